@@ -0,0 +1,13 @@
+// include/errno.h - Error numbers returned (negated) by system calls
+#ifndef ERRNO_H
+#define ERRNO_H
+
+#define EPERM   1       // Operation not permitted
+#define EBADF   9       // Bad file descriptor
+#define ENOMEM  12      // Out of memory or address space
+#define EACCES  13      // Permission denied
+#define EFAULT  14      // Bad address
+#define EINVAL  22      // Invalid argument
+#define ESPIPE  29      // Descriptor cannot seek
+
+#endif
@@ -0,0 +1,17 @@
+// include/kernel/config.h - Build-time kernel configuration
+#ifndef KERNEL_CONFIG_H
+#define KERNEL_CONFIG_H
+
+// Scheduler tick frequency. Time-based constants are expressed in
+// milliseconds and converted with TIMER_MS_TO_TICKS, so any value that
+// divides 1000 works.
+#define CONFIG_HZ 100
+
+// Stop the periodic tick while idle (dynamic ticks)
+#define CONFIG_NOHZ 1
+
+// Drive the tick from each CPU's local APIC timer when one is present;
+// 0 keeps the PIT as the only tick source
+#define CONFIG_LAPIC_TIMER 1
+
+#endif // KERNEL_CONFIG_H
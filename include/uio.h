@@ -0,0 +1,15 @@
+// include/uio.h - Scatter/gather I/O vectors
+#ifndef UIO_H
+#define UIO_H
+
+#include "types.h"
+
+// Most segments one readv/writev takes
+#define IOV_MAX 64
+
+typedef struct iovec {
+    void* iov_base;
+    uint32_t iov_len;
+} iovec_t;
+
+#endif
@@ -1,7 +1,9 @@
 // kernel/apps/app_manager.c - Application Management Implementation
 #include "app_manager.h"
 #include "../proc/process.h"
+#include "../proc/scheduler.h"
 #include "../core/monitor.h"
+#include "../drivers/mouse/mouse.h"
 
 // External app functions
 extern void start_calculator_app(void);
@@ -16,10 +18,12 @@ void calculator_process_entry(void) {
     start_calculator_app();
     
     // Keep process alive while app is active
+    uint32_t seen = mouse_get_packet_count();
     while (is_calculator_active()) {
         update_calculator_app();
-        // Yield to prevent CPU hogging
-        for (volatile int i = 0; i < 1000; i++);
+        // Input only changes on mouse packets: sleep until the next one
+        seen = mouse_wait_packet(seen);
+        thread_testcancel();
     }
 }
 
@@ -63,6 +67,8 @@ int app_launch(app_type_t type) {
             // Create process for calculator
             process_t* proc = process_create("calculator", calculator_process_entry);
             if (proc) {
+                // Interactive: favour over CPU-bound background work
+                scheduler_set_nice(proc->main_thread, APP_GUI_NICE);
                 app->pid = proc->pid;
                 print_string("[APP] Launched Calculator (PID ");
                 print_dec(app->pid);
@@ -74,28 +80,28 @@ int app_launch(app_type_t type) {
                 return -1;
             }
             break;
-            
+        
         case APP_TEXT_EDITOR:
             // TODO: Implement text editor
             print_string("[APP] Text editor not yet implemented\n");
             app->active = 0;
             app_count--;
             return -1;
-            
+        
         case APP_FILE_BROWSER:
             // TODO: Implement file browser
             print_string("[APP] File browser not yet implemented\n");
             app->active = 0;
             app_count--;
             return -1;
-            
+        
         case APP_TERMINAL:
             // TODO: Implement terminal
             print_string("[APP] Terminal not yet implemented\n");
             app->active = 0;
             app_count--;
             return -1;
-            
+        
         default:
             print_string("[APP] Unknown app type\n");
             app->active = 0;
@@ -118,11 +124,15 @@ void app_close(int app_id) {
     }
     
     // Terminate process
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i] && process_table[i]->pid == app->pid) {
-            process_terminate(process_table[i]);
-            break;
-        }
+    process_t* proc = process_find(app->pid);
+    if (proc && proc == process_get_current()) {
+        // Closing our own process does not return; our thread keeps it
+        // alive until then
+        process_put(proc);
+        process_terminate(proc);
+    } else if (proc) {
+        process_terminate(proc);
+        process_put(proc);
     }
     
     app->active = 0;
@@ -140,19 +150,13 @@ void app_manager_update(void) {
     for (int i = 0; i < app_count; i++) {
         if (apps[i].active) {
             // Check if process still exists
-            int process_exists = 0;
-            for (int j = 0; j < MAX_PROCESSES; j++) {
-                if (process_table[j] && 
-                    process_table[j]->pid == apps[i].pid &&
-                    process_table[j]->state != PROCESS_TERMINATED) {
-                    process_exists = 1;
-                    break;
-                }
-            }
-            
-            if (!process_exists) {
+            process_t* proc = process_find(apps[i].pid);
+            if (!proc || proc->exiting) {
                 apps[i].active = 0;
             }
+            if (proc) {
+                process_put(proc);
+            }
         }
     }
 }
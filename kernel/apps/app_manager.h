@@ -6,6 +6,9 @@
 
 #define MAX_APPS 16
 
+// Nice value given to GUI application processes
+#define APP_GUI_NICE (-5)
+
 typedef enum {
     APP_CALCULATOR,
     APP_TEXT_EDITOR,
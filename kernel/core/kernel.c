@@ -1,32 +1,61 @@
 // kernel/core/kernel.c
 #include "../core/monitor.h"
 #include "../core/panic.h"
+#include "../core/softirq.h"
 #include "../hal/gdt.h"
 #include "../hal/idt.h"
 #include "../hal/isr.h"
 #include "../hal/irq.h"
+#include "../hal/smp.h"
 #include "../mm/pmm.h"
 #include "../mm/heap.h"
 #include "../mm/paging.h"
+#include "../mm/vdso.h"
 #include "../proc/process.h"
 #include "../proc/scheduler.h"
+#include "../proc/fpu.h"
+#include "../proc/workqueue.h"
 #include "../drivers/timer/pit.h"
 #include "../drivers/keyboard/keyboard.h"
 #include "../drivers/mouse/mouse.h"
+#include "../drivers/serial/serial.h"
 #include "../drivers/gpu/gpu_detect.h"
 #include "../drivers/gpu/intel/i915_hd4600.h"
 #include "../drivers/video/gop_fb.h"
-#include "../fs/vfs_complete.h"
+#include "../fs/initrd.h"
+#include "../fs/dcache.h"
 #include "../syscall/syscall.h"
 #include "../usermode/usermode.h"
 #include "../../include/multiboot.h"
+#include "../../lib/libc/string.h"
 
 extern uint32_t kernel_end;
-extern fs_node_t* fs_root;
+
+// From vfs_complete.c, whose header clashes with vfs.h
+extern void vfs_init(void);
 
 // RGB color helper
 #define RGB(r,g,b) (0xFF000000 | ((r)<<16) | ((g)<<8) | (b))
 
+// Whether word appears as a whole word on the boot command line
+static int cmdline_has(multiboot_info_t* mbi, const char* word) {
+    if (!(mbi->flags & MULTIBOOT_FLAG_CMDLINE) || !mbi->cmdline) {
+        return 0;
+    }
+    
+    const char* p = (const char*)mbi->cmdline;
+    uint32_t len = strlen(word);
+    while (*p) {
+        while (*p == ' ') p++;
+        const char* start = p;
+        while (*p && *p != ' ') p++;
+        if ((uint32_t)(p - start) == len && memcmp(start, word, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     clear_screen();
     print_string("=================================\n");
@@ -39,6 +68,12 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
         for(;;) asm("cli; hlt");
     }
     
+    // "serial" on the command line mirrors the console to COM1
+    if (cmdline_has(mbi, "serial") && serial_init() == 0) {
+        console_set_serial(1);
+        print_string("Console: VGA text + COM1\n");
+    }
+    
     // Core initialization
     print_string("[1/17] GDT..."); 
     gdt_init(); 
@@ -58,6 +93,10 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     
     print_string(" [OK]\n");
     
+    print_string("[3.5/17] FPU/SSE...");
+    fpu_init();
+    print_string(" [OK]\n");
+    
     print_string("[4/17] IRQs..."); 
     irq_install(); 
     print_string(" [OK]\n");
@@ -76,10 +115,14 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     
     print_string("[7/17] VFS..."); 
     vfs_init();
-    fs_root = 0; 
     print_string(" [OK]\n");
     
-    print_string("[8/17] InitRD... [SKIP]\n");
+    print_string("[8/17] InitRD...\n");
+    if (initrd_mount(mbi)) {
+        print_string("  [OK]\n");
+    } else {
+        print_string("  [SKIP] No boot module\n");
+    }
     
     print_string("[9/17] Process..."); 
     process_init(); 
@@ -87,10 +130,20 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     
     print_string("[10/17] Scheduler..."); 
     scheduler_init(); 
+    softirq_init();
     print_string(" [OK]\n");
     
     print_string("[11/17] Timer..."); 
-    timer_init(100); 
+    timer_init(TIMER_HZ); 
+    print_string(" [OK]\n");
+    
+    print_string("[11.5/17] SMP...");
+    smp_init();
+    print_string(" [OK]\n");
+    
+    print_string("[11.6/17] Workers...");
+    softirq_start_threads();
+    workqueue_init();
     print_string(" [OK]\n");
     
     print_string("[12/17] Keyboard..."); 
@@ -104,6 +157,7 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     
     print_string("[14/17] User Mode...");
     usermode_init();
+    vdso_init();
     print_string(" [OK]\n");
     
     // GPU Detection & Driver Loading
@@ -205,6 +259,7 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     // Run paging tests
     print_string("\n");
     paging_test();
+    dcache_test();
     
     // Test exception handling (optional - will crash!)
     print_string("\n=== Exception Handler Test ===\n");
@@ -242,8 +297,11 @@ void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
         print_string("Kernel running in text mode...\n");
     }
     
-    // Idle loop
+    // Idle loop: sleep until the next timer event or interrupt
     while (1) {
-        asm volatile("hlt");
+        timer_idle();
+        if (scheduler_has_ready()) {
+            yield();
+        }
     }
 }
\ No newline at end of file
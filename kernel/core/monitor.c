@@ -1,4 +1,7 @@
 #include "monitor.h"
+#include "spinlock.h"
+#include "../drivers/serial/serial.h"
+#include "../../lib/libc/string.h"
 
 static uint16_t* video_memory = (uint16_t*)0xB8000;
 static uint8_t cursor_x = 0;
@@ -20,31 +23,16 @@ void clear_screen(void) {
     scrollback_offset = 0;
 }
 
-static void save_line_to_scrollback(void) {
+static void save_line_to_scrollback(uint32_t row) {
     if (scrollback_count < SCROLLBACK_LINES) {
         for (int i = 0; i < 80; i++) {
             scrollback_buffer[scrollback_count][i] = 
-                (char)(video_memory[i] & 0xFF);
+                (char)(video_memory[row * 80 + i] & 0xFF);
         }
         scrollback_count++;
     }
 }
 
-static void scroll(void) {
-    if (cursor_y >= 25) {
-        save_line_to_scrollback();
-        
-        for (int i = 0; i < 24 * 80; i++) {
-            video_memory[i] = video_memory[i + 80];
-        }
-        
-        for (int i = 24 * 80; i < 25 * 80; i++) {
-            video_memory[i] = (attribute << 8) | ' ';
-        }
-        cursor_y = 24;
-    }
-}
-
 void scroll_up(void) {
     if (scrollback_offset < scrollback_count) {
         scrollback_offset++;
@@ -63,60 +51,179 @@ void scroll_down(void) {
     }
 }
 
-void print_char(char c) {
-    if (c == '\n') {
-        cursor_x = 0;
-        cursor_y++;
-    } else if (c == '\b') {
-        if (cursor_x > 0) {
-            cursor_x--;
-            video_memory[cursor_y * 80 + cursor_x] = (attribute << 8) | ' ';
+// Serializes screen output between CPUs
+static spinlock_t console_lock = SPINLOCK_INIT;
+static int console_serial = 0;
+
+// Lines of scrolling one batch may need; one memmove makes room for all
+#define CONSOLE_BATCH_LINES 24
+
+// Length of the prefix of buf that starts at column x and advances at most
+// max_lines lines, which it stores in *lines. Mirrors console_render.
+static uint32_t console_measure(const char* buf, uint32_t len, uint32_t x,
+                                uint32_t max_lines, uint32_t* lines) {
+    uint32_t n = 0;
+    uint32_t i;
+    
+    for (i = 0; i < len; i++) {
+        char c = buf[i];
+        uint32_t next = x;
+        int advance = 0;
+        
+        if (c == '\n') {
+            next = 0;
+            advance = 1;
+        } else if (c == '\r') {
+            next = 0;
+        } else if (c == '\b') {
+            next = x ? x - 1 : 0;
+        } else if (c == '\t') {
+            next = (x + 4) & ~(4 - 1);
+        } else {
+            next = x + 1;
         }
-    } else if (c == '\t') {
-        cursor_x = (cursor_x + 4) & ~(4 - 1);
-    } else {
-        video_memory[cursor_y * 80 + cursor_x] = (attribute << 8) | c;
-        cursor_x++;
+        if (next >= 80) {
+            next = 0;
+            advance = 1;
+        }
+        
+        if (advance) {
+            if (n == max_lines) {
+                break;
+            }
+            n++;
+        }
+        x = next;
+    }
+    
+    *lines = n;
+    return i;
+}
+
+// Scroll the screen up by n lines (1..24) in one move
+static void console_scroll(uint32_t n) {
+    for (uint32_t line = 0; line < n; line++) {
+        save_line_to_scrollback(line);
     }
     
-    if (cursor_x >= 80) {
-        cursor_x = 0;
-        cursor_y++;
+    // Forward copy two cells at a time: the destination is below the source
+    uint32_t* dst = (uint32_t*)video_memory;
+    const uint32_t* src = (const uint32_t*)(video_memory + n * 80);
+    for (uint32_t i = 0; i < (25 - n) * 40; i++) {
+        dst[i] = src[i];
     }
     
-    scroll();
+    uint32_t blank = ((attribute << 8) | ' ') * 0x00010001u;
+    for (uint32_t i = (25 - n) * 40; i < 25 * 40; i++) {
+        dst[i] = blank;
+    }
+    cursor_y -= n;
 }
 
-void print_string(const char* str) {
-    for (int i = 0; str[i] != '\0'; i++) {
-        print_char(str[i]);
+// Draw text known to stay on screen: runs of printable characters are
+// stored to consecutive cells, control characters only move the cursor
+static void console_render(const char* buf, uint32_t len) {
+    uint16_t attr = attribute << 8;
+    uint32_t x = cursor_x;
+    uint32_t y = cursor_y;
+    uint32_t i = 0;
+    
+    while (i < len) {
+        char c = buf[i];
+        
+        if (c == '\n') {
+            x = 0;
+            y++;
+            i++;
+            continue;
+        }
+        if (c == '\r' || c == '\b' || c == '\t') {
+            if (c == '\r') {
+                x = 0;
+            } else if (c == '\b') {
+                if (x > 0) {
+                    x--;
+                    video_memory[y * 80 + x] = attr | ' ';
+                }
+            } else {
+                x = (x + 4) & ~(4 - 1);
+            }
+            i++;
+        } else {
+            uint16_t* cell = &video_memory[y * 80 + x];
+            while (i < len && x < 80 && buf[i] != '\n' && buf[i] != '\r' &&
+                   buf[i] != '\b' && buf[i] != '\t') {
+                *cell++ = attr | (uint8_t)buf[i++];
+                x++;
+            }
+        }
+        
+        if (x >= 80) {
+            x = 0;
+            y++;
+        }
     }
+    
+    cursor_x = x;
+    cursor_y = y;
 }
 
-void print_dec(uint32_t n) {
-    if (n == 0) {
-        print_char('0');
-        return;
+static void console_write_locked(const char* buf, uint32_t len) {
+    if (console_serial) {
+        serial_write(buf, len);
     }
     
-    char buffer[32];
-    int i = 0;
+    while (len > 0) {
+        uint32_t lines;
+        uint32_t n = console_measure(buf, len, cursor_x, CONSOLE_BATCH_LINES, &lines);
+        
+        if (cursor_y + lines > 24) {
+            console_scroll(cursor_y + lines - 24);
+        }
+        console_render(buf, n);
+        
+        buf += n;
+        len -= n;
+    }
+}
+
+void console_write(const char* buf, uint32_t len) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    console_write_locked(buf, len);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void console_set_serial(int enable) {
+    console_serial = enable && serial_present();
+}
+
+void print_char(char c) {
+    console_write(&c, 1);
+}
+
+void print_string(const char* str) {
+    console_write(str, strlen(str));
+}
+
+void print_dec(uint32_t n) {
+    char buffer[12];
+    int i = sizeof(buffer);
     
-    while (n > 0) {
-        buffer[i++] = '0' + (n % 10);
+    do {
+        buffer[--i] = '0' + (n % 10);
         n /= 10;
-    }
+    } while (n > 0);
     
-    while (i > 0) {
-        print_char(buffer[--i]);
-    }
+    console_write(&buffer[i], sizeof(buffer) - i);
 }
 
 void print_hex(uint32_t n) {
     const char* hex = "0123456789ABCDEF";
-    for (int i = 28; i >= 0; i -= 4) {
-        print_char(hex[(n >> i) & 0xF]);
+    char buffer[8];
+    for (int i = 0; i < 8; i++) {
+        buffer[i] = hex[(n >> (28 - i * 4)) & 0xF];
     }
+    console_write(buffer, sizeof(buffer));
 }
 
 void set_text_color(uint8_t foreground, uint8_t background) {
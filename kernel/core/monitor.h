@@ -5,6 +5,13 @@
 
 void clear_screen(void);
 void print_char(char c);
+
+// Write len bytes in one pass: control characters are interpreted, runs
+// of text stored straight to the screen, and scrolling done once per
+// screenful. Also sent to the serial port once console_set_serial(1).
+void console_write(const char* buf, uint32_t len);
+void console_set_serial(int enable);
+
 void print_string(const char* str);
 void print_dec(uint32_t n);
 void print_hex(uint32_t n);
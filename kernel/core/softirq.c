@@ -0,0 +1,314 @@
+// kernel/core/softirq.c - Deferred interrupt work: softirqs and tasklets
+//
+// Hard IRQ handlers do only what cannot wait (acknowledge the device,
+// grab its data) and raise a softirq for the rest. Pending softirqs are
+// per CPU and run on the way out of the outermost interrupt, with
+// interrupts enabled, so a slow bottom half no longer delays every other
+// device. If they keep being re-raised the remainder is handed to that
+// CPU's ksoftirqd thread, which competes for the CPU like any other.
+//
+// A reschedule requested from IRQ context (cpu->need_resched) is also
+// carried out here, after the softirqs, instead of inside the handler.
+#include "softirq.h"
+#include "monitor.h"
+#include "../hal/cpu.h"
+#include "../hal/smp.h"
+#include "../proc/process.h"
+#include "../proc/thread.h"
+#include "../proc/scheduler.h"
+#include "../proc/wait.h"
+#include "../drivers/timer/pit.h"
+#include "../../lib/libc/string.h"
+
+typedef struct {
+    volatile uint32_t pending;      // Bit per softirq vector
+    uint32_t irq_depth;             // Nested hard IRQs
+    uint8_t active;                 // Draining softirqs
+    uint32_t irq_start;             // timer_clock_us() at outermost entry
+    tasklet_t* tasklet_head[2];     // Index 0: SOFTIRQ_HI, 1: SOFTIRQ_TASKLET
+    tasklet_t** tasklet_tail[2];
+    thread_t* ksoftirqd;
+    wait_queue_t wait;              // ksoftirqd sleeps here
+    irq_stats_t stats;
+} softirq_cpu_t;
+
+static void (*softirq_vec[NR_SOFTIRQS])(void);
+static softirq_cpu_t softirq_cpus[MAX_CPUS];
+
+static inline softirq_cpu_t* this_softirq_cpu(void) {
+    return &softirq_cpus[cpu_current()->id];
+}
+
+static inline uint32_t xchg32(volatile uint32_t* ptr, uint32_t value) {
+    asm volatile("xchg %0, %1" : "+r"(value), "+m"(*ptr) :: "memory");
+    return value;
+}
+
+static void wakeup_softirqd(softirq_cpu_t* sc) {
+    if (sc->ksoftirqd) {
+        wake_up_one(&sc->wait);
+    }
+}
+
+void open_softirq(uint32_t nr, void (*action)(void)) {
+    if (nr < NR_SOFTIRQS) {
+        softirq_vec[nr] = action;
+    }
+}
+
+int in_interrupt(void) {
+    softirq_cpu_t* sc = this_softirq_cpu();
+    return sc->irq_depth || sc->active;
+}
+
+void raise_softirq_irqoff(uint32_t nr) {
+    softirq_cpu_t* sc = this_softirq_cpu();
+    sc->pending |= 1u << nr;
+    
+    // Nothing will drain it on an IRQ exit soon: hand it to the thread
+    if (!sc->irq_depth && !sc->active) {
+        wakeup_softirqd(sc);
+    }
+}
+
+void raise_softirq(uint32_t nr) {
+    uint32_t flags = cpu_irq_save();
+    raise_softirq_irqoff(nr);
+    cpu_irq_restore(flags);
+}
+
+// Run pending softirqs until none are left or the restart/time budget is
+// spent. Entered and left with interrupts disabled.
+static void softirq_run(softirq_cpu_t* sc) {
+    uint32_t start = timer_clock_us();
+    int restart = SOFTIRQ_MAX_RESTART;
+    uint32_t pending;
+    
+    sc->active = 1;
+    while ((pending = sc->pending) != 0) {
+        sc->pending = 0;
+        asm volatile("sti" ::: "memory");
+        
+        for (uint32_t nr = 0; pending; nr++, pending >>= 1) {
+            if ((pending & 1) && softirq_vec[nr]) {
+                softirq_vec[nr]();
+                sc->stats.softirqs[nr]++;
+            }
+        }
+        
+        asm volatile("cli" ::: "memory");
+        if (--restart == 0 || timer_clock_us() - start >= SOFTIRQ_MAX_US) {
+            break;
+        }
+    }
+    sc->active = 0;
+    
+    uint32_t us = timer_clock_us() - start;
+    sc->stats.softirq_us += us;
+    if (us > sc->stats.softirq_max_us) {
+        sc->stats.softirq_max_us = us;
+    }
+}
+
+void irq_enter(void) {
+    softirq_cpu_t* sc = this_softirq_cpu();
+    if (sc->irq_depth++ == 0) {
+        sc->irq_start = timer_clock_us();
+    }
+}
+
+void irq_exit(void) {
+    softirq_cpu_t* sc = this_softirq_cpu();
+    if (--sc->irq_depth > 0) {
+        return;
+    }
+    
+    uint32_t us = timer_clock_us() - sc->irq_start;
+    sc->stats.hardirqs++;
+    sc->stats.hardirq_us += us;
+    if (us > sc->stats.hardirq_max_us) {
+        sc->stats.hardirq_max_us = us;
+    }
+    
+    // An interrupted drain (or ksoftirqd) picks up whatever we raised
+    if (sc->active) {
+        return;
+    }
+    
+    if (sc->pending) {
+        softirq_run(sc);
+        if (sc->pending) {
+            sc->stats.ksoftirqd_wakeups++;
+            wakeup_softirqd(sc);
+        }
+    }
+    
+    cpu_t* cpu = cpu_current();
+    if (cpu->need_resched) {
+        preempt_schedule();
+    }
+}
+
+static void ksoftirqd_main(void* arg) {
+    softirq_cpu_t* sc = (softirq_cpu_t*)arg;
+    
+    for (;;) {
+        wait_event(sc->wait, sc->pending != 0);
+        
+        uint32_t flags = cpu_irq_save();
+        if (sc->pending) {
+            softirq_run(sc);
+        }
+        int resched = cpu_current()->need_resched;
+        cpu_irq_restore(flags);
+        
+        if (resched) {
+            schedule();
+        }
+    }
+}
+
+// Tasklets are queued on the CPU that scheduled them and only touched by
+// that CPU with interrupts off, so the lists need no lock
+static void tasklet_queue(tasklet_t* t, int list, uint32_t nr) {
+    if (xchg32(&t->scheduled, 1)) {
+        return;
+    }
+    
+    uint32_t flags = cpu_irq_save();
+    softirq_cpu_t* sc = this_softirq_cpu();
+    t->next = NULL;
+    *sc->tasklet_tail[list] = t;
+    sc->tasklet_tail[list] = &t->next;
+    raise_softirq_irqoff(nr);
+    cpu_irq_restore(flags);
+}
+
+void tasklet_init(tasklet_t* t, void (*func)(void* data), void* data) {
+    t->next = NULL;
+    t->scheduled = 0;
+    t->running = 0;
+    t->func = func;
+    t->data = data;
+}
+
+void tasklet_schedule(tasklet_t* t) {
+    tasklet_queue(t, 1, SOFTIRQ_TASKLET);
+}
+
+void tasklet_hi_schedule(tasklet_t* t) {
+    tasklet_queue(t, 0, SOFTIRQ_HI);
+}
+
+static void tasklet_action_common(int list, uint32_t nr) {
+    softirq_cpu_t* sc = this_softirq_cpu();
+    
+    asm volatile("cli" ::: "memory");
+    tasklet_t* t = sc->tasklet_head[list];
+    sc->tasklet_head[list] = NULL;
+    sc->tasklet_tail[list] = &sc->tasklet_head[list];
+    asm volatile("sti" ::: "memory");
+    
+    while (t) {
+        tasklet_t* next = t->next;
+        
+        if (xchg32(&t->running, 1) == 0) {
+            // Cleared first so the function may reschedule itself
+            xchg32(&t->scheduled, 0);
+            t->func(t->data);
+            sc->stats.tasklets++;
+            xchg32(&t->running, 0);
+        } else {
+            // Still running on another CPU: try again next round
+            asm volatile("cli" ::: "memory");
+            t->next = NULL;
+            *sc->tasklet_tail[list] = t;
+            sc->tasklet_tail[list] = &t->next;
+            sc->pending |= 1u << nr;
+            asm volatile("sti" ::: "memory");
+        }
+        t = next;
+    }
+}
+
+static void tasklet_hi_action(void) {
+    tasklet_action_common(0, SOFTIRQ_HI);
+}
+
+static void tasklet_action(void) {
+    tasklet_action_common(1, SOFTIRQ_TASKLET);
+}
+
+void softirq_init(void) {
+    for (int i = 0; i < MAX_CPUS; i++) {
+        softirq_cpu_t* sc = &softirq_cpus[i];
+        
+        memset(sc, 0, sizeof(softirq_cpu_t));
+        sc->tasklet_tail[0] = &sc->tasklet_head[0];
+        sc->tasklet_tail[1] = &sc->tasklet_head[1];
+        wait_queue_init(&sc->wait);
+    }
+    
+    open_softirq(SOFTIRQ_HI, tasklet_hi_action);
+    open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+void softirq_start_threads(void) {
+    process_t* proc = process_create_kernel("ksoftirqd");
+    if (!proc) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (!cpus[i].online) {
+            continue;
+        }
+        softirq_cpus[i].ksoftirqd = thread_create_on(proc, ksoftirqd_main,
+                                                     &softirq_cpus[i], i);
+    }
+}
+
+void softirq_get_stats(uint32_t cpu, irq_stats_t* stats) {
+    if (cpu < MAX_CPUS) {
+        *stats = softirq_cpus[cpu].stats;
+    }
+}
+
+static void print_padded(uint32_t value, uint32_t width) {
+    uint32_t digits = 1;
+    for (uint32_t v = value; v >= 10; v /= 10) digits++;
+    print_dec(value);
+    for (; digits < width; digits++) print_char(' ');
+}
+
+void softirq_stat_list(void) {
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        irq_stats_t stats;
+        softirq_get_stats(i, &stats);
+        
+        print_string("  ");
+        print_padded(i, 5);
+        print_padded(stats.hardirqs, 10);
+        print_padded(stats.hardirq_us / 1000, 9);
+        print_padded(stats.hardirq_max_us, 8);
+        print_padded(stats.softirq_us / 1000, 9);
+        print_padded(stats.softirq_max_us, 8);
+        print_padded(stats.tasklets, 10);
+        print_dec(stats.ksoftirqd_wakeups);
+        print_string("\n");
+    }
+    
+    static const char* names[NR_SOFTIRQS] = { "HI", "TIMER", "TASKLET", "SCHED" };
+    print_string("\nSoftirqs run:\n");
+    for (int nr = 0; nr < NR_SOFTIRQS; nr++) {
+        print_string("  ");
+        print_string(names[nr]);
+        for (int j = strlen(names[nr]); j < 9; j++) {
+            print_char(' ');
+        }
+        for (uint32_t i = 0; i < cpu_count; i++) {
+            print_padded(softirq_cpus[i].stats.softirqs[nr], 10);
+        }
+        print_string("\n");
+    }
+}
@@ -0,0 +1,78 @@
+// kernel/core/softirq.h - Deferred interrupt work: softirqs and tasklets
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include "../../include/types.h"
+
+// Softirq vectors, run in this order
+enum {
+    SOFTIRQ_HI,         // High priority tasklets
+    SOFTIRQ_TIMER,      // Timer wheel and periodic housekeeping
+    SOFTIRQ_TASKLET,    // Tasklets
+    SOFTIRQ_SCHED,      // Load balancing
+    NR_SOFTIRQS
+};
+
+// Drain at most this many rounds of re-raised softirqs, or this long, on
+// IRQ exit before leaving the rest to ksoftirqd
+#define SOFTIRQ_MAX_RESTART 10
+#define SOFTIRQ_MAX_US      2000
+
+// Tasklets: a function run once in softirq context after each schedule.
+// The same tasklet never runs on two CPUs at once.
+typedef struct tasklet {
+    struct tasklet* next;
+    volatile uint32_t scheduled;    // Queued and not yet started
+    volatile uint32_t running;      // Executing on some CPU
+    void (*func)(void* data);
+    void* data;
+} tasklet_t;
+
+#define TASKLET_INIT(func, data) { NULL, 0, 0, func, data }
+
+// Per-CPU interrupt statistics, shown by irqstat. Times in microseconds.
+typedef struct {
+    uint32_t hardirqs;          // Hardware interrupts taken
+    uint32_t hardirq_us;        // Time in hard IRQ handlers (interrupts off)
+    uint32_t hardirq_max_us;
+    uint32_t softirqs[NR_SOFTIRQS];
+    uint32_t softirq_us;        // Time in softirqs (interrupts on)
+    uint32_t softirq_max_us;    // Longest single drain
+    uint32_t tasklets;          // Tasklet runs
+    uint32_t ksoftirqd_wakeups; // Drains handed over to ksoftirqd
+} irq_stats_t;
+
+void softirq_init(void);
+
+// Start one ksoftirqd thread per online CPU; needs the scheduler and SMP
+void softirq_start_threads(void);
+
+// Install the handler for a softirq vector
+void open_softirq(uint32_t nr, void (*action)(void));
+
+// Mark a softirq pending on the calling CPU. The _irqoff variant is for
+// hard IRQ context; raise_softirq may be called from anywhere and wakes
+// ksoftirqd when not in an interrupt.
+void raise_softirq(uint32_t nr);
+void raise_softirq_irqoff(uint32_t nr);
+
+// Bracket every hardware interrupt handler. irq_exit runs pending
+// softirqs and any reschedule requested by the handler once the outermost
+// interrupt is done.
+void irq_enter(void);
+void irq_exit(void);
+
+// In a hard IRQ handler or softirq: the caller must not sleep
+int in_interrupt(void);
+
+void tasklet_init(tasklet_t* t, void (*func)(void* data), void* data);
+void tasklet_schedule(tasklet_t* t);
+void tasklet_hi_schedule(tasklet_t* t);
+
+// Copy the statistics of one CPU
+void softirq_get_stats(uint32_t cpu, irq_stats_t* stats);
+
+// Print per-CPU interrupt statistics (shell irqstat)
+void softirq_stat_list(void);
+
+#endif // SOFTIRQ_H
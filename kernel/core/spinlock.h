@@ -0,0 +1,56 @@
+// kernel/core/spinlock.h - Busy-wait locks for SMP
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "../../include/types.h"
+#include "../hal/cpu.h"
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock_init(spinlock_t* lock) {
+    lock->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+    uint32_t old;
+    for (;;) {
+        old = 1;
+        asm volatile("xchg %0, %1" : "+r"(old), "+m"(lock->locked) :: "memory");
+        if (old == 0) {
+            return;
+        }
+        // Spin on a plain read so the cache line is not bounced
+        while (lock->locked) {
+            asm volatile("pause");
+        }
+    }
+}
+
+static inline int spin_trylock(spinlock_t* lock) {
+    uint32_t old = 1;
+    asm volatile("xchg %0, %1" : "+r"(old), "+m"(lock->locked) :: "memory");
+    return old == 0;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile("" ::: "memory");
+    lock->locked = 0;
+}
+
+// Lock and disable local interrupts, returning the previous EFLAGS
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = cpu_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
@@ -1,5 +1,7 @@
 #include "keyboard.h"
 #include "../../hal/irq.h"
+#include "../../proc/wait.h"
+#include "../../core/softirq.h"
 #include "../../../include/io.h"
 
 #define KEYBOARD_DATA_PORT 0x60
@@ -11,6 +13,19 @@ static int buffer_tail = 0;
 static int shift_pressed = 0;
 static int caps_lock = 0;
 
+// Raw scancodes from the IRQ handler, decoded by the tasklet
+#define SCANCODE_QUEUE_SIZE 64
+static uint8_t scancode_queue[SCANCODE_QUEUE_SIZE];
+static volatile uint32_t scancode_head = 0;
+static volatile uint32_t scancode_tail = 0;
+
+// Readers sleep here until the tasklet buffers a key
+static wait_queue_t keyboard_wq = WAIT_QUEUE_INIT;
+static spinlock_t keyboard_lock = SPINLOCK_INIT;
+
+static void keyboard_tasklet_func(void* data);
+static tasklet_t keyboard_tasklet = TASKLET_INIT(keyboard_tasklet_func, NULL);
+
 static unsigned char scancode_to_ascii[128] = {
     0, 27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
@@ -29,11 +44,7 @@ static unsigned char scancode_to_ascii_shift[128] = {
     0, 0, 0, '+', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-static void keyboard_handler(registers_t* regs) {
-    (void)regs;
-    
-    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    
+static void keyboard_process(uint8_t scancode) {
     if (scancode == 0x2A || scancode == 0x36) {  // Left/Right Shift pressed
         shift_pressed = 1;
         return;
@@ -59,12 +70,39 @@ static void keyboard_handler(registers_t* regs) {
     }
     
     if (ascii != 0) {
+        uint32_t flags = spin_lock_irqsave(&keyboard_lock);
         int next_head = (buffer_head + 1) % 256;
         if (next_head != buffer_tail) {
             input_buffer[buffer_head] = ascii;
             buffer_head = next_head;
         }
+        spin_unlock_irqrestore(&keyboard_lock, flags);
+    }
+}
+
+// Decode everything the IRQ handler queued, then wake readers once
+static void keyboard_tasklet_func(void* data) {
+    (void)data;
+    
+    while (scancode_tail != scancode_head) {
+        keyboard_process(scancode_queue[scancode_tail % SCANCODE_QUEUE_SIZE]);
+        scancode_tail++;
+    }
+    wake_up_all(&keyboard_wq);
+}
+
+// Hard IRQ: read the scancode (which acknowledges the controller) and
+// leave the decoding to the tasklet
+static void keyboard_handler(registers_t* regs) {
+    (void)regs;
+    
+    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+    
+    if (scancode_head - scancode_tail < SCANCODE_QUEUE_SIZE) {
+        scancode_queue[scancode_head % SCANCODE_QUEUE_SIZE] = scancode;
+        scancode_head++;
     }
+    tasklet_schedule(&keyboard_tasklet);
 }
 
 void keyboard_init(void) {
@@ -76,12 +114,32 @@ void keyboard_init(void) {
     irq_register_handler(1, keyboard_handler);
 }
 
+// Non-blocking: 0 if no key is buffered
 char keyboard_getchar(void) {
+    uint32_t flags = spin_lock_irqsave(&keyboard_lock);
+    
     if (buffer_head == buffer_tail) {
+        spin_unlock_irqrestore(&keyboard_lock, flags);
         return 0;
     }
     
     char c = input_buffer[buffer_tail];
     buffer_tail = (buffer_tail + 1) % 256;
+    spin_unlock_irqrestore(&keyboard_lock, flags);
+    return c;
+}
+
+void keyboard_wait_for_key(void) {
+    wait_event_killable(keyboard_wq, buffer_head != buffer_tail);
+}
+
+// Blocking: sleeps until a key arrives. 0 if the caller was killed
+// meanwhile.
+char keyboard_read(void) {
+    char c;
+    do {
+        keyboard_wait_for_key();
+        c = keyboard_getchar();
+    } while (c == 0 && !current_thread->killed);
     return c;
 }
@@ -9,6 +9,7 @@
 
 void keyboard_init();
 char keyboard_getchar();
+char keyboard_read(void);
 void keyboard_wait_for_key();
 
 #endif
\ No newline at end of file
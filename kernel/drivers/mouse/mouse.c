@@ -1,18 +1,12 @@
 #include "mouse.h"
+#include "../../hal/irq.h"
+#include "../../proc/wait.h"
+#include "../../core/softirq.h"
 #include <io.h>
 
 // Suppress unused parameter warning
 #define UNUSED(x) (void)(x)
 
-typedef struct registers {
-    uint32_t ds;
-    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
-    uint32_t int_no, err_code;
-    uint32_t eip, cs, eflags, useresp, ss;
-} registers_t;
-
-extern void irq_register_handler(int irq, void (*handler)(registers_t*));
-
 #define MOUSE_PORT   0x60
 #define MOUSE_STATUS 0x64
 #define MOUSE_ABIT   0x02
@@ -29,6 +23,18 @@ static int8_t mouse_byte[3];
 static uint32_t mouse_packet_count = 0;
 static uint32_t mouse_error_count = 0;
 
+// Tasks waiting for the next packet
+static wait_queue_t mouse_wq = WAIT_QUEUE_INIT;
+
+// Raw bytes from the IRQ handler, assembled into packets by the tasklet
+#define MOUSE_QUEUE_SIZE 64
+static uint8_t mouse_queue[MOUSE_QUEUE_SIZE];
+static volatile uint32_t mouse_queue_head = 0;
+static volatile uint32_t mouse_queue_tail = 0;
+
+static void mouse_tasklet_func(void* data);
+static tasklet_t mouse_tasklet = TASKLET_INIT(mouse_tasklet_func, NULL);
+
 static void mouse_wait(uint8_t type) {
     uint32_t timeout = 100000;
     if (type == 0) {
@@ -58,22 +64,13 @@ static uint8_t mouse_read(void) {
     return inb(MOUSE_PORT);
 }
 
-static void mouse_handler_wrapper(registers_t* regs) {
-    UNUSED(regs);
-    
-    uint8_t status = inb(MOUSE_STATUS);
-    
-    // Check if data is available from mouse
-    if (!(status & MOUSE_BBIT)) return;
-    if (!(status & MOUSE_F_BIT)) return;
-    
-    uint8_t data = inb(MOUSE_PORT);
-    
+// Returns 1 when a packet was completed and applied
+static int mouse_process(uint8_t data) {
     // Validate packet - first byte should have bit 3 set
     if (mouse_cycle == 0 && !(data & 0x08)) {
         // Invalid packet, reset cycle
         mouse_error_count++;
-        return;
+        return 0;
     }
     
     mouse_byte[mouse_cycle] = data;
@@ -96,11 +93,11 @@ static void mouse_handler_wrapper(registers_t* regs) {
         // Check for overflow
         if (mouse_byte[0] & 0x40) {
             // X overflow - ignore this packet
-            return;
+            return 0;
         }
         if (mouse_byte[0] & 0x80) {
             // Y overflow - ignore this packet
-            return;
+            return 0;
         }
         
         // Apply acceleration for smoother movement
@@ -116,7 +113,44 @@ static void mouse_handler_wrapper(registers_t* regs) {
         if (mouse_state.x >= 640) mouse_state.x = 639;
         if (mouse_state.y < 0) mouse_state.y = 0;
         if (mouse_state.y >= 480) mouse_state.y = 479;
+        
+        return 1;
     }
+    return 0;
+}
+
+// Assemble queued bytes into packets, then wake waiters once
+static void mouse_tasklet_func(void* data) {
+    UNUSED(data);
+    
+    int packets = 0;
+    while (mouse_queue_tail != mouse_queue_head) {
+        packets += mouse_process(mouse_queue[mouse_queue_tail % MOUSE_QUEUE_SIZE]);
+        mouse_queue_tail++;
+    }
+    if (packets) {
+        wake_up_all(&mouse_wq);
+    }
+}
+
+// Hard IRQ: drain the controller byte and leave the decoding to the
+// tasklet
+static void mouse_handler_wrapper(registers_t* regs) {
+    UNUSED(regs);
+    
+    uint8_t status = inb(MOUSE_STATUS);
+    
+    // Check if data is available from mouse
+    if (!(status & MOUSE_BBIT)) return;
+    if (!(status & MOUSE_F_BIT)) return;
+    
+    uint8_t data = inb(MOUSE_PORT);
+    
+    if (mouse_queue_head - mouse_queue_tail < MOUSE_QUEUE_SIZE) {
+        mouse_queue[mouse_queue_head % MOUSE_QUEUE_SIZE] = data;
+        mouse_queue_head++;
+    }
+    tasklet_schedule(&mouse_tasklet);
 }
 
 void mouse_init(void) {
@@ -166,6 +200,13 @@ uint32_t mouse_get_packet_count(void) {
     return mouse_packet_count;
 }
 
+// Sleep until a packet newer than seen has been processed, or the caller
+// is killed
+uint32_t mouse_wait_packet(uint32_t seen) {
+    wait_event_killable(mouse_wq, mouse_packet_count != seen);
+    return mouse_packet_count;
+}
+
 uint32_t mouse_get_error_count(void) {
     return mouse_error_count;
 }
\ No newline at end of file
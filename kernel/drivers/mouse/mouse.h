@@ -14,6 +14,7 @@ mouse_state_t mouse_get_state(void);
 void mouse_handler(void);
 
 uint32_t mouse_get_packet_count(void);
+uint32_t mouse_wait_packet(uint32_t seen);
 uint32_t mouse_get_error_count(void);
 
 #define MOUSE_LEFT_BTN   0x01
@@ -0,0 +1,76 @@
+// kernel/drivers/serial/serial.c - 16550 UART output on COM1
+#include "serial.h"
+#include "../../../include/io.h"
+
+// Register offsets from the base port
+#define UART_DATA       0       // DLAB=0: transmit/receive
+#define UART_IER        1       // DLAB=0: interrupt enable
+#define UART_DLL        0       // DLAB=1: divisor low/high
+#define UART_DLM        1
+#define UART_FCR        2
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
+
+#define LCR_8N1         0x03
+#define LCR_DLAB        0x80
+#define FCR_ENABLE_CLEAR 0x07   // Enable and clear both FIFOs
+#define MCR_LOOPBACK    0x10
+#define MCR_DTR_RTS_OUT2 0x0B
+#define LSR_THRE        0x20    // Transmit holding register (FIFO) empty
+
+#define UART_FIFO_SIZE  16
+
+static int present = 0;
+
+int serial_init(void) {
+    uint16_t base = SERIAL_COM1;
+    uint16_t divisor = 115200 / SERIAL_BAUD;
+    
+    outb(base + UART_IER, 0x00);
+    outb(base + UART_LCR, LCR_DLAB);
+    outb(base + UART_DLL, divisor & 0xFF);
+    outb(base + UART_DLM, divisor >> 8);
+    outb(base + UART_LCR, LCR_8N1);
+    outb(base + UART_FCR, FCR_ENABLE_CLEAR);
+    
+    // A byte sent in loopback mode must come straight back
+    outb(base + UART_MCR, MCR_LOOPBACK | MCR_DTR_RTS_OUT2);
+    outb(base + UART_DATA, 0xAE);
+    if (inb(base + UART_DATA) != 0xAE) {
+        present = 0;
+        return -1;
+    }
+    
+    outb(base + UART_MCR, MCR_DTR_RTS_OUT2);
+    present = 1;
+    return 0;
+}
+
+int serial_present(void) {
+    return present;
+}
+
+void serial_write(const char* buf, uint32_t len) {
+    if (!present) {
+        return;
+    }
+    
+    uint32_t i = 0;
+    int cr_sent = 0;        // "\r" of a "\n" went out with the last burst
+    while (i < len) {
+        while (!(inb(SERIAL_COM1 + UART_LSR) & LSR_THRE)) {
+            asm volatile("pause");
+        }
+        
+        for (int room = UART_FIFO_SIZE; room > 0 && i < len; room--) {
+            if (buf[i] == '\n' && !cr_sent) {
+                outb(SERIAL_COM1 + UART_DATA, '\r');
+                cr_sent = 1;
+                continue;
+            }
+            outb(SERIAL_COM1 + UART_DATA, buf[i++]);
+            cr_sent = 0;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+// kernel/drivers/serial/serial.h - 16550 UART output on COM1
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "../../../include/types.h"
+
+#define SERIAL_COM1     0x3F8
+#define SERIAL_BAUD     115200
+
+// Program COM1 for 115200 8N1 with FIFOs. Returns -1 if no UART answers
+// the loopback test, in which case serial_write does nothing.
+int serial_init(void);
+
+int serial_present(void);
+
+// Send len bytes, "\n" as "\r\n". Polls the transmitter, refilling the
+// 16-byte FIFO each time it empties instead of waiting per byte.
+void serial_write(const char* buf, uint32_t len);
+
+#endif // SERIAL_H
@@ -0,0 +1,298 @@
+// kernel/drivers/timer/lapic_timer.c - Per-CPU local APIC timer tick
+//
+// Each CPU's local APIC timer raises its own scheduler tick, so
+// application processors no longer depend on a broadcast from the PIT.
+// The timer runs at an unknown bus-derived rate and is calibrated once on
+// the BSP: against the TSC when CPUID leaf 0x15 reports its frequency,
+// otherwise over a fixed PIT channel 2 interval, which is the only thing
+// the PIT is still used for.
+//
+// With TSC-deadline support every tick is an absolute TSC value, so late
+// interrupts do not accumulate drift. Otherwise the timer runs in one-shot
+// mode and is re-armed on every tick; both modes give dynamic ticks a
+// single long expiry without touching the PIT.
+#include "lapic_timer.h"
+#include "pit.h"
+#include "../../hal/apic.h"
+#include "../../hal/cpu.h"
+#include "../../hal/pic.h"
+#include "../../hal/smp.h"
+#include "../../proc/scheduler.h"
+#include "../../core/monitor.h"
+#include "../../../include/io.h"
+#include "../../../include/kernel/config.h"
+
+// Calibration window, at most 54ms (16-bit PIT count)
+#define CALIBRATE_MS 50
+
+#define PIT_FREQUENCY    1193180
+#define PIT_CHANNEL2     0x42
+#define PIT_COMMAND      0x43
+#define PIT_CH2_PORT     0x61    // Bit 0: gate, bit 1: speaker, bit 5: OUT2
+#define PIT_CH2_GATE     0x01
+#define PIT_CH2_SPEAKER  0x02
+#define PIT_CH2_OUT      0x20
+#define PIT_CMD_CH2_ONESHOT 0xB0 // Channel 2, lo/hi byte, mode 0
+
+static int timer_active = 0;
+static int use_tsc_deadline = 0;
+static uint32_t lapic_per_tick = 0;  // LAPIC counts (divide by 16) per tick
+static uint32_t tsc_per_tick = 0;    // 0 if the TSC rate is unknown
+static uint32_t tsc_per_us = 0;
+
+// Per-CPU tick state
+static uint64_t next_deadline[MAX_CPUS];   // TSC-deadline: next tick boundary
+static uint32_t nohz_count[MAX_CPUS];      // One-shot: count armed for nohz
+static uint32_t nohz_residual[MAX_CPUS];   // One-shot: counts into current tick
+static volatile int nohz[MAX_CPUS];
+
+// 64 by 32 bit division; the quotient must fit in 32 bits
+static inline uint32_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t q, r;
+    asm("divl %4" : "=a"(q), "=d"(r)
+                  : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+}
+
+// TSC frequency from CPUID leaf 0x15 (crystal clock ratio), 0 if unknown
+static uint64_t tsc_hz_from_cpuid(void) {
+    uint32_t eax, ebx, ecx, edx;
+    
+    if (cpu_max_leaf < 0x15) {
+        return 0;
+    }
+    cpuid(0x15, &eax, &ebx, &ecx, &edx);
+    if (eax == 0 || ebx == 0 || ecx == 0) {
+        return 0;
+    }
+    return div64_32((uint64_t)ecx * ebx, eax);
+}
+
+// Count LAPIC timer decrements (and TSC cycles) over CALIBRATE_MS
+static void calibrate(void) {
+    uint32_t window = CALIBRATE_MS * CONFIG_HZ;   // Ticks in window * 1000
+    int have_tsc = cpu_has_feature(CPUID_EDX_TSC);
+    uint64_t tsc_hz = have_tsc ? tsc_hz_from_cpuid() : 0;
+    
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    
+    if (tsc_hz) {
+        // TSC rate is architectural: time the LAPIC against it
+        uint32_t cycles = div64_32(tsc_hz * CALIBRATE_MS, 1000);
+        
+        lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+        uint64_t start = rdtsc();
+        while (rdtsc() - start < cycles) {
+            asm volatile("pause");
+        }
+        uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+        
+        lapic_per_tick = div64_32((uint64_t)elapsed * 1000, window);
+        tsc_per_tick = div64_32(tsc_hz, CONFIG_HZ);
+        print_string(" [calibrated by TSC]");
+    } else {
+        // Fall back to a PIT channel 2 one-shot; OUT2 rises at terminal count
+        uint16_t count = (uint16_t)(PIT_FREQUENCY * CALIBRATE_MS / 1000);
+        
+        outb(PIT_CH2_PORT, (inb(PIT_CH2_PORT) & ~PIT_CH2_SPEAKER) | PIT_CH2_GATE);
+        outb(PIT_COMMAND, PIT_CMD_CH2_ONESHOT);
+        outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+        outb(PIT_CHANNEL2, (uint8_t)(count >> 8));
+        
+        lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+        uint64_t start = have_tsc ? rdtsc() : 0;
+        while (!(inb(PIT_CH2_PORT) & PIT_CH2_OUT)) {
+            asm volatile("pause");
+        }
+        uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+        
+        lapic_per_tick = div64_32((uint64_t)elapsed * 1000, window);
+        if (have_tsc) {
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+            tsc_per_tick = div64_32((uint64_t)cycles * 1000, window);
+        }
+        print_string(" [calibrated by PIT]");
+    }
+    
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    
+    tsc_per_us = div64_32((uint64_t)tsc_per_tick * CONFIG_HZ, 1000000);
+}
+
+// Program the tick after the one that just fired
+static void arm_next(uint32_t id) {
+    if (use_tsc_deadline) {
+        uint64_t now = rdtsc();
+        next_deadline[id] += tsc_per_tick;
+        if (next_deadline[id] <= now) {
+            // Interrupts were off for more than a tick; resynchronize
+            next_deadline[id] = now + tsc_per_tick;
+        }
+        wrmsr(MSR_IA32_TSC_DEADLINE, next_deadline[id]);
+    } else {
+        lapic_write(LAPIC_TIMER_INIT, lapic_per_tick);
+    }
+}
+
+static void lapic_timer_handler(registers_t* regs) {
+    uint32_t id = cpu_current()->id;
+    
+    if (!nohz[id]) {
+        arm_next(id);
+    }
+    
+    // The BSP also keeps global time; everyone else only schedules
+    if (id == 0) {
+        timer_tick(regs);
+    } else {
+        scheduler_tick(regs);
+    }
+}
+
+void lapic_timer_start(void) {
+    if (!timer_active) {
+        return;
+    }
+    
+    uint32_t id = cpu_current()->id;
+    nohz[id] = 0;
+    nohz_residual[id] = 0;
+    
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    if (use_tsc_deadline) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSCDEADLINE | APIC_VECTOR_TIMER);
+        // Order the LVT write before the first deadline write
+        asm volatile("mfence" ::: "memory");
+        next_deadline[id] = rdtsc() + tsc_per_tick;
+        wrmsr(MSR_IA32_TSC_DEADLINE, next_deadline[id]);
+    } else {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | APIC_VECTOR_TIMER);
+        lapic_write(LAPIC_TIMER_INIT, lapic_per_tick);
+    }
+}
+
+int lapic_timer_init(void) {
+    if (!CONFIG_LAPIC_TIMER) {
+        return -1;
+    }
+    
+    uint32_t flags = cpu_irq_save();
+    calibrate();
+    cpu_irq_restore(flags);
+    
+    if (lapic_per_tick == 0) {
+        print_string(" [LAPIC timer unusable]");
+        return -1;
+    }
+    
+    use_tsc_deadline = tsc_per_tick != 0 &&
+                       cpu_has_feature(CPUID_EDX_MSR) &&
+                       cpu_has_feature_ecx(CPUID_ECX_TSC_DEADLINE);
+    
+    apic_register_handler(APIC_VECTOR_TIMER, lapic_timer_handler);
+    
+    // Hand the tick over: the PIT interrupt is no longer needed
+    flags = cpu_irq_save();
+    timer_active = 1;
+    pic_mask_irq(0);
+    lapic_timer_start();
+    cpu_irq_restore(flags);
+    
+    print_string(" [LAPIC timer ");
+    print_string(lapic_timer_mode());
+    print_string(", ");
+    print_dec(CONFIG_HZ);
+    print_string("Hz]");
+    return 0;
+}
+
+int lapic_timer_active(void) {
+    return timer_active;
+}
+
+int lapic_timer_clock_us(uint32_t* us) {
+    if (!tsc_per_us) {
+        return -1;
+    }
+    
+    // Divide the high word first so the quotient always fits divl; the
+    // result is the low 32 bits of the full quotient
+    uint64_t tsc = rdtsc();
+    uint32_t hi = (uint32_t)(tsc >> 32);
+    *us = div64_32(((uint64_t)(hi % tsc_per_us) << 32) | (uint32_t)tsc, tsc_per_us);
+    return 0;
+}
+
+uint32_t lapic_timer_tsc_per_us(void) {
+    return tsc_per_us;
+}
+
+const char* lapic_timer_mode(void) {
+    return use_tsc_deadline ? "tsc-deadline" : "one-shot";
+}
+
+uint32_t lapic_timer_max_sleep(void) {
+    if (use_tsc_deadline) {
+        return 0x7FFFFFFF;
+    }
+    return (0xFFFFFFFF - lapic_per_tick) / lapic_per_tick;
+}
+
+// Called with interrupts disabled
+int lapic_timer_nohz_enter(uint32_t ticks) {
+    uint32_t id = cpu_current()->id;
+    
+    if (use_tsc_deadline) {
+        if (next_deadline[id] <= rdtsc()) {
+            return -1;
+        }
+        wrmsr(MSR_IA32_TSC_DEADLINE,
+              next_deadline[id] + (uint64_t)(ticks - 1) * tsc_per_tick);
+    } else {
+        uint32_t remaining = lapic_read(LAPIC_TIMER_CUR);
+        if (remaining == 0 || remaining > lapic_per_tick) {
+            return -1;
+        }
+        nohz_residual[id] = lapic_per_tick - remaining;
+        nohz_count[id] = remaining + (ticks - 1) * lapic_per_tick;
+        lapic_write(LAPIC_TIMER_INIT, nohz_count[id]);
+    }
+    
+    nohz[id] = 1;
+    return 0;
+}
+
+// Called with interrupts disabled
+uint32_t lapic_timer_nohz_exit(int expired) {
+    uint32_t id = cpu_current()->id;
+    uint32_t ticks = 0;
+    
+    nohz[id] = 0;
+    
+    if (use_tsc_deadline) {
+        // Count the tick boundaries that passed and resume at the next one
+        uint64_t now = rdtsc();
+        while (next_deadline[id] <= now) {
+            next_deadline[id] += tsc_per_tick;
+            ticks++;
+        }
+        wrmsr(MSR_IA32_TSC_DEADLINE, next_deadline[id]);
+    } else {
+        uint32_t elapsed = nohz_count[id];
+        if (!expired) {
+            uint32_t remaining = lapic_read(LAPIC_TIMER_CUR);
+            if (remaining <= nohz_count[id]) {
+                elapsed = nohz_count[id] - remaining;
+            }
+        }
+        
+        // Carry the partial tick so the next one lands on the old grid
+        nohz_residual[id] += elapsed;
+        ticks = nohz_residual[id] / lapic_per_tick;
+        nohz_residual[id] %= lapic_per_tick;
+        lapic_write(LAPIC_TIMER_INIT, lapic_per_tick - nohz_residual[id]);
+    }
+    
+    return ticks;
+}
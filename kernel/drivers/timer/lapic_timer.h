@@ -0,0 +1,34 @@
+// kernel/drivers/timer/lapic_timer.h - Per-CPU local APIC timer tick
+#ifndef LAPIC_TIMER_H
+#define LAPIC_TIMER_H
+
+#include "../../../include/types.h"
+
+// Calibrate on the BSP and make the LAPIC timer the tick source. Returns 0
+// on success; on failure the PIT keeps driving the tick.
+int lapic_timer_init(void);
+
+// Start the tick on the calling CPU (application processors)
+void lapic_timer_start(void);
+
+// Is the LAPIC timer driving the tick?
+int lapic_timer_active(void);
+
+// Microseconds since boot from the calibrated TSC, wrapping at 32 bits.
+// Returns -1 if the TSC rate is unknown.
+int lapic_timer_clock_us(uint32_t* us);
+
+// Calibrated TSC cycles per microsecond, 0 if the TSC rate is unknown
+uint32_t lapic_timer_tsc_per_us(void);
+
+// "tsc-deadline" or "one-shot"
+const char* lapic_timer_mode(void);
+
+// Dynamic ticks on the calling CPU: replace the periodic tick with a
+// single expiry ticks from now (returns -1 if a tick is already due), and
+// later return to periodic mode reporting the whole ticks that elapsed
+uint32_t lapic_timer_max_sleep(void);
+int lapic_timer_nohz_enter(uint32_t ticks);
+uint32_t lapic_timer_nohz_exit(int expired);
+
+#endif // LAPIC_TIMER_H
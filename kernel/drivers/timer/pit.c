@@ -1,40 +1,256 @@
 #include "pit.h"
+#include "lapic_timer.h"
+#include "timer_wheel.h"
 #include "../../hal/irq.h"
+#include "../../hal/cpu.h"
 #include "../../../include/io.h"
 #include "../../core/monitor.h"
+#include "../../core/softirq.h"
+#include "../../mm/wss.h"
+#include "../../mm/vdso.h"
+#include "../../proc/thread.h"
+#include "../../proc/scheduler.h"
+#include "../../hal/smp.h"
+
+#define PIT_FREQUENCY 1193180
+#define PIT_MAX_COUNT 0xFFFF
+
+#define PIT_CHANNEL0  0x40
+#define PIT_COMMAND   0x43
+#define PIT_CMD_PERIODIC 0x36  // Channel 0, lo/hi byte, mode 3
+#define PIT_CMD_ONESHOT  0x30  // Channel 0, lo/hi byte, mode 0
+#define PIT_CMD_LATCH    0x00  // Latch channel 0 count
 
 volatile uint32_t system_ticks = 0;
 
-// Forward declaration
-extern void schedule();
+static uint32_t pit_divisor = 0;
 
-static void timer_callback(registers_t* regs) {
-    (void)regs;
+// Dynamic tick state: while nohz_active the periodic tick is stopped and a
+// one-shot is pending (nohz_count PIT clocks when the PIT drives the tick)
+static int nohz_enabled = TIMER_NOHZ;
+static volatile int nohz_active = 0;
+static uint32_t nohz_count = 0;
+static uint32_t nohz_residual = 0;  // PIT clocks short of a whole tick
+
+// Idle statistics
+static uint32_t idle_ticks = 0;
+static uint32_t timer_irqs = 0;
+static uint32_t window_start = 0;
+static uint32_t window_irqs = 0;
+static uint32_t window_idle = 0;
+static uint32_t wakeups_per_sec = 0;
+static uint32_t idle_percent = 0;
+
+static void pit_program(uint8_t command, uint16_t count) {
+    outb(PIT_COMMAND, command);
+    outb(PIT_CHANNEL0, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)((count >> 8) & 0xFF));
+}
+
+static uint16_t pit_read_count(void) {
+    outb(PIT_COMMAND, PIT_CMD_LATCH);
+    uint8_t lo = inb(PIT_CHANNEL0);
+    uint8_t hi = inb(PIT_CHANNEL0);
+    return (uint16_t)((hi << 8) | lo);
+}
+
+// Leave dynamic-tick mode and return the number of whole ticks that passed
+// while the periodic tick was stopped. Sub-tick remainders are carried so
+// system_ticks does not drift.
+static uint32_t tick_nohz_exit(int expired) {
+    if (lapic_timer_active()) {
+        nohz_active = 0;
+        return lapic_timer_nohz_exit(expired);
+    }
+    
+    uint32_t elapsed = nohz_count;
+    
+    if (!expired) {
+        uint16_t remaining = pit_read_count();
+        if (remaining <= nohz_count) {
+            elapsed = nohz_count - remaining;
+        }
+    }
+    
+    nohz_active = 0;
+    pit_program(PIT_CMD_PERIODIC, (uint16_t)pit_divisor);
+    
+    nohz_residual += elapsed;
+    uint32_t ticks = nohz_residual / pit_divisor;
+    nohz_residual %= pit_divisor;
+    return ticks;
+}
+
+// Account ticks skipped while idle
+static void tick_catch_up(uint32_t ticks) {
+    system_ticks += ticks;
+    vdso_tick(system_ticks);
+    idle_ticks += ticks;
+    if (idle_thread) {
+        idle_thread->cpu_time += ticks;
+    }
+}
+
+static void update_idle_stats(void) {
+    uint32_t elapsed = system_ticks - window_start;
+    if (elapsed < TIMER_HZ) {
+        return;
+    }
+    
+    wakeups_per_sec = ((timer_irqs - window_irqs) * TIMER_HZ) / elapsed;
+    idle_percent = ((idle_ticks - window_idle) * 100) / elapsed;
+    
+    window_start = system_ticks;
+    window_irqs = timer_irqs;
+    window_idle = idle_ticks;
+}
+
+// Global tick work, run on the BSP by whichever device drives the tick
+void timer_tick(registers_t* regs) {
+    timer_irqs++;
+    
+    if (nohz_active) {
+        uint32_t ticks = tick_nohz_exit(1);
+        if (ticks > 1) {
+            tick_catch_up(ticks - 1);
+        }
+    }
+    
     system_ticks++;
+    if (current_thread == idle_thread) {
+        idle_ticks++;
+    }
+    
+    update_idle_stats();
+    vdso_tick(system_ticks);
     
-    // Call scheduler every 10 ticks (100ms)
-    if (system_ticks % 10 == 0) {
-        schedule();
+    // Expired timers and the working set scan run after the IRQ, with
+    // interrupts enabled
+    raise_softirq_irqoff(SOFTIRQ_TIMER);
+    
+    // Without LAPIC timers the application processors share this tick
+    if (!lapic_timer_active()) {
+        smp_broadcast_tick();
     }
+    
+    // Timeslice accounting and preemption
+    scheduler_tick(regs);
+}
+
+// SOFTIRQ_TIMER: expired sleeps and timeouts, periodic housekeeping
+static void timer_softirq(void) {
+    uint32_t now = system_ticks;
+    
+    timer_wheel_run(now);
+    wss_tick(now);
+}
+
+static void timer_callback(registers_t* regs) {
+    timer_tick(regs);
 }
 
 void timer_init(uint32_t frequency) {
+    timer_wheel_init(system_ticks);
+    open_softirq(SOFTIRQ_TIMER, timer_softirq);
     irq_register_handler(0, timer_callback);
     
-    uint32_t divisor = 1193180 / frequency;
+    pit_divisor = PIT_FREQUENCY / frequency;
     
-    outb(0x43, 0x36);
-    outb(0x40, (uint8_t)(divisor & 0xFF));
-    outb(0x40, (uint8_t)((divisor >> 8) & 0xFF));
+    pit_program(PIT_CMD_PERIODIC, (uint16_t)pit_divisor);
 }
 
 uint32_t timer_get_ticks() {
     return system_ticks;
 }
 
+// Microsecond clock for timing short intervals, wraps every ~71 minutes.
+// Falls back to tick resolution when the TSC rate is unknown.
+uint32_t timer_clock_us(void) {
+    uint32_t us;
+    if (lapic_timer_clock_us(&us) == 0) {
+        return us;
+    }
+    return system_ticks * (1000000 / TIMER_HZ);
+}
+
+// Block for ticks timer ticks (the caller sleeps on the timer wheel)
 void timer_wait(uint32_t ticks) {
-    uint32_t end = system_ticks + ticks;
-    while(system_ticks < end) {
-        asm volatile("hlt");
+    timer_sleep(ticks);
+}
+
+// Ticks until the next event that needs the timer
+static uint32_t timer_next_event(void) {
+    uint32_t now = system_ticks;
+    uint32_t next = wss_next_scan() - now;
+    uint32_t sched = scheduler_next_event(now);
+    uint32_t timers = timer_wheel_next(now);
+    
+    if (sched < next) {
+        next = sched;
+    }
+    if (timers < next) {
+        next = timers;
     }
-}
\ No newline at end of file
+    return next;
+}
+
+// Sleep until the next interrupt. With dynamic ticks the periodic tick is
+// replaced by a one-shot for the next pending timer event, so an idle CPU
+// is not woken 100 times a second for nothing.
+void timer_idle(void) {
+    asm volatile("cli");
+    
+    if (scheduler_has_ready()) {
+        asm volatile("sti");
+        return;
+    }
+    
+    // Only stop the tick when every other CPU is idle too: the global
+    // tick (system_ticks, the timer wheel, wss) runs here alone, and
+    // without LAPIC timers the others also run off its broadcast. Their
+    // threads are woken by IRQs and timers handled on this CPU, so one
+    // turning busy meanwhile wakes us too and the next pass sees it.
+    uint32_t delta = timer_next_event();
+    int stop_tick = nohz_enabled && delta > 1 && smp_others_idle();
+    if (stop_tick && lapic_timer_active()) {
+        uint32_t max_ticks = lapic_timer_max_sleep();
+        if (delta > max_ticks) {
+            delta = max_ticks;
+        }
+        nohz_active = lapic_timer_nohz_enter(delta) == 0;
+    } else if (stop_tick) {
+        // Mode 0 count is 16 bits: at most ~54ms per one-shot
+        uint32_t max_ticks = PIT_MAX_COUNT / pit_divisor;
+        if (delta > max_ticks) {
+            delta = max_ticks;
+        }
+        
+        nohz_count = delta * pit_divisor;
+        pit_program(PIT_CMD_ONESHOT, (uint16_t)nohz_count);
+        nohz_active = 1;
+    }
+    
+    // sti takes effect after hlt, so no wakeup is lost in between
+    asm volatile("sti; hlt");
+    
+    // Woken by another interrupt before the one-shot expired
+    uint32_t flags = cpu_irq_save();
+    if (nohz_active) {
+        tick_catch_up(tick_nohz_exit(0));
+    }
+    cpu_irq_restore(flags);
+}
+
+void timer_set_nohz(int enabled) {
+    nohz_enabled = enabled;
+}
+
+void timer_get_stats(timer_stats_t* stats) {
+    stats->idle_ticks = idle_ticks;
+    stats->timer_irqs = timer_irqs;
+    stats->wakeups_per_sec = wakeups_per_sec;
+    stats->idle_percent = idle_percent;
+    stats->nohz = nohz_enabled;
+    stats->clock = lapic_timer_active() ? lapic_timer_mode() : "pit";
+    stats->pending_timers = timer_wheel_pending();
+}
@@ -2,11 +2,36 @@
 #define PIT_H
 
 #include "../../../include/types.h"
+#include "../../../include/kernel/config.h"
+#include "../../hal/isr.h"
+
+#define TIMER_HZ CONFIG_HZ
+
+// Stop the periodic tick while idle (dynamic ticks)
+#define TIMER_NOHZ CONFIG_NOHZ
+
+// Convert milliseconds to ticks, rounding up
+#define TIMER_MS_TO_TICKS(ms) (((ms) * TIMER_HZ + 999) / 1000)
 
 extern volatile uint32_t system_ticks;
 
+typedef struct {
+    uint32_t idle_ticks;       // Total ticks spent idle
+    uint32_t timer_irqs;       // Total timer interrupts taken
+    uint32_t wakeups_per_sec;  // Timer interrupts during the last second
+    uint32_t idle_percent;     // Idle residency during the last second
+    int nohz;
+    const char* clock;         // Tick source
+    uint32_t pending_timers;   // Armed timer wheel entries
+} timer_stats_t;
+
 void timer_init(uint32_t frequency);
+void timer_tick(registers_t* regs);
 uint32_t timer_get_ticks();
+uint32_t timer_clock_us(void);
 void timer_wait(uint32_t ticks);
+void timer_idle(void);
+void timer_set_nohz(int enabled);
+void timer_get_stats(timer_stats_t* stats);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,276 @@
+// kernel/drivers/timer/timer_wheel.c - Hierarchical timer wheel
+//
+// Pending timers hang off one of five wheels. The first has a slot per
+// tick for the next 256 ticks; each further wheel has 64 slots covering
+// 64 times the span of the one below. Adding or cancelling a timer is a
+// list insert or unlink. When the first wheel wraps, the current slot of
+// the next wheel is cascaded down, so each timer is touched at most once
+// per level however many are pending.
+//
+// The wheel runs on the BSP only, from its tick. While that tick is
+// stopped (timer_idle), a timer armed on another CPU that is due before
+// the BSP planned to wake sends it an IPI. Callbacks run outside the lock
+// but with interrupts off, and timer_cancel waits for one in flight, so
+// the owner of a timer may free it once cancel returns.
+#include "timer_wheel.h"
+#include "pit.h"
+#include "../../core/spinlock.h"
+#include "../../hal/smp.h"
+#include "../../proc/thread.h"
+#include "../../proc/scheduler.h"
+
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS 4
+
+static ktimer_t* tv1[TVR_SIZE];
+static ktimer_t* tvn[TVN_LEVELS][TVN_SIZE];
+static uint32_t wheel_time = 0;     // Next tick to process
+static uint32_t pending = 0;
+static uint32_t horizon = 0;        // The BSP runs the wheel again by then
+static spinlock_t wheel_lock = SPINLOCK_INIT;
+
+// Timer whose callback is running, and on which CPU
+static ktimer_t* volatile running_timer = NULL;
+static uint32_t running_cpu = 0;
+
+static void slot_add(ktimer_t** slot, ktimer_t* timer) {
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+static void slot_del(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// Put timer in the slot matching its distance from wheel_time
+static void internal_add(ktimer_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_time;
+    ktimer_t** slot;
+    
+    if ((int32_t)delta < 0) {
+        // Already due: run on the next tick processed
+        slot = &tv1[wheel_time & TVR_MASK];
+    } else if (delta < TVR_SIZE) {
+        slot = &tv1[expires & TVR_MASK];
+    } else {
+        int level = 0;
+        while (level < TVN_LEVELS - 1 &&
+               delta >= (1u << (TVR_BITS + (level + 1) * TVN_BITS))) {
+            level++;
+        }
+        slot = &tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+    
+    slot_add(slot, timer);
+}
+
+// Move every timer of one upper-level slot down to where it now belongs
+static void cascade(int level, uint32_t index) {
+    ktimer_t* timer = tvn[level][index];
+    tvn[level][index] = NULL;
+    
+    while (timer) {
+        ktimer_t* next = timer->next;
+        timer->next = NULL;
+        timer->pprev = NULL;
+        internal_add(timer);
+        timer = next;
+    }
+}
+
+void timer_wheel_init(uint32_t now) {
+    for (int i = 0; i < TVR_SIZE; i++) {
+        tv1[i] = NULL;
+    }
+    for (int level = 0; level < TVN_LEVELS; level++) {
+        for (int i = 0; i < TVN_SIZE; i++) {
+            tvn[level][i] = NULL;
+        }
+    }
+    wheel_time = now;
+    pending = 0;
+    horizon = now + 1;
+}
+
+void timer_setup(ktimer_t* timer, void (*func)(void* data), void* data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->func = func;
+    timer->data = data;
+}
+
+void timer_add(ktimer_t* timer, uint32_t expires) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    
+    if (timer_pending(timer)) {
+        slot_del(timer);
+        pending--;
+    }
+    timer->expires = expires;
+    internal_add(timer);
+    pending++;
+    
+    // Due before the BSP next looks at the wheel: wake it to re-plan
+    int kick = cpu_current()->id != 0 && (int32_t)(expires - horizon) < 0;
+    if (kick) {
+        horizon = expires;
+    }
+    
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    
+    if (kick) {
+        smp_send_reschedule(0);
+    }
+}
+
+int timer_cancel(ktimer_t* timer) {
+    int was_pending = 0;
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    
+    if (timer_pending(timer)) {
+        slot_del(timer);
+        pending--;
+        was_pending = 1;
+    }
+    
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    
+    // Already fired: wait for the callback to finish with it, unless
+    // that callback is the caller
+    while (running_timer == timer && running_cpu != cpu_current()->id) {
+        asm volatile("pause");
+    }
+    return was_pending;
+}
+
+void timer_wheel_run(uint32_t now) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    
+    while ((int32_t)(now - wheel_time) >= 0) {
+        uint32_t index = wheel_time & TVR_MASK;
+        
+        // First wheel wrapped: refill it from the next level, and that
+        // one from the level above whenever it wraps too
+        if (index == 0) {
+            for (int level = 0; level < TVN_LEVELS; level++) {
+                uint32_t slot = (wheel_time >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+                cascade(level, slot);
+                if (slot != 0) {
+                    break;
+                }
+            }
+        }
+        
+        wheel_time++;
+        
+        // Callbacks run unlocked, so they may add or cancel timers, but
+        // with interrupts off: nothing on this CPU can wait in
+        // timer_cancel for the one running
+        while (tv1[index]) {
+            ktimer_t* timer = tv1[index];
+            void (*func)(void*) = timer->func;
+            void* data = timer->data;
+            
+            slot_del(timer);
+            pending--;
+            running_timer = timer;
+            running_cpu = cpu_current()->id;
+            
+            spin_unlock(&wheel_lock);
+            func(data);
+            spin_lock(&wheel_lock);
+            running_timer = NULL;
+        }
+    }
+    
+    // The periodic tick runs the wheel again on the next one
+    horizon = now + 1;
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+// Exact for the first wheel; beyond the next cascade point it returns the
+// cascade itself, which is early but never late
+uint32_t timer_wheel_next(uint32_t now) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    uint32_t next = 0xFFFFFFFF;
+    
+    if (pending) {
+        uint32_t tick = wheel_time;
+        for (int i = 0; i < TVR_SIZE; i++, tick++) {
+            if (i > 0 && (tick & TVR_MASK) == 0) {
+                break;
+            }
+            if (tv1[tick & TVR_MASK]) {
+                break;
+            }
+        }
+        next = (int32_t)(tick - now) > 0 ? tick - now : 0;
+    }
+    
+    // The BSP plans its next wakeup from this (timer_idle); a timer added
+    // elsewhere for earlier must kick it
+    horizon = now + (next < 0x7FFFFFFF ? next : 0x7FFFFFFF);
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return next;
+}
+
+uint32_t timer_wheel_pending(void) {
+    return pending;
+}
+
+static void sleep_timeout(void* data) {
+    scheduler_wake((thread_t*)data);
+}
+
+void timer_sleep(uint32_t ticks) {
+    thread_t* current = current_thread;
+    
+    if (ticks == 0) {
+        return;
+    }
+    
+    // The boot context (idle task) cannot block; it waits in place
+    if (!current || current == idle_thread) {
+        uint32_t end = timer_get_ticks() + ticks;
+        while ((int32_t)(timer_get_ticks() - end) < 0) {
+            asm volatile("hlt");
+        }
+        return;
+    }
+    
+    ktimer_t timer;
+    timer_setup(&timer, sleep_timeout, current);
+    
+    // Mark blocked before arming: a timer firing on another CPU before
+    // we switch away then requeues us instead of being lost. A killed
+    // thread is on its way out and does not sleep at all.
+    uint32_t flags = cpu_irq_save();
+    if (current->killed) {
+        cpu_irq_restore(flags);
+        return;
+    }
+    current->state = THREAD_BLOCKED;
+    current->sleep_timer = &timer;
+    timer_add(&timer, timer_get_ticks() + ticks);
+    schedule();
+    cpu_irq_restore(flags);
+    
+    timer_cancel(&timer);
+    current->sleep_timer = NULL;
+}
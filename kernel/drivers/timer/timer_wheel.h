@@ -0,0 +1,45 @@
+// kernel/drivers/timer/timer_wheel.h - Hierarchical timer wheel
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "../../../include/types.h"
+
+// A pending expiration. Embed one wherever a timeout is needed; the wheel
+// never allocates.
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;      // Link pointing at us, NULL when not pending
+    uint32_t expires;           // Absolute tick
+    void (*func)(void* data);   // Runs on the BSP with interrupts off
+    void* data;
+} ktimer_t;
+
+void timer_wheel_init(uint32_t now);
+
+void timer_setup(ktimer_t* timer, void (*func)(void* data), void* data);
+
+// Arm (or re-arm) timer to fire at tick expires. O(1).
+void timer_add(ktimer_t* timer, uint32_t expires);
+
+// Disarm timer, returns 1 if it was pending. If it already fired, waits
+// for its callback to return, so the timer may be freed afterwards.
+int timer_cancel(ktimer_t* timer);
+
+static inline int timer_pending(const ktimer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+// Fire every timer due at or before now (timer softirq)
+void timer_wheel_run(uint32_t now);
+
+// Ticks from now until the wheel needs to run again. For the BSP planning
+// its next wakeup: timers added on other CPUs that are due earlier than
+// that send it an IPI.
+uint32_t timer_wheel_next(uint32_t now);
+
+uint32_t timer_wheel_pending(void);
+
+// Block the calling process for at least ticks ticks
+void timer_sleep(uint32_t ticks);
+
+#endif // TIMER_WHEEL_H
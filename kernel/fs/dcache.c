@@ -0,0 +1,191 @@
+// kernel/fs/dcache.c - Cache of directory lookups for the VFS
+//
+// Every (directory, name) lookup that goes through here is remembered,
+// found again by a hash of both, so resolving a hot path does not call
+// into the filesystem at all. A name that is not there is remembered too
+// (node NULL) until something is created under it. The entries are a
+// fixed pool on one LRU list: the least recently used entry is recycled
+// for each new lookup, and invalidated entries go to the end to be
+// recycled first.
+//
+// Lookups of the filesystem run unlocked. A miss notes the generation
+// first and only caches its answer if nothing was invalidated meanwhile.
+#include "dcache.h"
+#include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../../lib/libc/string.h"
+#include "../../lib/libk/hashtable.h"
+
+typedef struct dentry {
+    hash_node_t hash_node;      // Unhashed while free
+    void* dir;
+    void* node;                 // NULL: the name does not exist
+    struct dentry* lru_prev;
+    struct dentry* lru_next;
+    char name[DCACHE_NAME_LEN];
+} dentry_t;
+
+static dentry_t dentries[DCACHE_SIZE];
+static dentry_t lru;            // Most recently used after it, least before
+static hash_node_t* dcache_buckets[1 << DCACHE_HASH_BITS];
+static hashtable_t dcache_hash;
+static spinlock_t dcache_lock = SPINLOCK_INIT;
+static uint32_t dcache_gen = 0;
+
+// FNV-1a of the name, mixed with the directory
+static uint32_t dcache_key(void* dir, const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+    return hash ^ (uint32_t)dir;
+}
+
+static void lru_unlink(dentry_t* d) {
+    d->lru_prev->lru_next = d->lru_next;
+    d->lru_next->lru_prev = d->lru_prev;
+}
+
+static void lru_add_front(dentry_t* d) {
+    d->lru_prev = &lru;
+    d->lru_next = lru.lru_next;
+    lru.lru_next->lru_prev = d;
+    lru.lru_next = d;
+}
+
+static void lru_add_back(dentry_t* d) {
+    d->lru_next = &lru;
+    d->lru_prev = lru.lru_prev;
+    lru.lru_prev->lru_next = d;
+    lru.lru_prev = d;
+}
+
+// Unhash d and queue it for reuse. Locked.
+static void dentry_drop(dentry_t* d) {
+    hashtable_del(&dcache_hash, &d->hash_node);
+    lru_unlink(d);
+    lru_add_back(d);
+}
+
+// Locked
+static dentry_t* dcache_find(void* dir, const char* name, uint32_t key) {
+    hash_node_t* n = dcache_hash.buckets[hash_u32(key, DCACHE_HASH_BITS)];
+    for (; n; n = n->next) {
+        dentry_t* d = hash_entry(n, dentry_t, hash_node);
+        if (n->key == key && d->dir == dir && strcmp(d->name, name) == 0) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+void dcache_init(void) {
+    hashtable_init(&dcache_hash, dcache_buckets, DCACHE_HASH_BITS);
+    lru.lru_prev = lru.lru_next = &lru;
+    for (uint32_t i = 0; i < DCACHE_SIZE; i++) {
+        dentries[i].hash_node.pprev = NULL;
+        lru_add_back(&dentries[i]);
+    }
+}
+
+void* dcache_lookup(void* dir, const char* name, dcache_lookup_t lookup) {
+    uint32_t len = strlen(name);
+    if (len >= DCACHE_NAME_LEN) {
+        return lookup(dir, name);
+    }
+    uint32_t key = dcache_key(dir, name);
+    
+    uint32_t flags = spin_lock_irqsave(&dcache_lock);
+    dentry_t* d = dcache_find(dir, name, key);
+    if (d) {
+        lru_unlink(d);
+        lru_add_front(d);
+        void* node = d->node;
+        spin_unlock_irqrestore(&dcache_lock, flags);
+        return node;
+    }
+    uint32_t gen = dcache_gen;
+    spin_unlock_irqrestore(&dcache_lock, flags);
+    
+    void* node = lookup(dir, name);
+    
+    flags = spin_lock_irqsave(&dcache_lock);
+    if (gen == dcache_gen && !dcache_find(dir, name, key)) {
+        d = lru.lru_prev;
+        hashtable_del(&dcache_hash, &d->hash_node);
+        d->dir = dir;
+        d->node = node;
+        memcpy(d->name, name, len + 1);
+        hashtable_add(&dcache_hash, &d->hash_node, key);
+        lru_unlink(d);
+        lru_add_front(d);
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+    return node;
+}
+
+void dcache_invalidate(void* dir, const char* name, void* node) {
+    uint32_t flags = spin_lock_irqsave(&dcache_lock);
+    dcache_gen++;
+    
+    dentry_t* d = dcache_find(dir, name, dcache_key(dir, name));
+    if (d) {
+        dentry_drop(d);
+    }
+    
+    // A removed directory's node may be reused for something else
+    if (node) {
+        for (uint32_t i = 0; i < DCACHE_SIZE; i++) {
+            d = &dentries[i];
+            if (d->hash_node.pprev && (d->dir == node || d->node == node)) {
+                dentry_drop(d);
+            }
+        }
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+}
+
+void dcache_flush(void) {
+    uint32_t flags = spin_lock_irqsave(&dcache_lock);
+    dcache_gen++;
+    for (uint32_t i = 0; i < DCACHE_SIZE; i++) {
+        if (dentries[i].hash_node.pprev) {
+            dentry_drop(&dentries[i]);
+        }
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+}
+
+static uint32_t test_lookups;
+
+static void* test_lookup(void* dir, const char* name) {
+    test_lookups++;
+    return strcmp(name, "present") == 0 ? dir : NULL;
+}
+
+void dcache_test(void) {
+    static uint32_t dir;        // Any unique address stands in for a directory
+    print_string("\n=== Directory Cache Tests ===\n");
+    
+    // Test 1: Only the first lookup of each name reaches the filesystem
+    print_string("Test 1: Repeated lookups\n");
+    test_lookups = 0;
+    int ok = 1;
+    for (int i = 0; i < 3; i++) {
+        ok &= dcache_lookup(&dir, "present", test_lookup) == &dir;
+        ok &= dcache_lookup(&dir, "absent", test_lookup) == NULL;
+    }
+    print_string("  3 x 2 lookups, ");
+    print_dec(test_lookups);
+    print_string(" reached finddir");
+    print_string(ok && test_lookups == 2 ? " [PASS]\n" : " [FAIL]\n");
+    
+    // Test 2: An invalidated name is looked up again
+    print_string("Test 2: Invalidation\n");
+    dcache_invalidate(&dir, "absent", NULL);
+    dcache_lookup(&dir, "absent", test_lookup);
+    print_string(test_lookups == 3 ? "  Looked up again [PASS]\n" : "  Still cached [FAIL]\n");
+    
+    dcache_invalidate(&dir, "present", NULL);
+    dcache_invalidate(&dir, "absent", NULL);
+}
@@ -0,0 +1,35 @@
+// kernel/fs/dcache.h - Cache of directory lookups for the VFS
+//
+// Nodes are opaque here: both the initrd tree (vfs.h) and the descriptor
+// VFS (vfs_complete.h) cache their lookups through it, each passing its
+// own finddir.
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "../../include/types.h"
+
+#define DCACHE_SIZE         256     // Entries, recycled least recently used first
+#define DCACHE_HASH_BITS    8
+#define DCACHE_NAME_LEN     40      // Longer names bypass the cache
+
+void dcache_init(void);
+
+// A filesystem's lookup of name in dir, NULL if it does not exist
+typedef void* (*dcache_lookup_t)(void* dir, const char* name);
+
+// lookup(dir, name), answered from the cache when the same lookup was
+// made before. Misses, including names that do not exist, are cached.
+void* dcache_lookup(void* dir, const char* name, dcache_lookup_t lookup);
+
+// Forget name in dir after it was created or removed. When node (the
+// entry removed, may be NULL) is given, lookups made inside it go too.
+void dcache_invalidate(void* dir, const char* name, void* node);
+
+// Forget everything, e.g. when the tree is remounted
+void dcache_flush(void);
+
+// Boot-time check that repeated lookups are answered without the
+// filesystem
+void dcache_test(void);
+
+#endif // DCACHE_H
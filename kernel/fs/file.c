@@ -0,0 +1,290 @@
+// kernel/fs/file.c - Open files and per-process descriptor tables
+//
+// Every process owns its descriptors; the table is created on first use
+// and doubles as it fills, with the new arrays allocated outside the lock.
+// Allocation always hands out the lowest free descriptor: the full bitmap
+// skips 32 taken slots per bit and next skips the dense low end, so even
+// a table with thousands of descriptors is searched in a few words.
+#include "file.h"
+#include "../mm/heap.h"
+#include "../proc/thread.h"
+#include "../../lib/libc/string.h"
+#include "../../lib/libk/bitmap.h"
+
+file_t* file_open(fs_node_t* node, uint32_t flags) {
+    file_t* file = (file_t*)kmalloc(sizeof(file_t));
+    if (!file) {
+        return NULL;
+    }
+    file->node = node;
+    file->offset = 0;
+    file->flags = flags;
+    file->refs = 1;
+    
+    if (node->open) {
+        node->open(node);
+    }
+    return file;
+}
+
+void file_get(file_t* file) {
+    __sync_fetch_and_add(&file->refs, 1);
+}
+
+void file_put(file_t* file) {
+    if (__sync_sub_and_fetch(&file->refs, 1) != 0) {
+        return;
+    }
+    if (file->node->close) {
+        file->node->close(file->node);
+    }
+    kfree(file);
+}
+
+// The three arrays of a size-slot table share one allocation, starting
+// with files
+static file_t** table_arrays(uint32_t size, uint32_t** open, uint32_t** full) {
+    uint32_t open_words = size / 32;
+    uint32_t bytes = size * sizeof(file_t*) +
+                     (open_words + BITMAP_WORDS(open_words)) * sizeof(uint32_t);
+    
+    uint8_t* block = (uint8_t*)kmalloc(bytes);
+    if (!block) {
+        return NULL;
+    }
+    memset(block, 0, bytes);
+    *open = (uint32_t*)(block + size * sizeof(file_t*));
+    *full = *open + open_words;
+    return (file_t**)block;
+}
+
+// The calling process's table, created on first use
+static fd_table_t* table_current(void) {
+    process_t* proc = current_process;
+    if (proc->files) {
+        return proc->files;
+    }
+    
+    fd_table_t* table = (fd_table_t*)kmalloc(sizeof(fd_table_t));
+    if (!table) {
+        return NULL;
+    }
+    memset(table, 0, sizeof(fd_table_t));
+    spin_lock_init(&table->lock);
+    table->size = FD_INITIAL;
+    table->files = table_arrays(FD_INITIAL, &table->open, &table->full);
+    if (!table->files) {
+        kfree(table);
+        return NULL;
+    }
+    
+    // Another thread of the process may have beaten us to it
+    if (!__sync_bool_compare_and_swap(&proc->files, NULL, table)) {
+        kfree(table->files);
+        kfree(table);
+    }
+    return proc->files;
+}
+
+// Make slot fd exist. Returns 0 once it does (possibly grown by someone
+// else), -1 past FD_MAX or when out of memory.
+static int table_grow(fd_table_t* table, uint32_t fd) {
+    if (fd >= FD_MAX) {
+        return -1;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&table->lock);
+    uint32_t size = table->size;
+    spin_unlock_irqrestore(&table->lock, flags);
+    if (fd < size) {
+        return 0;
+    }
+    
+    uint32_t new_size = size;
+    while (new_size <= fd) {
+        new_size *= 2;
+    }
+    uint32_t* open;
+    uint32_t* full;
+    file_t** files = table_arrays(new_size, &open, &full);
+    if (!files) {
+        return -1;
+    }
+    
+    flags = spin_lock_irqsave(&table->lock);
+    if (table->size != size) {
+        spin_unlock_irqrestore(&table->lock, flags);
+        kfree(files);
+        return 0;
+    }
+    memcpy(files, table->files, size * sizeof(file_t*));
+    memcpy(open, table->open, size / 32 * sizeof(uint32_t));
+    memcpy(full, table->full, BITMAP_WORDS(size / 32) * sizeof(uint32_t));
+    
+    file_t** old = table->files;
+    table->files = files;
+    table->open = open;
+    table->full = full;
+    table->size = new_size;
+    spin_unlock_irqrestore(&table->lock, flags);
+    
+    kfree(old);
+    return 0;
+}
+
+// Lowest free slot, table->size if there is none. Table locked.
+static uint32_t table_find_free(fd_table_t* table) {
+    uint32_t words = table->size / 32;
+    uint32_t word = bitmap_find_next_zero(table->full, words, table->next / 32);
+    if (word >= words) {
+        return table->size;
+    }
+    
+    // Every free slot of a word is at or above next
+    uint32_t start = word * 32 > table->next ? word * 32 : table->next;
+    return bitmap_find_next_zero(table->open, table->size, start);
+}
+
+static void slot_set(fd_table_t* table, uint32_t fd, file_t* file) {
+    table->files[fd] = file;
+    bitmap_set(table->open, fd);
+    if (table->open[fd / 32] == 0xFFFFFFFF) {
+        bitmap_set(table->full, fd / 32);
+    }
+    if (table->next == fd) {
+        table->next = fd + 1;
+    }
+    table->count++;
+}
+
+static file_t* slot_clear(fd_table_t* table, uint32_t fd) {
+    file_t* file = table->files[fd];
+    table->files[fd] = NULL;
+    bitmap_clear(table->open, fd);
+    bitmap_clear(table->full, fd / 32);
+    if (fd < table->next) {
+        table->next = fd;
+    }
+    table->count--;
+    return file;
+}
+
+int fd_install(file_t* file) {
+    fd_table_t* table = table_current();
+    if (!table) {
+        return -1;
+    }
+    
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&table->lock);
+        uint32_t fd = table_find_free(table);
+        if (fd < table->size) {
+            slot_set(table, fd, file);
+            spin_unlock_irqrestore(&table->lock, flags);
+            return (int)fd;
+        }
+        spin_unlock_irqrestore(&table->lock, flags);
+        
+        if (table_grow(table, fd) < 0) {
+            return -1;
+        }
+    }
+}
+
+file_t* fd_get(int fd) {
+    fd_table_t* table = current_process->files;
+    if (!table || fd < 0) {
+        return NULL;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&table->lock);
+    file_t* file = (uint32_t)fd < table->size ? table->files[fd] : NULL;
+    if (file) {
+        file_get(file);
+    }
+    spin_unlock_irqrestore(&table->lock, flags);
+    return file;
+}
+
+int fd_close(int fd) {
+    fd_table_t* table = current_process->files;
+    if (!table || fd < 0) {
+        return -1;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&table->lock);
+    if ((uint32_t)fd >= table->size || !table->files[fd]) {
+        spin_unlock_irqrestore(&table->lock, flags);
+        return -1;
+    }
+    file_t* file = slot_clear(table, fd);
+    spin_unlock_irqrestore(&table->lock, flags);
+    
+    file_put(file);
+    return 0;
+}
+
+int fd_dup(int fd) {
+    file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    
+    int newfd = fd_install(file);
+    if (newfd < 0) {
+        file_put(file);
+    }
+    return newfd;
+}
+
+int fd_dup2(int fd, int newfd) {
+    if (newfd < 0 || newfd >= FD_MAX) {
+        return -1;
+    }
+    file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    if (fd == newfd) {
+        file_put(file);
+        return newfd;
+    }
+    
+    // fd_get succeeded, so the table exists
+    fd_table_t* table = current_process->files;
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&table->lock);
+        if ((uint32_t)newfd < table->size) {
+            file_t* old = table->files[newfd] ? slot_clear(table, newfd) : NULL;
+            slot_set(table, newfd, file);
+            spin_unlock_irqrestore(&table->lock, flags);
+            
+            if (old) {
+                file_put(old);
+            }
+            return newfd;
+        }
+        spin_unlock_irqrestore(&table->lock, flags);
+        
+        if (table_grow(table, newfd) < 0) {
+            file_put(file);
+            return -1;
+        }
+    }
+}
+
+void fd_table_exit(process_t* proc) {
+    fd_table_t* table = proc->files;
+    if (!table) {
+        return;
+    }
+    proc->files = NULL;
+    
+    uint32_t fd = bitmap_find_next_set(table->open, table->size, 0);
+    while (fd < table->size) {
+        file_put(table->files[fd]);
+        fd = bitmap_find_next_set(table->open, table->size, fd + 1);
+    }
+    kfree(table->files);
+    kfree(table);
+}
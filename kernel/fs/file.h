@@ -0,0 +1,65 @@
+// kernel/fs/file.h - Open files and per-process descriptor tables
+#ifndef FILE_H
+#define FILE_H
+
+#include "../../include/types.h"
+#include "../core/spinlock.h"
+#include "../proc/process.h"
+#include "vfs_complete.h"
+
+// A table starts with one bitmap word of descriptors and doubles up to
+// FD_MAX as it fills
+#define FD_INITIAL  32
+#define FD_MAX      65536
+
+// An open file. Descriptors dup'd from one another share it, and with it
+// the offset; it is closed with its last reference.
+typedef struct file {
+    fs_node_t* node;
+    uint32_t offset;
+    uint32_t flags;
+    volatile uint32_t refs;
+} file_t;
+
+// A process's descriptors. open has a bit per slot; full has a bit per
+// word of open with no free slot left, so the lowest free descriptor is
+// found by skipping whole full words at a time.
+typedef struct fd_table {
+    spinlock_t lock;
+    uint32_t size;              // Slots, a multiple of 32
+    file_t** files;
+    uint32_t* open;
+    uint32_t* full;
+    uint32_t next;              // No free slot below this
+    uint32_t count;             // Open descriptors
+} fd_table_t;
+
+// New open file of node holding one reference; NULL when out of memory
+file_t* file_open(fs_node_t* node, uint32_t flags);
+
+void file_get(file_t* file);
+
+// Drop a reference, closing the node with the last
+void file_put(file_t* file);
+
+// Install file (taking over the caller's reference) at the lowest free
+// descriptor of the calling process. Returns the descriptor, or -1 if the
+// table is full or cannot grow.
+int fd_install(file_t* file);
+
+// Referenced open file behind fd, NULL if fd is not open; file_put it
+// when done
+file_t* fd_get(int fd);
+
+// Returns 0, or -1 if fd was not open
+int fd_close(int fd);
+
+// Lowest free descriptor / newfd (closing what it held) sharing fd's
+// open file. Returns the new descriptor or -1.
+int fd_dup(int fd);
+int fd_dup2(int fd, int newfd);
+
+// Close every descriptor of proc and free its table (process teardown)
+void fd_table_exit(process_t* proc);
+
+#endif // FILE_H
@@ -20,7 +20,8 @@ static uint32_t initrd_read(fs_node_t* node, uint32_t offset, uint32_t size, uin
     if (offset > header.length) return 0;
     if (offset + size > header.length) size = header.length - offset;
     
-    memcpy(buffer, (uint8_t*)(header.offset + offset), size);
+    // Header offsets are relative to the image; impl holds the address
+    memcpy(buffer, (uint8_t*)(node->impl + offset), size);
     return size;
 }
 
@@ -120,3 +121,18 @@ fs_node_t* initrd_init(uint32_t location) {
     
     return initrd_root;
 }
+
+int initrd_mount(multiboot_info_t* mbi) {
+    if (!(mbi->flags & MULTIBOOT_FLAG_MODS) || mbi->mods_count == 0) {
+        return 0;
+    }
+    
+    multiboot_module_t* mod = (multiboot_module_t*)mbi->mods_addr;
+    fs_node_t* root = initrd_init(mod->mod_start);
+    if (!root) {
+        return 0;
+    }
+    
+    fs_root = root;
+    return 1;
+}
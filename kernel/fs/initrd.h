@@ -2,6 +2,7 @@
 #define INITRD_H
 
 #include "vfs.h"
+#include "../../include/multiboot.h"
 
 typedef struct {
     uint32_t nfiles;
@@ -16,4 +17,7 @@ typedef struct {
 
 fs_node_t* initrd_init(uint32_t location);
 
+// Mount the first boot module as fs_root. Returns 0 if there is none.
+int initrd_mount(multiboot_info_t* mbi);
+
 #endif
@@ -1,4 +1,5 @@
 #include "vfs.h"
+#include "dcache.h"
 
 fs_node_t* fs_root = 0;
 
@@ -42,3 +43,28 @@ fs_node_t* fs_finddir(fs_node_t* node, char* name) {
     }
     return 0;
 }
+
+static void* fs_lookup_one(void* dir, const char* name) {
+    return fs_finddir((fs_node_t*)dir, (char*)name);
+}
+
+// Each step goes through the directory cache: exec looks the same few
+// paths up over and over, and initrd_finddir is a linear scan
+fs_node_t* fs_lookup(const char* path) {
+    fs_node_t* node = fs_root;
+    char name[128];
+    
+    while (node && *path) {
+        while (*path == '/') path++;
+        if (!*path) break;
+        
+        uint32_t len = 0;
+        while (*path && *path != '/' && len < sizeof(name) - 1) {
+            name[len++] = *path++;
+        }
+        name[len] = '\0';
+        
+        node = (fs_node_t*)dcache_lookup(node, name, fs_lookup_one);
+    }
+    return node;
+}
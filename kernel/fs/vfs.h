@@ -49,4 +49,7 @@ void fs_close(fs_node_t* node);
 dirent_t* fs_readdir(fs_node_t* node, uint32_t index);
 fs_node_t* fs_finddir(fs_node_t* node, char* name);
 
+// Resolve a '/'-separated path from fs_root, NULL if any part is missing
+fs_node_t* fs_lookup(const char* path);
+
 #endif
\ No newline at end of file
@@ -1,12 +1,13 @@
 // kernel/fs/vfs_complete.c
 #include "vfs_complete.h"
+#include "file.h"
+#include "dcache.h"
 #include "../core/monitor.h"
 #include "../core/panic.h"
 #include "../mm/heap.h"
 #include "../../lib/libc/string.h"
 
 static fs_node_t* vfs_root = NULL;
-static file_descriptor_t fd_table[MAX_OPEN_FILES];
 
 // String helpers (assuming you have these)
 extern int strcmp(const char* s1, const char* s2);
@@ -15,20 +16,13 @@ extern uint32_t strlen(const char* str);
 
 void vfs_init(void) {
     print_string("  [VFS] Initializing Virtual File System...\n");
-    
-    // Clear file descriptor table
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        fd_table[i].in_use = 0;
-        fd_table[i].node = NULL;
-        fd_table[i].offset = 0;
-        fd_table[i].flags = 0;
-    }
-    
+    dcache_init();
     print_string("  [VFS] Ready\n");
 }
 
 void vfs_set_root(fs_node_t* root) {
     vfs_root = root;
+    dcache_flush();
     print_string("  [VFS] Root filesystem mounted\n");
 }
 
@@ -36,17 +30,6 @@ fs_node_t* vfs_get_root(void) {
     return vfs_root;
 }
 
-// Allocate file descriptor
-static int alloc_fd(void) {
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (!fd_table[i].in_use) {
-            fd_table[i].in_use = 1;
-            return i;
-        }
-    }
-    return -1;  // No free descriptors
-}
-
 // Resolve path to fs_node
 fs_node_t* vfs_resolve_path(const char* path) {
     if (!vfs_root) {
@@ -80,13 +63,9 @@ fs_node_t* vfs_resolve_path(const char* path) {
         if (*path == '/') path++;
         
         // Find component in current directory
-        if (current->finddir) {
-            current = current->finddir(current, component);
-            if (!current) {
-                return NULL;  // Not found
-            }
-        } else {
-            return NULL;  // Not a directory
+        current = vfs_finddir(current, component);
+        if (!current) {
+            return NULL;  // Not found, or not a directory
         }
     }
     
@@ -100,82 +79,135 @@ int vfs_open(const char* path, uint32_t flags) {
         return -1;  // File not found
     }
     
-    int fd = alloc_fd();
-    if (fd < 0) {
-        return -1;  // No free descriptors
+    file_t* file = file_open(node, flags);
+    if (!file) {
+        return -1;
     }
     
-    fd_table[fd].node = node;
-    fd_table[fd].offset = 0;
-    fd_table[fd].flags = flags;
-    
-    if (node->open) {
-        node->open(node);
+    int fd = fd_install(file);
+    if (fd < 0) {
+        file_put(file);  // No free descriptors
     }
-    
     return fd;
 }
 
 // Close file
 void vfs_close(int fd) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
-        return;
+    fd_close(fd);
+}
+
+int vfs_dup(int fd) {
+    return fd_dup(fd);
+}
+
+int vfs_dup2(int fd, int newfd) {
+    return fd_dup2(fd, newfd);
+}
+
+// Move the iovec's segments through the node's callback in one pass,
+// starting at offset. Returns the total moved.
+static uint32_t vfs_transfer(fs_node_t* node, uint32_t offset, const iovec_t* iov,
+                             uint32_t iovcnt, int write) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        uint32_t len = iov[i].iov_len;
+        if (len == 0) {
+            continue;
+        }
+        
+        uint8_t* base = (uint8_t*)iov[i].iov_base;
+        uint32_t done = write ? node->write(node, offset + total, len, base)
+                              : node->read(node, offset + total, len, base);
+        total += done;
+        if (done < len) {
+            break;
+        }
     }
-    
-    fs_node_t* node = fd_table[fd].node;
-    if (node && node->close) {
-        node->close(node);
+    return total;
+}
+
+int vfs_readv(int fd, const iovec_t* iov, uint32_t iovcnt) {
+    if (iovcnt > IOV_MAX) {
+        return -1;
+    }
+    file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    if (!file->node->read) {
+        file_put(file);
+        return -1;
     }
     
-    fd_table[fd].in_use = 0;
-    fd_table[fd].node = NULL;
+    uint32_t bytes_read = vfs_transfer(file->node, file->offset, iov, iovcnt, 0);
+    file->offset += bytes_read;
+    file_put(file);
+    return bytes_read;
 }
 
-// Read from file
-int vfs_read(int fd, void* buffer, uint32_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
+int vfs_writev(int fd, const iovec_t* iov, uint32_t iovcnt) {
+    if (iovcnt > IOV_MAX) {
         return -1;
     }
-    
-    fs_node_t* node = fd_table[fd].node;
-    if (!node || !node->read) {
+    file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    if (!file->node->write) {
+        file_put(file);
         return -1;
     }
     
-    uint32_t bytes_read = node->read(node, fd_table[fd].offset, size, (uint8_t*)buffer);
-    fd_table[fd].offset += bytes_read;
-    
-    return bytes_read;
+    uint32_t bytes_written = vfs_transfer(file->node, file->offset, iov, iovcnt, 1);
+    file->offset += bytes_written;
+    file_put(file);
+    return bytes_written;
+}
+
+// Read from file
+int vfs_read(int fd, void* buffer, uint32_t size) {
+    iovec_t iov = { buffer, size };
+    return vfs_readv(fd, &iov, 1);
 }
 
 // Write to file
 int vfs_write(int fd, const void* buffer, uint32_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
+    iovec_t iov = { (void*)buffer, size };
+    return vfs_writev(fd, &iov, 1);
+}
+
+int vfs_pread(int fd, void* buffer, uint32_t size, uint32_t offset) {
+    file_t* file = fd_get(fd);
+    if (!file) {
         return -1;
     }
     
-    fs_node_t* node = fd_table[fd].node;
-    if (!node || !node->write) {
+    iovec_t iov = { buffer, size };
+    int ret = file->node->read ? (int)vfs_transfer(file->node, offset, &iov, 1, 0) : -1;
+    file_put(file);
+    return ret;
+}
+
+int vfs_pwrite(int fd, const void* buffer, uint32_t size, uint32_t offset) {
+    file_t* file = fd_get(fd);
+    if (!file) {
         return -1;
     }
     
-    uint32_t bytes_written = node->write(node, fd_table[fd].offset, size, (uint8_t*)buffer);
-    fd_table[fd].offset += bytes_written;
-    
-    return bytes_written;
+    iovec_t iov = { (void*)buffer, size };
+    int ret = file->node->write ? (int)vfs_transfer(file->node, offset, &iov, 1, 1) : -1;
+    file_put(file);
+    return ret;
 }
 
 // Seek in file
 int vfs_seek(int fd, int offset, int whence) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
-        return -1;
-    }
-    
-    fs_node_t* node = fd_table[fd].node;
-    if (!node) {
+    file_t* file = fd_get(fd);
+    if (!file) {
         return -1;
     }
     
+    fs_node_t* node = file->node;
     uint32_t new_offset;
     
     switch (whence) {
@@ -183,12 +215,13 @@ int vfs_seek(int fd, int offset, int whence) {
             new_offset = offset;
             break;
         case SEEK_CUR:
-            new_offset = fd_table[fd].offset + offset;
+            new_offset = file->offset + offset;
             break;
         case SEEK_END:
             new_offset = node->length + offset;
             break;
         default:
+            file_put(file);
             return -1;
     }
     
@@ -197,7 +230,8 @@ int vfs_seek(int fd, int offset, int whence) {
         new_offset = node->length;
     }
     
-    fd_table[fd].offset = new_offset;
+    file->offset = new_offset;
+    file_put(file);
     return new_offset;
 }
 
@@ -215,7 +249,9 @@ int vfs_create(const char* path, uint32_t flags) {
     if (!last_slash) {
         // No directory specified, use root
         if (vfs_root && vfs_root->create) {
-            return vfs_root->create(vfs_root, path, flags);
+            int ret = vfs_root->create(vfs_root, path, flags);
+            dcache_invalidate(vfs_root, path, NULL);
+            return ret;
         }
         return -1;
     }
@@ -237,7 +273,9 @@ int vfs_create(const char* path, uint32_t flags) {
     }
     
     // Create file in directory
-    return dir->create(dir, last_slash + 1, flags);
+    int ret = dir->create(dir, last_slash + 1, flags);
+    dcache_invalidate(dir, last_slash + 1, NULL);
+    return ret;
 }
 
 // Make directory
@@ -252,7 +290,9 @@ int vfs_mkdir(const char* path, uint32_t mode) {
     
     if (!last_slash) {
         if (vfs_root && vfs_root->mkdir) {
-            return vfs_root->mkdir(vfs_root, path, mode);
+            int ret = vfs_root->mkdir(vfs_root, path, mode);
+            dcache_invalidate(vfs_root, path, NULL);
+            return ret;
         }
         return -1;
     }
@@ -271,21 +311,21 @@ int vfs_mkdir(const char* path, uint32_t mode) {
         return -1;
     }
     
-    return dir->mkdir(dir, last_slash + 1, mode);
+    int ret = dir->mkdir(dir, last_slash + 1, mode);
+    dcache_invalidate(dir, last_slash + 1, NULL);
+    return ret;
 }
 
 // Read directory entry
 int vfs_readdir(int fd, dirent_t* entry, uint32_t index) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
+    file_t* file = fd_get(fd);
+    if (!file) {
         return -1;
     }
     
-    fs_node_t* node = fd_table[fd].node;
-    if (!node || !node->readdir) {
-        return -1;
-    }
-    
-    dirent_t* dir_entry = node->readdir(node, index);
+    fs_node_t* node = file->node;
+    dirent_t* dir_entry = node->readdir ? node->readdir(node, index) : NULL;
+    file_put(file);
     if (!dir_entry) {
         return -1;
     }
@@ -298,13 +338,17 @@ int vfs_readdir(int fd, dirent_t* entry, uint32_t index) {
     return 0;
 }
 
+static void* vfs_lookup(void* dir, const char* name) {
+    fs_node_t* node = (fs_node_t*)dir;
+    return node->finddir(node, name);
+}
+
 // Find in directory
 fs_node_t* vfs_finddir(fs_node_t* node, const char* name) {
     if (!node || !node->finddir) {
         return NULL;
     }
-    
-    return node->finddir(node, name);
+    return (fs_node_t*)dcache_lookup(node, name, vfs_lookup);
 }
 
 // Get file stats
@@ -337,7 +381,10 @@ int vfs_unlink(const char* path) {
     
     if (!last_slash) {
         if (vfs_root && vfs_root->unlink) {
-            return vfs_root->unlink(vfs_root, path);
+            fs_node_t* victim = vfs_finddir(vfs_root, path);
+            int ret = vfs_root->unlink(vfs_root, path);
+            dcache_invalidate(vfs_root, path, victim);
+            return ret;
         }
         return -1;
     }
@@ -356,5 +403,9 @@ int vfs_unlink(const char* path) {
         return -1;
     }
     
-    return dir->unlink(dir, last_slash + 1);
+    // Cached lookups under what is removed have to go with it
+    fs_node_t* victim = vfs_finddir(dir, last_slash + 1);
+    int ret = dir->unlink(dir, last_slash + 1);
+    dcache_invalidate(dir, last_slash + 1, victim);
+    return ret;
 }
\ No newline at end of file
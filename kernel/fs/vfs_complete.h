@@ -3,10 +3,10 @@
 #define VFS_COMPLETE_H
 
 #include "../../include/types.h"
+#include "../../include/uio.h"
 
 #define MAX_FILENAME 128
 #define MAX_PATH 256
-#define MAX_OPEN_FILES 256
 
 // File types
 #define FS_FILE        0x01
@@ -74,23 +74,27 @@ struct fs_node {
     void* impl;
 };
 
-// File descriptor
-typedef struct {
-    fs_node_t* node;
-    uint32_t offset;
-    uint32_t flags;
-    int in_use;
-} file_descriptor_t;
-
 // VFS functions
 void vfs_init(void);
 
-// File operations
+// File operations. Descriptors belong to the calling process (fs/file.c).
 int vfs_open(const char* path, uint32_t flags);
 void vfs_close(int fd);
+int vfs_dup(int fd);
+int vfs_dup2(int fd, int newfd);
 int vfs_read(int fd, void* buffer, uint32_t size);
 int vfs_write(int fd, const void* buffer, uint32_t size);
 int vfs_seek(int fd, int offset, int whence);
+
+// Scatter/gather: one pass over iov, each segment moved straight between
+// the node and its buffer; stops at the first short transfer. Returns the
+// bytes moved, or -1 for a bad descriptor or more than IOV_MAX segments.
+int vfs_readv(int fd, const iovec_t* iov, uint32_t iovcnt);
+int vfs_writev(int fd, const iovec_t* iov, uint32_t iovcnt);
+
+// Read/write at offset, leaving the descriptor's own offset alone
+int vfs_pread(int fd, void* buffer, uint32_t size, uint32_t offset);
+int vfs_pwrite(int fd, const void* buffer, uint32_t size, uint32_t offset);
 int vfs_stat(const char* path, fs_node_t* stat_buf);
 
 // Directory operations
@@ -4,6 +4,10 @@
 #include "../drivers/vga/vga.h"
 #include "../drivers/mouse/mouse.h"
 #include "../apps/app_manager.h"
+#include "../proc/process.h"
+#include "../proc/scheduler.h"
+#include "../drivers/timer/pit.h"
+#include "../core/monitor.h"
 
 
 extern void start_calculator_app(void);
@@ -38,7 +42,7 @@ void gui_init(void) {
     
     // Start calculator automatically
     start_calculator_app();
-
+        
         // Initialize app manager
     app_manager_init();
 }
@@ -224,7 +228,7 @@ void gui_update(void) {
     }
     
     last_buttons = mouse.buttons;
-    
+      
       gui_draw_desktop();
     
     for (int i = 0; i < window_count; i++) {
@@ -244,4 +248,45 @@ void gui_update(void) {
     gui_draw_taskbar();
     gui_draw_cursor();
     vga_swap_buffers();
-}
\ No newline at end of file
+}
+
+// Compositor process: one frame per period, then yield to end the job
+static void gui_process_entry(void) {
+    int paced = 0;
+    if (GUI_FRAME_RUNTIME == 0) {
+        print_string("[GUI] Warning: a ");
+        print_dec(TIMER_HZ);
+        print_string(" Hz tick cannot pace ");
+        print_dec(GUI_FRAME_HZ);
+        print_string(" Hz frames\n");
+    } else if (scheduler_set_deadline(thread_get_current(), GUI_FRAME_RUNTIME,
+                                      GUI_FRAME_PERIOD, 0) != 0) {
+        print_string("[GUI] Warning: frame reservation not admitted\n");
+    } else {
+        paced = 1;
+    }
+    if (!paced) {
+        // Fall back to a boosted normal task
+        scheduler_set_nice(thread_get_current(), APP_GUI_NICE);
+    }
+    
+    while (1) {
+        gui_update();
+        yield();
+    }
+}
+
+// The compositor owns the shared window state: only one may run
+static volatile int gui_running = 0;
+
+void gui_start(void) {
+    if (!__sync_bool_compare_and_swap(&gui_running, 0, 1)) {
+        print_string("[GUI] Already running\n");
+        return;
+    }
+    
+    gui_init();
+    if (!process_create("gui", gui_process_entry)) {
+        gui_running = 0;
+    }
+}
@@ -5,6 +5,15 @@
 
 #define MAX_WINDOWS 16
 
+// Frame loop runs as a deadline task with a quarter of each period
+// guaranteed, both in whole scheduler ticks (TIMER_HZ, pit.h): the period
+// is the longest that still gives at least GUI_FRAME_HZ. Below a tick
+// rate of 4 * GUI_FRAME_HZ (CONFIG_HZ 250 and up) that leaves no whole
+// tick of runtime; the compositor then warns and runs as a normal task.
+#define GUI_FRAME_HZ        60
+#define GUI_FRAME_PERIOD    (TIMER_HZ / GUI_FRAME_HZ)
+#define GUI_FRAME_RUNTIME   (GUI_FRAME_PERIOD / 4)
+
 typedef struct {
     uint32_t x;
     uint32_t y;
@@ -19,6 +28,7 @@ typedef struct {
 
 void gui_init(void);
 void gui_update(void);
+void gui_start(void);
 void gui_draw_desktop(void);
 void gui_draw_taskbar(void);
 void gui_draw_cursor(void);
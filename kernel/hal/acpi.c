@@ -0,0 +1,211 @@
+// kernel/hal/acpi.c - ACPI MADT and MP table parsing
+#include "acpi.h"
+#include "../mm/paging.h"
+#include "../../lib/libc/string.h"
+
+typedef struct {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+#define MADT_LAPIC  0
+#define MADT_IOAPIC 1
+#define MADT_LAPIC_ENABLED 0x01
+
+typedef struct {
+    char signature[4];      // "_MP_"
+    uint32_t config_table;
+    uint8_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed)) mp_floating_t;
+
+typedef struct {
+    char signature[4];      // "PCMP"
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) mp_config_t;
+
+#define MP_ENTRY_PROCESSOR 0
+#define MP_ENTRY_IOAPIC    2
+#define MP_CPU_ENABLED     0x01
+
+static uint8_t checksum(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// Firmware tables may sit above the identity-mapped 16MB
+static void acpi_map(uint32_t phys, uint32_t length) {
+    uint32_t end = PAGE_ALIGN_UP(phys + length);
+    for (uint32_t page = PAGE_ALIGN_DOWN(phys); page < end; page += PAGE_SIZE) {
+        if (!paging_get_physical(page)) {
+            paging_map_page(page, page, PAGE_PRESENT);
+        }
+    }
+}
+
+// Scan a physical range on 16-byte boundaries for a signature
+static void* scan_signature(uint32_t start, uint32_t length,
+                            const char* sig, uint32_t sig_len) {
+    for (uint32_t addr = start; addr < start + length; addr += 16) {
+        if (memcmp((void*)addr, sig, sig_len) == 0) {
+            return (void*)addr;
+        }
+    }
+    return NULL;
+}
+
+// Search the EBDA's first KB, then the BIOS ROM area
+static void* find_bios_structure(const char* sig, uint32_t sig_len) {
+    uint32_t ebda = (uint32_t)(*(uint16_t*)0x40E) << 4;
+    void* found = NULL;
+    
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        found = scan_signature(ebda, 1024, sig, sig_len);
+    }
+    if (!found) {
+        found = scan_signature(0xE0000, 0x20000, sig, sig_len);
+    }
+    return found;
+}
+
+static void add_cpu(smp_config_t* config, uint8_t apic_id) {
+    if (config->cpu_count < MAX_CPUS) {
+        config->apic_ids[config->cpu_count++] = apic_id;
+    }
+}
+
+int acpi_parse_madt(smp_config_t* config) {
+    acpi_rsdp_t* rsdp = (acpi_rsdp_t*)find_bios_structure("RSD PTR ", 8);
+    if (!rsdp || checksum(rsdp, sizeof(acpi_rsdp_t)) != 0) {
+        return -1;
+    }
+    
+    acpi_map(rsdp->rsdt_address, sizeof(acpi_sdt_header_t));
+    acpi_sdt_header_t* rsdt = (acpi_sdt_header_t*)rsdp->rsdt_address;
+    acpi_map(rsdp->rsdt_address, rsdt->length);
+    
+    if (memcmp(rsdt->signature, "RSDT", 4) != 0 ||
+        checksum(rsdt, rsdt->length) != 0) {
+        return -1;
+    }
+    
+    uint32_t entries = (rsdt->length - sizeof(acpi_sdt_header_t)) / 4;
+    uint32_t* tables = (uint32_t*)(rsdt + 1);
+    
+    for (uint32_t i = 0; i < entries; i++) {
+        acpi_map(tables[i], sizeof(acpi_sdt_header_t));
+        acpi_sdt_header_t* header = (acpi_sdt_header_t*)tables[i];
+        
+        if (memcmp(header->signature, "APIC", 4) != 0) {
+            continue;
+        }
+        
+        acpi_map(tables[i], header->length);
+        if (checksum(header, header->length) != 0) {
+            return -1;
+        }
+        
+        acpi_madt_t* madt = (acpi_madt_t*)header;
+        config->lapic_base = madt->lapic_address;
+        config->cpu_count = 0;
+        
+        uint8_t* entry = (uint8_t*)(madt + 1);
+        uint8_t* end = (uint8_t*)madt + madt->header.length;
+        
+        while (entry < end && entry[1] >= 2) {
+            switch (entry[0]) {
+                case MADT_LAPIC:
+                    // acpi_id, apic_id, flags
+                    if (*(uint32_t*)(entry + 4) & MADT_LAPIC_ENABLED) {
+                        add_cpu(config, entry[3]);
+                    }
+                    break;
+                case MADT_IOAPIC:
+                    if (!config->ioapic_base) {
+                        config->ioapic_base = *(uint32_t*)(entry + 4);
+                    }
+                    break;
+            }
+            entry += entry[1];
+        }
+        
+        return config->cpu_count ? 0 : -1;
+    }
+    
+    return -1;
+}
+
+int mp_parse_table(smp_config_t* config) {
+    mp_floating_t* mpf = (mp_floating_t*)find_bios_structure("_MP_", 4);
+    if (!mpf || checksum(mpf, mpf->length * 16) != 0 || !mpf->config_table) {
+        return -1;
+    }
+    
+    acpi_map(mpf->config_table, sizeof(mp_config_t));
+    mp_config_t* table = (mp_config_t*)mpf->config_table;
+    acpi_map(mpf->config_table, table->length);
+    
+    if (memcmp(table->signature, "PCMP", 4) != 0 ||
+        checksum(table, table->length) != 0) {
+        return -1;
+    }
+    
+    config->lapic_base = table->lapic_address;
+    config->cpu_count = 0;
+    
+    uint8_t* entry = (uint8_t*)(table + 1);
+    for (uint32_t i = 0; i < table->entry_count; i++) {
+        if (entry[0] == MP_ENTRY_PROCESSOR) {
+            // apic_id, version, flags
+            if (entry[3] & MP_CPU_ENABLED) {
+                add_cpu(config, entry[1]);
+            }
+            entry += 20;
+        } else {
+            if (entry[0] == MP_ENTRY_IOAPIC && !config->ioapic_base) {
+                config->ioapic_base = *(uint32_t*)(entry + 4);
+            }
+            entry += 8;
+        }
+    }
+    
+    return config->cpu_count ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+// kernel/hal/acpi.h - ACPI MADT and MP table parsing
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "../../include/types.h"
+#include "cpu.h"
+
+// Processor topology found in firmware tables
+typedef struct {
+    uint32_t lapic_base;
+    uint32_t ioapic_base;
+    uint32_t cpu_count;
+    uint8_t apic_ids[MAX_CPUS];
+} smp_config_t;
+
+// Parse the ACPI MADT. Returns 0 on success.
+int acpi_parse_madt(smp_config_t* config);
+
+// Parse the legacy Intel MP configuration table. Returns 0 on success.
+int mp_parse_table(smp_config_t* config);
+
+#endif // ACPI_H
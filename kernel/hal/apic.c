@@ -0,0 +1,82 @@
+// kernel/hal/apic.c - Local APIC
+#include "apic.h"
+#include "idt.h"
+#include "../mm/paging.h"
+#include "../core/softirq.h"
+#include "../proc/thread.h"
+
+volatile uint32_t* lapic_regs = (volatile uint32_t*)LAPIC_DEFAULT_BASE;
+
+static isr_handler_t apic_handlers[256];
+
+// Vector stubs (irq_stubs.asm)
+extern void apic_vector240(void);
+extern void apic_vector241(void);
+extern void apic_vector242(void);
+extern void apic_vector243(void);
+extern void apic_spurious(void);
+
+// Common handler for LAPIC-delivered vectors
+void apic_handler(registers_t* regs) {
+    // Acknowledge first: irq_exit may switch to another task and the
+    // LAPIC would block this vector until EOI
+    lapic_eoi();
+    irq_enter();
+    
+    isr_handler_t handler = apic_handlers[regs->int_no & 0xFF];
+    if (handler) {
+        handler(regs);
+    }
+    
+    irq_exit();
+    thread_exit_to_user(regs);
+}
+
+void apic_register_handler(uint8_t vector, isr_handler_t handler) {
+    apic_handlers[vector] = handler;
+}
+
+void apic_init(uint32_t base) {
+    lapic_regs = (volatile uint32_t*)base;
+    
+    // Registers are MMIO, map uncached
+    paging_map_page(base, base, PAGE_PRESENT | PAGE_WRITE | PAGE_CACHE_DISABLE);
+    
+    idt_set_gate(APIC_VECTOR_RESCHEDULE, (uint32_t)apic_vector240, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_TICK, (uint32_t)apic_vector241, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_TIMER, (uint32_t)apic_vector242, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_TLB, (uint32_t)apic_vector243, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_SPURIOUS, (uint32_t)apic_spurious, 0x08, 0x8E);
+}
+
+void lapic_enable(void) {
+    // Accept all priorities
+    lapic_write(LAPIC_TPR, 0);
+    
+    // Software enable with the spurious vector
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_VECTOR_SPURIOUS);
+    
+    // Clear any stale error
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    
+    lapic_eoi();
+}
+
+static void lapic_wait_icr(void) {
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_BUSY) {
+        asm volatile("pause");
+    }
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    lapic_wait_icr();
+}
+
+void lapic_broadcast_ipi(uint8_t vector) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_LOW, ICR_ALL_BUT_SELF | vector);
+}
@@ -0,0 +1,79 @@
+// kernel/hal/apic.h - Local APIC
+#ifndef APIC_H
+#define APIC_H
+
+#include "../../include/types.h"
+#include "isr.h"
+
+#define LAPIC_DEFAULT_BASE 0xFEE00000
+
+// Register offsets
+#define LAPIC_ID       0x020
+#define LAPIC_VERSION  0x030
+#define LAPIC_TPR      0x080
+#define LAPIC_EOI      0x0B0
+#define LAPIC_SVR      0x0F0
+#define LAPIC_ESR      0x280
+#define LAPIC_ICR_LOW  0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+#define LAPIC_SVR_ENABLE 0x100
+
+// LVT timer modes
+#define LAPIC_TIMER_ONESHOT     0x00000000
+#define LAPIC_TIMER_PERIODIC    0x00020000
+#define LAPIC_TIMER_TSCDEADLINE 0x00040000
+#define LAPIC_LVT_MASKED        0x00010000
+
+// Divide configuration value for divide-by-16
+#define LAPIC_TIMER_DIV_16 0x3
+
+// ICR fields
+#define ICR_INIT          0x00000500
+#define ICR_STARTUP       0x00000600
+#define ICR_LEVEL_ASSERT  0x00004000
+#define ICR_LEVEL_TRIGGER 0x00008000
+#define ICR_DELIVERY_BUSY 0x00001000
+#define ICR_ALL_BUT_SELF  0x000C0000
+
+// Interrupt vectors owned by the local APIC
+#define APIC_VECTOR_RESCHEDULE 0xF0
+#define APIC_VECTOR_TICK       0xF1
+#define APIC_VECTOR_TIMER      0xF2
+#define APIC_VECTOR_TLB        0xF3
+#define APIC_VECTOR_SPURIOUS   0xFF
+
+extern volatile uint32_t* lapic_regs;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_regs[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_regs[reg / 4] = value;
+}
+
+static inline uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+static inline void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+// Map the LAPIC registers and install the APIC vectors (BSP, once)
+void apic_init(uint32_t base);
+
+// Enable the local APIC of the calling CPU
+void lapic_enable(void);
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr);
+void lapic_broadcast_ipi(uint8_t vector);
+
+void apic_register_handler(uint8_t vector, isr_handler_t handler);
+
+#endif // APIC_H
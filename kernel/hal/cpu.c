@@ -0,0 +1,20 @@
+// kernel/hal/cpu.c - CPU feature detection
+#include "cpu.h"
+
+uint32_t cpu_features_edx = 0;
+uint32_t cpu_features_ecx = 0;
+uint32_t cpu_max_leaf = 0;
+
+void cpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    cpu_max_leaf = eax;
+    if (eax < 1) {
+        return;
+    }
+    
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    cpu_features_edx = edx;
+    cpu_features_ecx = ecx;
+}
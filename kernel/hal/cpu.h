@@ -0,0 +1,111 @@
+// kernel/hal/cpu.h - CPU control helpers
+#ifndef CPU_H
+#define CPU_H
+
+#include "../../include/types.h"
+
+// Upper bound on CPUs brought up by smp_init
+#define MAX_CPUS 8
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_EDX_FPU   (1 << 0)
+#define CPUID_EDX_TSC   (1 << 4)
+#define CPUID_EDX_MSR   (1 << 5)
+#define CPUID_EDX_APIC  (1 << 9)
+#define CPUID_EDX_SEP   (1 << 11)
+#define CPUID_EDX_FXSR  (1 << 24)
+#define CPUID_EDX_SSE   (1 << 25)
+#define CPUID_EDX_SSE2  (1 << 26)
+#define CPUID_ECX_TSC_DEADLINE (1 << 24)
+
+#define MSR_IA32_TSC_DEADLINE 0x6E0
+#define MSR_IA32_SYSENTER_CS  0x174
+#define MSR_IA32_SYSENTER_ESP 0x175
+#define MSR_IA32_SYSENTER_EIP 0x176
+
+// Control register bits
+#define CR0_MP  (1 << 1)   // Monitor coprocessor (WAIT honours TS)
+#define CR0_EM  (1 << 2)   // x87 emulation
+#define CR0_TS  (1 << 3)   // Task switched, FPU use raises #NM
+#define CR0_NE  (1 << 5)   // Native x87 error reporting
+#define CR4_OSFXSR     (1 << 9)   // FXSAVE/FXRSTOR and SSE enabled
+#define CR4_OSXMMEXCPT (1 << 10)  // Unmasked SIMD exceptions raise #XM
+
+// Feature bits detected by cpu_init (CPUID leaf 1)
+extern uint32_t cpu_features_edx;
+extern uint32_t cpu_features_ecx;
+extern uint32_t cpu_max_leaf;
+
+void cpu_init(void);
+
+static inline int cpu_has_feature(uint32_t edx_bit) {
+    return (cpu_features_edx & edx_bit) != 0;
+}
+
+static inline int cpu_has_feature_ecx(uint32_t ecx_bit) {
+    return (cpu_features_ecx & ecx_bit) != 0;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value),
+                 "d"((uint32_t)(value >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx,
+                         uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid"
+                 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                 : "a"(leaf), "c"(0));
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32_t val) {
+    asm volatile("mov %0, %%cr0" :: "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32_t val) {
+    asm volatile("mov %0, %%cr4" :: "r"(val) : "memory");
+}
+
+// Clear CR0.TS
+static inline void clts(void) {
+    asm volatile("clts" ::: "memory");
+}
+
+// Set CR0.TS so the next FPU/SSE instruction traps
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+// Disable interrupts, returning the previous EFLAGS
+static inline uint32_t cpu_irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+// Restore the interrupt flag saved by cpu_irq_save
+static inline void cpu_irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+#endif // CPU_H
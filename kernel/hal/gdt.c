@@ -1,4 +1,7 @@
 #include "gdt.h"
+#include "smp.h"
+
+#define GDT_ENTRIES 7
 
 struct gdt_entry {
     uint16_t limit_low;
@@ -44,73 +47,96 @@ struct tss_entry {
     uint16_t iomap_base;
 } __attribute__((packed));
 
-struct gdt_entry gdt_entries[6];
-struct gdt_ptr gdt_pointer;
-struct tss_entry tss;
+// Each CPU has its own GDT so its TSS (and ring 0 stack) is private
+struct gdt_entry gdt_entries[MAX_CPUS][GDT_ENTRIES];
+struct gdt_ptr gdt_pointer[MAX_CPUS];
+struct tss_entry tss[MAX_CPUS];
 
 extern void gdt_flush(uint32_t);
 
-static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
-    gdt_entries[num].base_low = (base & 0xFFFF);
-    gdt_entries[num].base_middle = (base >> 16) & 0xFF;
-    gdt_entries[num].base_high = (base >> 24) & 0xFF;
+static void gdt_set_gate(struct gdt_entry* gdt, int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    gdt[num].base_low = (base & 0xFFFF);
+    gdt[num].base_middle = (base >> 16) & 0xFF;
+    gdt[num].base_high = (base >> 24) & 0xFF;
     
-    gdt_entries[num].limit_low = (limit & 0xFFFF);
-    gdt_entries[num].granularity = (limit >> 16) & 0x0F;
-    gdt_entries[num].granularity |= gran & 0xF0;
-    gdt_entries[num].access = access;
+    gdt[num].limit_low = (limit & 0xFFFF);
+    gdt[num].granularity = (limit >> 16) & 0x0F;
+    gdt[num].granularity |= gran & 0xF0;
+    gdt[num].access = access;
 }
 
-static void write_tss(int num, uint16_t ss0, uint32_t esp0) {
-    uint32_t base = (uint32_t)&tss;
-    uint32_t limit = sizeof(tss);
+static void write_tss(uint32_t cpu, int num, uint16_t ss0, uint32_t esp0) {
+    struct tss_entry* t = &tss[cpu];
+    uint32_t base = (uint32_t)t;
+    uint32_t limit = sizeof(struct tss_entry);
     
     // Clear TSS
-   uint8_t* tss_ptr = (uint8_t*)&tss;
-    for (uint32_t i = 0; i < sizeof(tss); i++) {
+    uint8_t* tss_ptr = (uint8_t*)t;
+    for (uint32_t i = 0; i < sizeof(struct tss_entry); i++) {
         tss_ptr[i] = 0;
     }
     
-    tss.ss0 = ss0;
-    tss.esp0 = esp0;
+    t->ss0 = ss0;
+    t->esp0 = esp0;
     
     // Set segment registers to kernel data segment
-    tss.cs = 0x0b;  // Kernel code (0x08) | RPL 3
-    tss.ss = tss.ds = tss.es = tss.fs = tss.gs = 0x13;  // Kernel data (0x10) | RPL 3
+    t->cs = 0x0b;  // Kernel code (0x08) | RPL 3
+    t->ss = t->ds = t->es = t->fs = t->gs = 0x13;  // Kernel data (0x10) | RPL 3
     
     // Add TSS descriptor (0xE9 = Present, DPL=0, Type=Available TSS)
-    gdt_set_gate(num, base, limit, 0xE9, 0x00);
+    gdt_set_gate(gdt_entries[cpu], num, base, limit, 0xE9, 0x00);
 }
 
-void gdt_init(void) {
-    gdt_pointer.limit = (sizeof(struct gdt_entry) * 6) - 1;
-    gdt_pointer.base = (uint32_t)&gdt_entries;
+void gdt_init_cpu(uint32_t cpu) {
+    struct gdt_entry* gdt = gdt_entries[cpu];
+    
+    gdt_pointer[cpu].limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    gdt_pointer[cpu].base = (uint32_t)gdt;
     
     // Null descriptor
-    gdt_set_gate(0, 0, 0, 0, 0);
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);
     
     // Kernel code segment (0x08)
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
+    gdt_set_gate(gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
     
     // Kernel data segment (0x10)
-    gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+    gdt_set_gate(gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF);
     
     // User code segment (0x18)
-    gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
+    gdt_set_gate(gdt, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
     
     // User data segment (0x20)
-    gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+    gdt_set_gate(gdt, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
     
     // TSS segment (0x28) - will be set up properly
-    write_tss(5, 0x10, 0x0);
+    write_tss(cpu, 5, 0x10, 0x0);
+    
+    // Thread-local storage (0x30), rebased on every thread switch
+    gdt_set_gate(gdt, GDT_TLS_ENTRY, 0, 0xFFFFFFFF, 0xF2, 0xCF);
     
     // Flush GDT
-    gdt_flush((uint32_t)&gdt_pointer);
+    gdt_flush((uint32_t)&gdt_pointer[cpu]);
     
     // Load TSS (selector 0x28 = index 5 * 8)
     __asm__ volatile("mov $0x28, %ax; ltr %ax");
 }
 
+void gdt_init(void) {
+    gdt_init_cpu(0);
+}
+
 void set_kernel_stack(uint32_t stack) {
-    tss.esp0 = stack;
+    tss[cpu_current()->id].esp0 = stack;
+}
+
+uint32_t gdt_kernel_stack_slot(uint32_t cpu) {
+    return (uint32_t)&tss[cpu].esp0;
+}
+
+// Point the calling CPU's TLS descriptor at base. %gs caches the
+// descriptor, so it is reloaded for the change to take effect.
+void gdt_set_tls(uint32_t base) {
+    gdt_set_gate(gdt_entries[cpu_current()->id], GDT_TLS_ENTRY, base,
+                 0xFFFFFFFF, 0xF2, 0xCF);
+    asm volatile("mov %0, %%gs" :: "r"(GDT_TLS_SELECTOR));
 }
\ No newline at end of file
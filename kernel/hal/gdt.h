@@ -3,7 +3,17 @@
 
 #include "../../include/types.h"
 
+// User data segment whose base is the running thread's TLS; %gs always
+// holds this selector and the interrupt stubs leave it alone
+#define GDT_TLS_ENTRY    6
+#define GDT_TLS_SELECTOR 0x33
+
 void gdt_init(void);
+void gdt_init_cpu(uint32_t cpu);
 void set_kernel_stack(uint32_t stack);
 
+// Address of the TSS field holding a CPU's ring 0 stack (set_kernel_stack)
+uint32_t gdt_kernel_stack_slot(uint32_t cpu);
+void gdt_set_tls(uint32_t base);
+
 #endif
\ No newline at end of file
@@ -4,10 +4,41 @@
 #include "idt.h"
 #include "pic.h"
 #include "../core/monitor.h"
+#include "../core/softirq.h"
+#include "../core/spinlock.h"
+#include "../proc/process.h"
+#include "../proc/thread.h"
+#include "../proc/scheduler.h"
+#include "../proc/wait.h"
+#include "../drivers/timer/pit.h"
+#include "../mm/heap.h"
+#include "../../lib/libc/string.h"
 
 // IRQ handler table
 static isr_handler_t irq_handlers[16] = {0};
 
+// A threaded IRQ: the hard handler masks the line and wakes the thread,
+// which runs the real handler like any other task and unmasks when done
+typedef struct {
+    uint8_t irq;
+    char name[16];
+    isr_handler_t primary;
+    void (*thread_fn)(void* data);
+    void* data;
+    thread_t* thread;
+    volatile uint32_t pending;
+    wait_queue_t wait;
+    uint32_t raised_at;         // timer_clock_us() of the last hard IRQ
+    uint32_t count;             // Hard IRQs taken
+    uint32_t runs;              // Thread handler runs
+    uint32_t lat_max_us;        // Worst hard IRQ to handler start
+} irq_thread_t;
+
+static irq_thread_t* irq_threads[16];
+
+// PIC mask register updates are read-modify-write
+static spinlock_t irq_mask_lock = SPINLOCK_INIT;
+
 // Register an IRQ handler
 void irq_register_handler(uint8_t irq, isr_handler_t handler) {
     if (irq < 16) {
@@ -15,6 +46,133 @@ void irq_register_handler(uint8_t irq, isr_handler_t handler) {
     }
 }
 
+static void irq_thread_main(void* arg) {
+    irq_thread_t* it = (irq_thread_t*)arg;
+    
+    for (;;) {
+        wait_event(it->wait, it->pending != 0);
+        it->pending = 0;
+        
+        uint32_t lat = timer_clock_us() - it->raised_at;
+        if (lat > it->lat_max_us) {
+            it->lat_max_us = lat;
+        }
+        
+        it->thread_fn(it->data);
+        it->runs++;
+        
+        uint32_t flags = spin_lock_irqsave(&irq_mask_lock);
+        pic_unmask_irq(it->irq);
+        spin_unlock_irqrestore(&irq_mask_lock, flags);
+    }
+}
+
+// Hard IRQ side: acknowledge, mask until the thread has run, wake it
+static void irq_thread_wake(irq_thread_t* it, registers_t* regs) {
+    if (it->primary) {
+        it->primary(regs);
+    }
+    
+    spin_lock(&irq_mask_lock);
+    pic_mask_irq(it->irq);
+    spin_unlock(&irq_mask_lock);
+    
+    it->count++;
+    it->raised_at = timer_clock_us();
+    it->pending = 1;
+    wake_up_one(&it->wait);
+}
+
+int irq_register_threaded(uint8_t irq, isr_handler_t primary,
+                          void (*thread_fn)(void* data), void* data,
+                          int32_t nice, const char* name) {
+    if (irq >= 16 || !thread_fn || irq_threads[irq]) {
+        return -1;
+    }
+    
+    irq_thread_t* it = (irq_thread_t*)kmalloc(sizeof(irq_thread_t));
+    if (!it) {
+        return -1;
+    }
+    memset(it, 0, sizeof(irq_thread_t));
+    it->irq = irq;
+    strncpy(it->name, name, sizeof(it->name) - 1);
+    it->primary = primary;
+    it->thread_fn = thread_fn;
+    it->data = data;
+    wait_queue_init(&it->wait);
+    
+    // Shows up in ps and schedstat as "irq/<n>"
+    char proc_name[8] = "irq/";
+    if (irq >= 10) {
+        proc_name[4] = '1';
+        proc_name[5] = '0' + (irq - 10);
+    } else {
+        proc_name[4] = '0' + irq;
+    }
+    
+    process_t* proc = process_create_kernel(proc_name);
+    it->thread = proc ? thread_create(proc, irq_thread_main, it) : NULL;
+    if (!it->thread) {
+        print_string("[IRQ] Error: Failed to start handler thread\n");
+        if (proc) {
+            process_discard(proc);
+        }
+        kfree(it);
+        return -1;
+    }
+    scheduler_set_nice(it->thread, nice);
+    
+    irq_threads[irq] = it;
+    return 0;
+}
+
+int irq_set_thread_nice(uint8_t irq, int32_t nice) {
+    if (irq >= 16 || !irq_threads[irq]) {
+        return -1;
+    }
+    return scheduler_set_nice(irq_threads[irq]->thread, nice);
+}
+
+void irq_thread_stat_list(void) {
+    for (int irq = 0; irq < 16; irq++) {
+        irq_thread_t* it = irq_threads[irq];
+        if (!it) {
+            continue;
+        }
+        
+        print_string("  ");
+        if (irq < 10) print_char(' ');
+        print_dec(irq);
+        print_string("   ");
+        print_string(it->name);
+        for (int j = strlen(it->name); j < 16; j++) {
+            print_char(' ');
+        }
+        
+        int32_t nice = it->thread->nice;
+        if (nice < 0) {
+            print_char('-');
+            nice = -nice;
+        } else {
+            print_char(' ');
+        }
+        print_dec((uint32_t)nice);
+        print_string(nice < 10 ? "     " : "    ");
+        
+        print_dec(it->count);
+        print_string(" irqs, ");
+        print_dec(it->runs);
+        print_string(" runs, ");
+        print_dec(it->thread->stats.run_ms);
+        print_string(" ms run, ");
+        print_dec(it->thread->stats.wait_ms);
+        print_string(" ms waiting, max latency ");
+        print_dec(it->lat_max_us);
+        print_string(" us\n");
+    }
+}
+
 // Common IRQ handler
 void irq_handler(registers_t* regs) {
     // Check if this is a spurious IRQ7 or IRQ15
@@ -30,14 +188,23 @@ void irq_handler(registers_t* regs) {
         }
     }
     
-    // Call the registered handler if exists
+    irq_enter();
+    
+    // Send EOI before the handler: irq_exit may run softirqs or switch to
+    // another task and not return here for a long time, which would block
+    // lower priority IRQs
     uint8_t irq_num = regs->int_no - 32;
-    if (irq_num < 16 && irq_handlers[irq_num]) {
+    pic_send_eoi(irq_num);
+    
+    // Call the registered handler if exists
+    if (irq_num < 16 && irq_threads[irq_num]) {
+        irq_thread_wake(irq_threads[irq_num], regs);
+    } else if (irq_num < 16 && irq_handlers[irq_num]) {
         irq_handlers[irq_num](regs);
     }
     
-    // Send EOI
-    pic_send_eoi(irq_num);
+    irq_exit();
+    thread_exit_to_user(regs);
 }
 
 // Install IRQ handlers
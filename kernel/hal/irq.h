@@ -28,6 +28,20 @@
 void irq_install(void);
 void irq_register_handler(uint8_t irq, isr_handler_t handler);
 
+// Threaded IRQ: primary (may be NULL) runs in the hard IRQ to acknowledge
+// the device, then the line is masked and thread_fn(data) runs in a
+// kernel thread of its own at the given nice value. The line is unmasked
+// when thread_fn returns. Needs the scheduler; returns -1 on failure.
+int irq_register_threaded(uint8_t irq, isr_handler_t primary,
+                          void (*thread_fn)(void* data), void* data,
+                          int32_t nice, const char* name);
+
+// Change the priority of a threaded IRQ's handler thread
+int irq_set_thread_nice(uint8_t irq, int32_t nice);
+
+// Print threaded IRQ statistics (shell irqstat)
+void irq_thread_stat_list(void);
+
 // IRQ stubs (32-47)
 extern void irq0(void);
 extern void irq1(void);
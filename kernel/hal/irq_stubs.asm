@@ -48,11 +48,11 @@ irq_common_stub:
     mov ax, ds
     push eax
     
+    ; %gs holds the thread's TLS selector and is left alone
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     push esp
     call irq_handler
@@ -62,9 +62,60 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     popa
     add esp, 8
     sti
-    iret
\ No newline at end of file
+    iret
+
+; Local APIC vectors (IPIs, LAPIC timer)
+extern apic_handler
+
+global apic_vector240
+global apic_vector241
+global apic_vector242
+global apic_vector243
+
+%macro APIC_VECTOR 1
+apic_vector%1:
+    cli
+    push dword 0
+    push dword %1
+    jmp apic_common_stub
+%endmacro
+
+APIC_VECTOR 240     ; Reschedule IPI
+APIC_VECTOR 241     ; Scheduler tick IPI
+APIC_VECTOR 242     ; Local APIC timer
+APIC_VECTOR 243     ; TLB shootdown IPI
+
+; Spurious interrupts need no EOI
+global apic_spurious
+apic_spurious:
+    iret
+
+apic_common_stub:
+    pusha
+    
+    mov ax, ds
+    push eax
+    
+    ; %gs holds the thread's TLS selector and is left alone
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    
+    push esp
+    call apic_handler
+    add esp, 4
+    
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    
+    popa
+    add esp, 8
+    sti
+    iret
@@ -3,6 +3,7 @@
 #include "isr.h"
 #include "idt.h"
 #include "../core/monitor.h"
+#include "../proc/thread.h"
 
 // ISR handler table
 isr_handler_t interrupt_handlers[256];
@@ -90,6 +91,7 @@ void isr_handler(registers_t* regs) {
     if (interrupt_handlers[regs->int_no] != 0) {
         isr_handler_t handler = interrupt_handlers[regs->int_no];
         handler(regs);
+        thread_exit_to_user(regs);
     } else {
         // Unhandled exception
         print_string("\n!!! EXCEPTION: ");
@@ -87,19 +87,20 @@ isr_common_stub:
     mov ax, ds
     push eax
     
+    ; %gs holds the thread's TLS selector and is left alone
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
+    push esp
     call isr_handler
+    add esp, 4
     
     pop eax
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     popa
     add esp, 8
@@ -43,6 +43,22 @@ void pic_set_mask(uint8_t mask1, uint8_t mask2) {
     outb(PIC2_DATA, mask2);
 }
 
+void pic_mask_irq(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) | (1 << irq));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (irq - 8)));
+    }
+}
+
+void pic_unmask_irq(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+    }
+}
+
 void pic_disable(void) {
     outb(PIC1_DATA, 0xFF);
     outb(PIC2_DATA, 0xFF);
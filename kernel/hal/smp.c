@@ -0,0 +1,232 @@
+// kernel/hal/smp.c - Multiprocessor bring-up
+//
+// CPUs are discovered through the ACPI MADT (falling back to the MP
+// table). Each application processor is started with INIT-SIPI-SIPI into
+// a real-mode trampoline copied to SMP_TRAMPOLINE_BASE, which enters
+// protected mode with the kernel page directory and jumps to ap_main.
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../mm/heap.h"
+#include "../mm/paging.h"
+#include "../proc/process.h"
+#include "../proc/scheduler.h"
+#include "../proc/fpu.h"
+#include "../drivers/timer/pit.h"
+#include "../drivers/timer/lapic_timer.h"
+#include "../syscall/syscall.h"
+#include "../../lib/libc/string.h"
+
+// Trampoline must sit below 1MB on a page boundary; SIPI vector is the page
+#define SMP_TRAMPOLINE_BASE 0x8000
+#define SMP_AP_STACK_SIZE   8192
+
+// Parameter block offsets inside the trampoline (smp_trampoline.asm)
+#define TRAMPOLINE_CR3   4
+#define TRAMPOLINE_STACK 8
+#define TRAMPOLINE_ENTRY 12
+
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_end[];
+extern struct idt_ptr idt_pointer;
+
+cpu_t cpus[MAX_CPUS];
+uint32_t cpu_count = 1;
+volatile int smp_started = 0;
+uint8_t apic_to_cpu[256];
+
+static volatile uint32_t ap_boot_id = 0;
+
+// One TLB shootdown at a time; tlb_pending counts CPUs yet to flush
+static spinlock_t tlb_lock = SPINLOCK_INIT;
+static volatile uint32_t tlb_pending = 0;
+
+static void reschedule_ipi(registers_t* regs) {
+    scheduler_ipi(regs);
+}
+
+static void tick_ipi(registers_t* regs) {
+    scheduler_tick(regs);
+}
+
+static void tlb_ipi(registers_t* regs) {
+    (void)regs;
+    paging_switch_directory(paging_get_directory());
+    __sync_fetch_and_sub(&tlb_pending, 1);
+}
+
+// First C code run by an application processor
+static void ap_main(void) {
+    uint32_t id = ap_boot_id;
+    cpu_t* cpu = &cpus[id];
+    
+    gdt_init_cpu(id);
+    idt_load((uint32_t)&idt_pointer);
+    lapic_enable();
+    lapic_timer_start();
+    fpu_init_cpu();
+    syscall_init_cpu();
+    
+    char name[8] = "idle";
+    name[4] = '0' + (char)id;
+    name[5] = '\0';
+    
+    // The boot context becomes this CPU's idle task
+    cpu->idle = process_create_idle(name);
+    cpu->current = cpu->idle;
+    cpu->online = 1;
+    
+    asm volatile("sti");
+    
+    // Ticks come from this CPU's LAPIC timer (or tick_ipi without one);
+    // sleep until there is work
+    while (1) {
+        asm volatile("hlt");
+        if (scheduler_has_ready()) {
+            yield();
+        }
+    }
+}
+
+static int smp_start_ap(uint32_t id) {
+    cpu_t* cpu = &cpus[id];
+    uint8_t* tramp = (uint8_t*)SMP_TRAMPOLINE_BASE;
+    
+    void* stack = kmalloc(SMP_AP_STACK_SIZE);
+    if (!stack) {
+        return -1;
+    }
+    cpu->boot_stack = (uint32_t)stack + SMP_AP_STACK_SIZE;
+    
+    *(uint32_t*)(tramp + TRAMPOLINE_CR3) = (uint32_t)paging_get_kernel_directory();
+    *(uint32_t*)(tramp + TRAMPOLINE_STACK) = cpu->boot_stack;
+    *(uint32_t*)(tramp + TRAMPOLINE_ENTRY) = (uint32_t)ap_main;
+    ap_boot_id = id;
+    
+    // INIT, wait 10ms, then two STARTUPs
+    lapic_send_ipi(cpu->apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+    timer_wait(TIMER_MS_TO_TICKS(10));
+    
+    for (int attempt = 0; attempt < 2 && !cpu->online; attempt++) {
+        lapic_send_ipi(cpu->apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_BASE >> 12));
+        timer_wait(1);
+    }
+    
+    // Allow up to 100ms for the AP to check in
+    uint32_t deadline = timer_get_ticks() + TIMER_MS_TO_TICKS(100);
+    while (!cpu->online && (int32_t)(timer_get_ticks() - deadline) < 0) {
+        asm volatile("hlt");
+    }
+    
+    return cpu->online ? 0 : -1;
+}
+
+void smp_init(void) {
+    smp_config_t config;
+    memset(&config, 0, sizeof(config));
+    
+    cpus[0].id = 0;
+    cpus[0].online = 1;
+    
+    if (!cpu_has_feature(CPUID_EDX_APIC)) {
+        print_string(" [no APIC]");
+        return;
+    }
+    
+    if (acpi_parse_madt(&config) != 0 && mp_parse_table(&config) != 0) {
+        print_string(" [no MADT/MP table]");
+        return;
+    }
+    
+    apic_init(config.lapic_base ? config.lapic_base : LAPIC_DEFAULT_BASE);
+    lapic_enable();
+    
+    apic_register_handler(APIC_VECTOR_RESCHEDULE, reschedule_ipi);
+    apic_register_handler(APIC_VECTOR_TICK, tick_ipi);
+    apic_register_handler(APIC_VECTOR_TLB, tlb_ipi);
+    
+    cpus[0].apic_id = lapic_id();
+    apic_to_cpu[cpus[0].apic_id] = 0;
+    smp_started = 1;
+    
+    // Take over the tick from the PIT before starting the APs so each
+    // of them can start its own timer
+    lapic_timer_init();
+    
+    memcpy((void*)SMP_TRAMPOLINE_BASE, smp_trampoline_start,
+           (uint32_t)(smp_trampoline_end - smp_trampoline_start));
+    
+    for (uint32_t i = 0; i < config.cpu_count; i++) {
+        if (config.apic_ids[i] == cpus[0].apic_id || cpu_count >= MAX_CPUS) {
+            continue;
+        }
+        
+        uint32_t id = cpu_count;
+        cpus[id].id = id;
+        cpus[id].apic_id = config.apic_ids[i];
+        apic_to_cpu[config.apic_ids[i]] = (uint8_t)id;
+        
+        if (smp_start_ap(id) == 0) {
+            cpu_count++;
+        } else {
+            print_string(" [AP ");
+            print_dec(config.apic_ids[i]);
+            print_string(" failed]");
+        }
+    }
+    
+    print_string(" ");
+    print_dec(cpu_count);
+    print_string(" CPU(s)");
+}
+
+void smp_send_reschedule(uint32_t cpu) {
+    if (!smp_started || cpu >= cpu_count || !cpus[cpu].online) {
+        return;
+    }
+    lapic_send_ipi(cpus[cpu].apic_id, APIC_VECTOR_RESCHEDULE);
+}
+
+void smp_broadcast_tick(void) {
+    if (smp_started && cpu_count > 1) {
+        lapic_broadcast_ipi(APIC_VECTOR_TICK);
+    }
+}
+
+void smp_flush_tlb(page_directory_t* dir) {
+    if (!smp_started || cpu_count < 2) {
+        return;
+    }
+    
+    // Taken with interrupts on: a CPU waiting here must still answer the
+    // shootdown in progress
+    spin_lock(&tlb_lock);
+    cpu_t* self = cpu_current();
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        thread_t* thread = cpus[i].current;
+        if (&cpus[i] == self || !cpus[i].online || !thread || !thread->proc ||
+            thread->proc->page_dir != dir) {
+            continue;
+        }
+        __sync_fetch_and_add(&tlb_pending, 1);
+        lapic_send_ipi(cpus[i].apic_id, APIC_VECTOR_TLB);
+    }
+    while (tlb_pending) {
+        asm volatile("pause");
+    }
+    spin_unlock(&tlb_lock);
+}
+
+int smp_others_idle(void) {
+    cpu_t* self = cpu_current();
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (&cpus[i] != self && cpus[i].current != cpus[i].idle) {
+            return 0;
+        }
+    }
+    return 1;
+}
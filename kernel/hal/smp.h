@@ -0,0 +1,57 @@
+// kernel/hal/smp.h - Multiprocessor bring-up and per-CPU data
+#ifndef SMP_H
+#define SMP_H
+
+#include "../../include/types.h"
+#include "cpu.h"
+#include "apic.h"
+#include "../mm/paging.h"
+#include "../proc/runqueue.h"
+
+struct thread;
+
+typedef struct cpu {
+    uint32_t id;                // Index into cpus[]
+    uint32_t apic_id;
+    volatile uint32_t online;
+    struct thread* current;     // Thread running on this CPU
+    struct thread* idle;        // Runs when the run queue is empty
+    struct thread* fpu_owner;   // Thread whose state is in this CPU's FPU
+    struct thread* last;        // Thread switched out, until the switch completes
+    uint32_t boot_stack;        // AP boot/idle stack
+    volatile uint8_t need_resched; // Set in IRQ context, acted on by irq_exit()
+    runqueue_t rq;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t cpu_count;
+extern volatile int smp_started;
+extern uint8_t apic_to_cpu[256];
+
+// Per-CPU data of the calling CPU. Until smp_init has set up the LAPIC
+// everything runs on the BSP.
+static inline cpu_t* cpu_current(void) {
+    if (!smp_started) {
+        return &cpus[0];
+    }
+    return &cpus[apic_to_cpu[lapic_id()]];
+}
+
+// Parse firmware tables, enable the LAPIC and start application processors
+void smp_init(void);
+
+// Interrupt another CPU so it re-runs its scheduler
+void smp_send_reschedule(uint32_t cpu);
+
+// Deliver the scheduler tick to all other CPUs
+void smp_broadcast_tick(void);
+
+// Make every other CPU running with dir loaded flush its TLB, and wait
+// until they have. Called with interrupts enabled and no spinlock held,
+// after the page tables have been changed.
+void smp_flush_tlb(page_directory_t* dir);
+
+// Are all CPUs other than the caller idle?
+int smp_others_idle(void);
+
+#endif // SMP_H
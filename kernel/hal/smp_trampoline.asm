@@ -0,0 +1,71 @@
+; kernel/hal/smp_trampoline.asm
+; Application processor entry. Copied to TRAMP_BASE by smp_init; the
+; STARTUP IPI starts the AP here in real mode at TRAMP_BASE:0.
+[BITS 16]
+
+TRAMP_BASE equ 0x8000
+
+%define TRAMP(label) (TRAMP_BASE + (label - smp_trampoline_start))
+
+section .text
+
+global smp_trampoline_start
+global smp_trampoline_end
+
+smp_trampoline_start:
+    jmp short tramp_real
+
+align 4
+; Parameter block, filled in by smp_start_ap (offsets 4, 8, 12)
+tramp_cr3:      dd 0
+tramp_stack:    dd 0
+tramp_entry:    dd 0
+
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; 0x08: flat code
+    dq 0x00CF92000000FFFF           ; 0x10: flat data
+tramp_gdtr:
+    dw tramp_gdtr - tramp_gdt - 1
+    dd TRAMP(tramp_gdt)
+
+tramp_real:
+    cli
+    xor ax, ax
+    mov ds, ax
+    
+    lgdt [TRAMP(tramp_gdtr)]
+    
+    mov eax, cr0
+    or eax, 1                       ; PE
+    mov cr0, eax
+    
+    jmp dword 0x08:TRAMP(tramp_protected)
+
+[BITS 32]
+tramp_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    
+    ; Same address space as the BSP
+    mov eax, [TRAMP(tramp_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80010000              ; PG, WP
+    mov cr0, eax
+    
+    mov esp, [TRAMP(tramp_stack)]
+    mov eax, [TRAMP(tramp_entry)]
+    call eax
+    
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+smp_trampoline_end:
@@ -1,6 +1,7 @@
 #include "heap.h"
 #include "pmm.h"
 #include "../core/monitor.h"
+#include "../core/spinlock.h"
 
 #define HEAP_START 0x00400000  // 4MB
 #define HEAP_SIZE  0x00400000  // 4MB heap
@@ -13,6 +14,7 @@ typedef struct heap_block {
 
 static heap_block_t* heap_start = 0;
 static uint32_t heap_used = 0;
+static spinlock_t heap_lock = SPINLOCK_INIT;
 
 void heap_init() {
     print_string("[HEAP] Initializing kernel heap...\n");
@@ -23,6 +25,9 @@ void heap_init() {
     heap_start->next = 0;
     heap_used = 0;
     
+    // Keep page allocations out of the heap
+    pmm_reserve_region(HEAP_START, HEAP_SIZE);
+    
     print_string("[HEAP] Heap at 0x");
     print_hex(HEAP_START);
     print_string(", size: ");
@@ -38,6 +43,7 @@ void* kmalloc(uint32_t size) {
     // Align to 4 bytes
     size = (size + 3) & ~3;
     
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
     heap_block_t* current = heap_start;
     
     while (current) {
@@ -56,12 +62,14 @@ void* kmalloc(uint32_t size) {
             current->used = 1;
             heap_used += current->size;
             
+            spin_unlock_irqrestore(&heap_lock, flags);
             return (void*)((uint32_t)current + sizeof(heap_block_t));
         }
         
         current = current->next;
     }
     
+    spin_unlock_irqrestore(&heap_lock, flags);
     return 0;  // Out of memory
 }
 
@@ -71,8 +79,10 @@ void kfree(void* ptr) {
     }
     
     heap_block_t* block = (heap_block_t*)((uint32_t)ptr - sizeof(heap_block_t));
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
     
     if (!block->used) {
+        spin_unlock_irqrestore(&heap_lock, flags);
         return;  // Already freed
     }
     
@@ -95,6 +105,8 @@ void kfree(void* ptr) {
         current->size += sizeof(heap_block_t) + block->size;
         current->next = block->next;
     }
+    
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
 uint32_t heap_get_used() {
@@ -1,32 +1,45 @@
 // kernel/mm/paging.c
 #include "paging.h"
 #include "pmm.h"
+#include "vmm.h"
+#include "uaccess.h"
 #include "../core/monitor.h"
 #include "../hal/isr.h"
+#include "../../lib/libc/string.h"
 
 // Kernel page directory
 static page_directory_t* kernel_directory = NULL;
-static page_directory_t* current_directory = NULL;
 
 // Page tables pool (temporary, should use dynamic allocation)
 static page_table_t page_tables[256] __attribute__((aligned(PAGE_SIZE)));
 static uint32_t next_table_index = 0;
 
 // Forward declaration
-static void page_fault_handler_internal(uint32_t error_code, uint32_t faulting_addr);
+static void page_fault_handler_internal(registers_t* regs, uint32_t error_code, uint32_t faulting_addr);
 
 // Assembly function to load page directory
 extern void paging_load_directory(uint32_t phys_addr);
 extern void paging_enable(void);
 
-// Get a free page table
+static inline page_directory_t* read_cr3(void) {
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (page_directory_t*)cr3;
+}
+
+// Get a free page table: kernel tables come from the pool while it lasts,
+// then from the PMM (frames are identity-mapped, so usable as is)
 static page_table_t* alloc_page_table(void) {
-    if (next_table_index >= 256) {
-        return NULL; // Out of tables
+    page_table_t* table;
+    if (next_table_index < 256) {
+        table = &page_tables[next_table_index++];
+    } else {
+        table = (page_table_t*)pmm_alloc_page();
+        if (!table) {
+            return NULL; // Out of tables
+        }
     }
     
-    page_table_t* table = &page_tables[next_table_index++];
-    
     // Clear table
     for (int i = 0; i < PAGE_TABLE_SIZE; i++) {
         table->entries[i].present = 0;
@@ -44,14 +57,38 @@ void page_fault_handler(registers_t* regs) {
     uint32_t faulting_addr;
     asm volatile("mov %%cr2, %0" : "=r"(faulting_addr));
     
-    page_fault_handler_internal(regs->err_code, faulting_addr);
+    page_fault_handler_internal(regs, regs->err_code, faulting_addr);
 }
 
 // Page fault handler implementation
-static void page_fault_handler_internal(uint32_t error_code, uint32_t faulting_addr) {
+static void page_fault_handler_internal(registers_t* regs, uint32_t error_code, uint32_t faulting_addr) {
     page_fault_error_t error;
     *((uint32_t*)&error) = error_code;
     
+    // A kernel page table created after this directory was copied from
+    // the kernel's: pick it up now
+    page_directory_t* dir = read_cr3();
+    uint32_t dir_index = PAGE_DIR_INDEX(faulting_addr);
+    if (!IS_USER_ADDR(faulting_addr) && dir != kernel_directory &&
+        kernel_directory->entries[dir_index].present &&
+        !dir->entries[dir_index].present) {
+        dir->entries[dir_index] = kernel_directory->entries[dir_index];
+        return;
+    }
+    
+    // Demand paging; any bad access from ring 3 kills the process there
+    if ((IS_USER_ADDR(faulting_addr) || error.user) &&
+        vmm_handle_fault(faulting_addr, error_code) == 0) {
+        return;
+    }
+    
+    // A user-memory copy hit a bad address: its fixup fails the copy
+    uint32_t fixup = error.user ? 0 : uaccess_fixup(regs->eip);
+    if (fixup) {
+        regs->eip = fixup;
+        return;
+    }
+    
     print_string("\n\n!!! PAGE FAULT !!!\n");
     print_string("Address: 0x");
     print_hex(faulting_addr);
@@ -94,21 +131,25 @@ void paging_init(void) {
         kernel_directory->entries[i].frame = 0;
     }
     
-    // Identity map first 16MB (kernel space + heap)
-    print_string("    Identity mapping first 16MB...\n");
+    // Identity map all usable RAM (kernel, heap and every PMM frame), at
+    // least the first 16MB
+    uint32_t identity_end = PAGE_ALIGN_UP(pmm_get_total_memory());
+    if (identity_end < 0x1000000) {
+        identity_end = 0x1000000;
+    }
+    print_string("    Identity mapping RAM...\n");
     
-    for (uint32_t i = 0; i < 0x1000000; i += PAGE_SIZE) {
+    for (uint32_t i = 0; i < identity_end; i += PAGE_SIZE) {
         paging_map_page(i, i, PAGE_PRESENT | PAGE_WRITE);
     }
     
-    print_string("    Mapped 0x00000000 - 0x01000000\n");
+    print_string("    Mapped 0x00000000 - 0x");
+    print_hex(identity_end);
+    print_string("\n");
     
     // Register page fault handler (ISR 14)
     isr_register_handler(14, page_fault_handler);
     
-    // Switch to kernel directory
-    current_directory = kernel_directory;
-    
     print_string("    Loading page directory...\n");
     paging_load_directory((uint32_t)kernel_directory);
     
@@ -147,6 +188,8 @@ void paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
     table->entries[table_index].present = (flags & PAGE_PRESENT) ? 1 : 0;
     table->entries[table_index].rw = (flags & PAGE_WRITE) ? 1 : 0;
     table->entries[table_index].user = (flags & PAGE_USER) ? 1 : 0;
+    table->entries[table_index].pwt = (flags & PAGE_WRITE_THROUGH) ? 1 : 0;
+    table->entries[table_index].pcd = (flags & PAGE_CACHE_DISABLE) ? 1 : 0;
     table->entries[table_index].frame = phys >> 12;
 }
 
@@ -183,12 +226,257 @@ uint32_t paging_get_physical(uint32_t virt) {
 }
 
 void paging_switch_directory(page_directory_t* dir) {
-    current_directory = dir;
     paging_load_directory((uint32_t)dir);
 }
 
 page_directory_t* paging_get_directory(void) {
-    return current_directory;
+    return read_cr3();
+}
+
+page_directory_t* paging_get_kernel_directory(void) {
+    return kernel_directory;
+}
+
+page_directory_t* paging_create_directory(void) {
+    page_directory_t* dir = (page_directory_t*)pmm_alloc_page();
+    if (!dir) {
+        return NULL;
+    }
+    
+    // Kernel entries point at the kernel's own page tables, so later
+    // changes within them are seen by every directory
+    for (uint32_t i = 0; i < PAGE_DIR_SIZE; i++) {
+        if (i >= PAGE_DIR_INDEX(USER_BASE) && i < PAGE_DIR_INDEX(USER_END)) {
+            memset(&dir->entries[i], 0, sizeof(page_dir_entry_t));
+        } else {
+            dir->entries[i] = kernel_directory->entries[i];
+        }
+    }
+    return dir;
+}
+
+void paging_destroy_directory(page_directory_t* dir) {
+    if (!dir || dir == kernel_directory) {
+        return;
+    }
+    
+    for (uint32_t i = PAGE_DIR_INDEX(USER_BASE); i < PAGE_DIR_INDEX(USER_END); i++) {
+        if (dir->entries[i].present) {
+            pmm_free_page((void*)(dir->entries[i].frame << 12));
+        }
+    }
+    pmm_free_page(dir);
+}
+
+int paging_map_user(page_directory_t* dir, uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t dir_index = PAGE_DIR_INDEX(virt);
+    uint32_t table_index = PAGE_TABLE_INDEX(virt);
+    
+    if (!IS_USER_ADDR(virt)) {
+        return -1;
+    }
+    
+    page_table_t* table;
+    if (!dir->entries[dir_index].present) {
+        table = (page_table_t*)pmm_alloc_page();
+        if (!table) {
+            return -1;
+        }
+        memset(table, 0, sizeof(page_table_t));
+        
+        // Permissions are enforced per page
+        dir->entries[dir_index].frame = ((uint32_t)table) >> 12;
+        dir->entries[dir_index].rw = 1;
+        dir->entries[dir_index].user = 1;
+        dir->entries[dir_index].present = 1;
+    } else {
+        table = (page_table_t*)(dir->entries[dir_index].frame << 12);
+    }
+    
+    page_table_entry_t* pte = &table->entries[table_index];
+    memset(pte, 0, sizeof(page_table_entry_t));
+    pte->frame = phys >> 12;
+    pte->rw = (flags & PAGE_WRITE) ? 1 : 0;
+    pte->user = (flags & PAGE_USER) ? 1 : 0;
+    pte->present = (flags & PAGE_PRESENT) ? 1 : 0;
+    
+    // Drop any translation cached for the page's previous mapping
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    return 0;
+}
+
+uint32_t paging_lookup(page_directory_t* dir, uint32_t virt) {
+    uint32_t dir_index = PAGE_DIR_INDEX(virt);
+    uint32_t table_index = PAGE_TABLE_INDEX(virt);
+    
+    if (!dir || !dir->entries[dir_index].present) {
+        return 0;
+    }
+    
+    page_table_t* table = (page_table_t*)(dir->entries[dir_index].frame << 12);
+    if (!table->entries[table_index].present) {
+        return 0;
+    }
+    return (table->entries[table_index].frame << 12) | (virt & 0xFFF);
+}
+
+// Page table covering virt in dir, NULL if there is none
+static page_table_t* user_table(page_directory_t* dir, uint32_t virt) {
+    if (!dir->entries[PAGE_DIR_INDEX(virt)].present) {
+        return NULL;
+    }
+    return (page_table_t*)(dir->entries[PAGE_DIR_INDEX(virt)].frame << 12);
+}
+
+// End of the page table's span containing virt, capped at end
+static uint32_t table_end(uint32_t virt, uint32_t end) {
+    uint32_t next = (PAGE_DIR_INDEX(virt) + 1) << 22;
+    return (next > end || next == 0) ? end : next;
+}
+
+void paging_update_user(page_directory_t* dir, uint32_t start, uint32_t end,
+                        uint32_t clear, uint32_t set) {
+    uint32_t virt = start;
+    while (virt < end) {
+        uint32_t stop = table_end(virt, end);
+        page_table_t* table = user_table(dir, virt);
+        if (!table) {
+            virt = stop;
+            continue;
+        }
+        
+        for (; virt < stop; virt += PAGE_SIZE) {
+            uint32_t* pte = (uint32_t*)&table->entries[PAGE_TABLE_INDEX(virt)];
+            if (*pte & 0xFFFFF000) {
+                *pte = (*pte & ~clear) | set;
+            }
+        }
+    }
+}
+
+uint32_t paging_release_user(page_directory_t* dir, uint32_t start, uint32_t end,
+                             int free_frames) {
+    uint32_t found = 0;
+    uint32_t virt = start;
+    while (virt < end) {
+        uint32_t stop = table_end(virt, end);
+        page_table_t* table = user_table(dir, virt);
+        if (!table) {
+            virt = stop;
+            continue;
+        }
+        
+        for (; virt < stop; virt += PAGE_SIZE) {
+            uint32_t* pte = (uint32_t*)&table->entries[PAGE_TABLE_INDEX(virt)];
+            uint32_t frame = *pte & 0xFFFFF000;
+            *pte = 0;
+            if (frame) {
+                found++;
+                if (free_frames) {
+                    pmm_free_page((void*)frame);
+                }
+            }
+        }
+    }
+    return found;
+}
+
+// Past this many pages reloading CR3 is cheaper than invlpg one by one
+#define FLUSH_ALL_PAGES 32
+
+void paging_flush_user(page_directory_t* dir, uint32_t start, uint32_t end) {
+    if (dir != read_cr3()) {
+        return;
+    }
+    if ((end - start) / PAGE_SIZE > FLUSH_ALL_PAGES) {
+        paging_load_directory((uint32_t)dir);
+        return;
+    }
+    for (uint32_t virt = start; virt < end; virt += PAGE_SIZE) {
+        asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    }
+}
+
+// Idle age field of a PTE (the available bits)
+#define PTE_AGE_SHIFT   9
+#define PTE_AGE_MASK    (PAGE_IDLE_AGE_MAX << PTE_AGE_SHIFT)
+
+uint32_t paging_scan_accessed(page_directory_t* dir, uint32_t* mapped) {
+    uint32_t referenced = 0;
+    uint32_t present = 0;
+    
+    if (!dir) {
+        if (mapped) *mapped = 0;
+        return 0;
+    }
+    
+    for (int d = 0; d < PAGE_DIR_SIZE; d++) {
+        // A supervisor PDE cannot expose user pages, skip the whole table
+        if (!dir->entries[d].present || !dir->entries[d].user) {
+            continue;
+        }
+        
+        page_table_t* table = (page_table_t*)(dir->entries[d].frame << 12);
+        
+        for (int t = 0; t < PAGE_TABLE_SIZE; t++) {
+            page_table_entry_t* pte = &table->entries[t];
+            if (!pte->present || !pte->user) {
+                continue;
+            }
+            
+            present++;
+            
+            // Other CPUs set A and D with locked updates while we look, so
+            // the entry is rewritten whole with a compare-and-swap
+            volatile uint32_t* raw = (volatile uint32_t*)&table->entries[t];
+            uint32_t old, new;
+            do {
+                old = *raw;
+                if (old & PAGE_ACCESSED) {
+                    new = old & ~(PAGE_ACCESSED | PTE_AGE_MASK);
+                } else if ((old & PTE_AGE_MASK) < PTE_AGE_MASK) {
+                    new = old + (1 << PTE_AGE_SHIFT);
+                } else {
+                    break;
+                }
+            } while (!__sync_bool_compare_and_swap(raw, old, new));
+            
+            if (old & PAGE_ACCESSED) {
+                referenced++;
+            }
+        }
+        
+        __sync_fetch_and_and((volatile uint32_t*)&dir->entries[d], ~PAGE_ACCESSED);
+    }
+    
+    // Cleared A bits are only set again on a TLB miss, so flush the TLB
+    // if the scanned directory is live here. Other CPUs running it are not
+    // interrupted for a sample (the scan runs from the tick and cannot wait
+    // on them); pages they reach through entries still cached in their
+    // TLBs count as idle until they next reload CR3.
+    if (dir == read_cr3() && present) {
+        paging_load_directory((uint32_t)dir);
+    }
+    
+    if (mapped) *mapped = present;
+    return referenced;
+}
+
+uint32_t paging_get_idle_age(page_directory_t* dir, uint32_t virt) {
+    uint32_t dir_index = PAGE_DIR_INDEX(virt);
+    uint32_t table_index = PAGE_TABLE_INDEX(virt);
+    
+    if (!dir || !dir->entries[dir_index].present) {
+        return PAGE_IDLE_AGE_MAX;
+    }
+    
+    page_table_t* table = (page_table_t*)(dir->entries[dir_index].frame << 12);
+    
+    if (!table->entries[table_index].present) {
+        return PAGE_IDLE_AGE_MAX;
+    }
+    
+    return table->entries[table_index].available;
 }
 
 // Test paging functionality
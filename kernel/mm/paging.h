@@ -11,11 +11,16 @@ typedef struct registers registers_t;
 #define PAGE_PRESENT    0x001
 #define PAGE_WRITE      0x002
 #define PAGE_USER       0x004
+#define PAGE_WRITE_THROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010
 #define PAGE_ACCESSED   0x020
 #define PAGE_DIRTY      0x040
 #define PAGE_SIZE_4MB   0x080
 #define PAGE_GLOBAL     0x100
 
+// Idle age of a page is kept in the 3 PTE bits available to the OS
+#define PAGE_IDLE_AGE_MAX 7
+
 // Page sizes
 #define PAGE_SIZE       4096
 #define PAGE_TABLE_SIZE 1024
@@ -25,6 +30,13 @@ typedef struct registers registers_t;
 #define PAGE_ALIGN_DOWN(addr) ((addr) & 0xFFFFF000)
 #define PAGE_ALIGN_UP(addr)   (((addr) + 0xFFF) & 0xFFFFF000)
 
+// Address space layout. RAM is identity-mapped below USER_BASE and MMIO
+// is mapped above USER_END; those page tables are shared by every
+// directory. Each process owns the range in between.
+#define USER_BASE       0x40000000
+#define USER_END        0xC0000000
+#define IS_USER_ADDR(addr) ((addr) >= USER_BASE && (addr) < USER_END)
+
 // Get page directory/table indices
 #define PAGE_DIR_INDEX(addr)   ((addr) >> 22)
 #define PAGE_TABLE_INDEX(addr) (((addr) >> 12) & 0x3FF)
@@ -93,9 +105,52 @@ uint32_t paging_get_physical(uint32_t virt);
 // Switch page directory
 void paging_switch_directory(page_directory_t* dir);
 
-// Get current directory
+// Directory loaded on the calling CPU
 page_directory_t* paging_get_directory(void);
 
+// New directory sharing the kernel's mappings, with an empty user range.
+// NULL when out of memory.
+page_directory_t* paging_create_directory(void);
+
+// Free a directory and its user page tables. The pages they mapped are
+// the caller's to free; the directory must not be loaded on any CPU.
+void paging_destroy_directory(page_directory_t* dir);
+
+// Map a page in the user range of dir, allocating its page table on
+// demand. Returns -1 when out of memory.
+int paging_map_user(page_directory_t* dir, uint32_t virt, uint32_t phys, uint32_t flags);
+
+// Physical address a directory maps virt to, 0 if unmapped
+uint32_t paging_lookup(page_directory_t* dir, uint32_t virt);
+
+// Rewrite the user PTEs of dir in [start, end) that hold a frame, present
+// or not: clear the PAGE_* bits in clear, then set those in set. Missing
+// page tables are skipped, so a sparse range costs little. The caller
+// flushes the TLB.
+void paging_update_user(page_directory_t* dir, uint32_t start, uint32_t end,
+                        uint32_t clear, uint32_t set);
+
+// Zero the user PTEs of dir in [start, end), freeing the frames they held
+// if free_frames is set. Returns the number of frames found.
+uint32_t paging_release_user(page_directory_t* dir, uint32_t start, uint32_t end,
+                             int free_frames);
+
+// Drop the calling CPU's cached translations of [start, end) in dir, if
+// dir is loaded
+void paging_flush_user(page_directory_t* dir, uint32_t start, uint32_t end);
+
+// Get the kernel (shared) directory
+page_directory_t* paging_get_kernel_directory(void);
+
+// Sample and clear accessed bits of all user pages in a directory, whose
+// owner's mm_lock the caller holds. Returns the number of pages referenced
+// since the last scan; the total number of mapped user pages is stored in
+// *mapped (if non-NULL).
+uint32_t paging_scan_accessed(page_directory_t* dir, uint32_t* mapped);
+
+// Number of scans a user page has gone unreferenced (0-7, saturating)
+uint32_t paging_get_idle_age(page_directory_t* dir, uint32_t virt);
+
 // Test paging
 void paging_test(void);
 
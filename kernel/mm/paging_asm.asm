@@ -15,12 +15,13 @@ paging_load_directory:
     pop ebp
     ret
 
-; Enable paging by setting CR0.PG
+; Enable paging by setting CR0.PG. CR0.WP makes read-only user pages
+; read-only for the kernel too, so copy_to_user cannot write shared text.
 paging_enable:
     push ebp
     mov ebp, esp
     mov eax, cr0
-    or eax, 0x80000000    ; Set PG bit
+    or eax, 0x80010000    ; Set PG and WP bits
     mov cr0, eax
     mov esp, ebp
     pop ebp
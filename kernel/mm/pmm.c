@@ -1,5 +1,7 @@
 #include "pmm.h"
+#include "paging.h"
 #include "../core/monitor.h"
+#include "../core/spinlock.h"
 
 #define BITMAP_SIZE (128 * 1024)
 
@@ -8,6 +10,11 @@ uint32_t used_blocks = 0;
 uint32_t total_blocks = 0;
 uint32_t* memory_bitmap = 0;
 
+// Word to resume the free-frame search from, and the lock serialising
+// allocations across CPUs
+static uint32_t next_word = 0;
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+
 static inline void bitmap_set(uint32_t bit) {
     memory_bitmap[bit / 32] |= (1 << (bit % 32));
 }
@@ -20,10 +27,22 @@ static inline uint32_t bitmap_test(uint32_t bit) {
     return memory_bitmap[bit / 32] & (1 << (bit % 32));
 }
 
+// Next-fit search a word at a time, skipping fully used words
 static int32_t bitmap_find_free() {
-    for (uint32_t i = 0; i < total_blocks; i++) {
-        if (!bitmap_test(i)) {
-            return i;
+    uint32_t words = (total_blocks + 31) / 32;
+    
+    for (uint32_t n = 0; n < words; n++) {
+        uint32_t w = (next_word + n) % words;
+        if (memory_bitmap[w] == 0xFFFFFFFF) {
+            continue;
+        }
+        
+        for (uint32_t bit = 0; bit < 32; bit++) {
+            uint32_t i = w * 32 + bit;
+            if (i < total_blocks && !bitmap_test(i)) {
+                next_word = w;
+                return i;
+            }
         }
     }
     return -1;
@@ -42,10 +61,30 @@ void pmm_init(multiboot_info_t* mbi, uint32_t kernel_end) {
         print_string("[PMM] Assuming 32 MB\n");
     }
     
+    // The kernel only reaches physical memory through the identity map
+    if (total_memory > PMM_MEMORY_LIMIT) {
+        total_memory = PMM_MEMORY_LIMIT;
+        print_string("[PMM] Using the first ");
+        print_dec(total_memory / 1024 / 1024);
+        print_string(" MB\n");
+    }
+    
     total_blocks = total_memory / PAGE_SIZE;
     used_blocks = total_blocks;
     
-    memory_bitmap = (uint32_t*)((kernel_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    // Boot modules (the initrd) are loaded after the kernel; keep the
+    // bitmap and every free frame clear of them
+    uint32_t reserved_end = kernel_end;
+    if ((mbi->flags & MULTIBOOT_FLAG_MODS) && mbi->mods_count) {
+        multiboot_module_t* mods = (multiboot_module_t*)mbi->mods_addr;
+        for (uint32_t i = 0; i < mbi->mods_count; i++) {
+            if (mods[i].mod_end > reserved_end) {
+                reserved_end = mods[i].mod_end;
+            }
+        }
+    }
+    
+    memory_bitmap = (uint32_t*)((reserved_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
     
     print_string("[PMM] Bitmap at: 0x");
     print_hex((uint32_t)memory_bitmap);
@@ -74,15 +113,33 @@ void pmm_init(multiboot_info_t* mbi, uint32_t kernel_end) {
     print_string(" MB\n");
 }
 
+void pmm_reserve_region(uint32_t start, uint32_t size) {
+    uint32_t first = start / PAGE_SIZE;
+    uint32_t last = (start + size + PAGE_SIZE - 1) / PAGE_SIZE;
+    
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    for (uint32_t i = first; i < last && i < total_blocks; i++) {
+        if (!bitmap_test(i)) {
+            bitmap_set(i);
+            used_blocks++;
+        }
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
 void* pmm_alloc_page() {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    
     int32_t page = bitmap_find_free();
     if (page < 0) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
         return 0;
     }
     
     bitmap_set(page);
     used_blocks++;
     
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return (void*)(page * PAGE_SIZE);
 }
 
@@ -93,12 +150,12 @@ void pmm_free_page(void* page) {
         return;
     }
     
-    if (!bitmap_test(page_num)) {
-        return;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    if (bitmap_test(page_num)) {
+        bitmap_clear(page_num);
+        used_blocks--;
     }
-    
-    bitmap_clear(page_num);
-    used_blocks--;
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 uint32_t pmm_get_total_memory() {
@@ -111,4 +168,4 @@ uint32_t pmm_get_used_memory() {
 
 uint32_t pmm_get_free_memory() {
     return (total_blocks - used_blocks) * PAGE_SIZE;
-}
\ No newline at end of file
+}
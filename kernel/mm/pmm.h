@@ -7,6 +7,10 @@
 #define PAGE_SIZE 4096
 #define BITMAP_SIZE (128 * 1024)
 
+// Memory above this is not identity-mapped (it is user address space,
+// see USER_BASE) and is left unused
+#define PMM_MEMORY_LIMIT 0x40000000
+
 extern uint32_t* memory_bitmap;
 extern uint32_t total_blocks;
 extern uint32_t total_memory;
@@ -14,6 +18,9 @@ extern uint32_t used_blocks;
 
 void pmm_init(multiboot_info_t* mbi, uint32_t kernel_end);
 void* pmm_alloc_page();
+
+// Mark a physical range in use, e.g. memory claimed by the kernel heap
+void pmm_reserve_region(uint32_t start, uint32_t size);
 void pmm_free_page(void* page);
 uint32_t pmm_get_total_memory();
 uint32_t pmm_get_used_memory();
@@ -0,0 +1,170 @@
+// kernel/mm/uaccess.c - Copying to and from user memory
+//
+// System calls must not trust user pointers, but checking each page
+// before touching it would cost more than the copy. Instead the range is
+// checked once against the user address limits and copied with string
+// instructions; every instruction that may fault on the user side has an
+// entry in the __ex_table section naming a fixup, and the page fault
+// handler resumes there instead of halting. A fault on a page that is
+// merely not present yet is still demand-paged first.
+#include "uaccess.h"
+#include "paging.h"
+#include "../proc/process.h"
+
+// __ex_table entry: a faulting instruction and where to continue
+typedef struct {
+    uint32_t insn;
+    uint32_t fixup;
+} exception_entry_t;
+
+extern const exception_entry_t __start___ex_table[];
+extern const exception_entry_t __stop___ex_table[];
+
+// Kernel processes pass kernel pointers to system calls (the shell's
+// tests); anything running in a user address space, including kernel
+// threads serving it, is held to the user range
+static int range_ok(uint32_t addr, uint32_t n) {
+    thread_t* thread = current_thread;
+    if (!thread || thread->proc->page_dir == paging_get_kernel_directory()) {
+        return 1;
+    }
+    return addr >= USER_BASE && addr <= USER_END && n <= USER_END - addr;
+}
+
+// Copy dwords then the tail bytes. Returns the number of bytes not
+// copied: 0, or what was left when an access faulted.
+static uint32_t copy_user(void* to, const void* from, uint32_t n) {
+    uint32_t left = n >> 2;
+    uint32_t d0, d1;
+    
+    asm volatile("1: rep movsl\n"
+                 "   mov %[tail], %%ecx\n"
+                 "2: rep movsb\n"
+                 "3:\n"
+                 ".pushsection .fixup, \"ax\"\n"
+                 "4: lea (%[tail], %%ecx, 4), %%ecx\n"
+                 "   jmp 3b\n"
+                 ".popsection\n"
+                 ".pushsection __ex_table, \"a\"\n"
+                 "   .long 1b, 4b\n"
+                 "   .long 2b, 3b\n"
+                 ".popsection\n"
+                 : "+c"(left), "=&D"(d0), "=&S"(d1)
+                 : [tail] "r"(n & 3), "1"(to), "2"(from)
+                 : "memory");
+    return left;
+}
+
+int copy_from_user(void* to, const void* from, uint32_t n) {
+    if (!range_ok((uint32_t)from, n) || copy_user(to, from, n)) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+int copy_to_user(void* to, const void* from, uint32_t n) {
+    if (!range_ok((uint32_t)to, n) || copy_user(to, from, n)) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+// Touch the byte at p, for writing without changing it: 0, or -EFAULT
+static int probe_user(const char* p, int write) {
+    int res = 0;
+    if (write) {
+        asm volatile("1: lock addb $0, (%[p])\n"
+                     "2:\n"
+                     ".pushsection .fixup, \"ax\"\n"
+                     "3: mov %[efault], %[res]\n"
+                     "   jmp 2b\n"
+                     ".popsection\n"
+                     ".pushsection __ex_table, \"a\"\n"
+                     "   .long 1b, 3b\n"
+                     ".popsection\n"
+                     : [res] "+r"(res)
+                     : [p] "r"(p), [efault] "i"(-EFAULT)
+                     : "memory");
+    } else {
+        char byte;
+        if (copy_user(&byte, p, 1)) {
+            res = -EFAULT;
+        }
+    }
+    return res;
+}
+
+int user_access_begin(const void* addr, uint32_t n, int write) {
+    uint32_t start = (uint32_t)addr;
+    if (!range_ok(start, n)) {
+        return -EFAULT;
+    }
+    
+    process_t* proc = current_process;
+    mutex_lock(&proc->mm_mutex);
+    if (proc->page_dir == paging_get_kernel_directory()) {
+        return 0;
+    }
+    
+    // One byte of each page, through the fixups like any copy
+    uint32_t end = start + n;
+    for (uint32_t page = start & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        const char* p = page < start ? (const char*)start : (const char*)page;
+        if (probe_user(p, write) < 0) {
+            mutex_unlock(&proc->mm_mutex);
+            return -EFAULT;
+        }
+    }
+    return 0;
+}
+
+void user_access_end(void) {
+    mutex_unlock(&current_process->mm_mutex);
+}
+
+int32_t strncpy_from_user(char* dst, const char* src, uint32_t n) {
+    if (!range_ok((uint32_t)src, 1)) {
+        return -EFAULT;
+    }
+    
+    // Never walk off the end of user space looking for the NUL
+    uint32_t addr = (uint32_t)src;
+    if (addr >= USER_BASE && addr < USER_END && n > USER_END - addr) {
+        n = USER_END - addr;
+    }
+    
+    int32_t res;
+    uint32_t d0, d1;
+    asm volatile("   test %[count], %[count]\n"
+                 "   jz 2f\n"
+                 "0: lodsb\n"
+                 "   stosb\n"
+                 "   test %%al, %%al\n"
+                 "   jz 1f\n"
+                 "   dec %[count]\n"
+                 "   jnz 0b\n"
+                 "1: sub %[count], %[res]\n"
+                 "2:\n"
+                 ".pushsection .fixup, \"ax\"\n"
+                 "3: mov %[efault], %[res]\n"
+                 "   jmp 2b\n"
+                 ".popsection\n"
+                 ".pushsection __ex_table, \"a\"\n"
+                 "   .long 0b, 3b\n"
+                 ".popsection\n"
+                 : [res] "=&r"(res), [count] "+c"(n), "=&S"(d0), "=&D"(d1)
+                 : "0"(n), "2"(src), "3"(dst), [efault] "i"(-EFAULT)
+                 : "eax", "memory");
+    return res;
+}
+
+// The table is short and only searched on a kernel fault, so it is
+// scanned rather than sorted
+uint32_t uaccess_fixup(uint32_t eip) {
+    for (const exception_entry_t* e = __start___ex_table; e < __stop___ex_table; e++) {
+        if (e->insn == eip) {
+            return e->fixup;
+        }
+    }
+    return 0;
+}
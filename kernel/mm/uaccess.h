@@ -0,0 +1,31 @@
+// kernel/mm/uaccess.h - Copying to and from user memory
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include "../../include/types.h"
+#include "../../include/errno.h"
+
+// Copy n bytes between user and kernel memory. Returns 0, or -EFAULT if
+// any part of the user range is outside user space or faults; the
+// destination may then be partly written.
+int copy_from_user(void* to, const void* from, uint32_t n);
+int copy_to_user(void* to, const void* from, uint32_t n);
+
+// Let the kernel read (or with write, fill) the user range
+// [addr, addr + n) where it is rather than copy it: faults every page in
+// and holds the process's mm_mutex so none can be unmapped or protected
+// until user_access_end. Returns 0, or -EFAULT (with nothing held) if any
+// page does not allow the access.
+int user_access_begin(const void* addr, uint32_t n, int write);
+void user_access_end(void);
+
+// Copy a NUL-terminated user string of at most n bytes (NUL included).
+// Returns its length, n if no NUL was found within n bytes (dst is then
+// unterminated), or -EFAULT.
+int32_t strncpy_from_user(char* dst, const char* src, uint32_t n);
+
+// Where to resume after a fault at eip inside one of the copies above, 0
+// if eip is not a user access (page fault handler)
+uint32_t uaccess_fixup(uint32_t eip);
+
+#endif // UACCESS_H
@@ -0,0 +1,77 @@
+// kernel/mm/vdso.c - Kernel data mapped read-only into every process
+//
+// getpid or reading the clock needs only a value the kernel already has,
+// so instead of trapping a process reads it from a page mapped into its
+// address space (userspace/lib/vdso.h). The tick count is a single word;
+// the clock parameters are wider than a store, so they are published
+// under a sequence count.
+#include "vdso.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "paging.h"
+#include "../core/monitor.h"
+#include "../drivers/timer/pit.h"
+#include "../drivers/timer/lapic_timer.h"
+#include "../hal/cpu.h"
+#include "../../lib/libc/string.h"
+
+static vdso_data_t* vdso_data = NULL;
+
+static void vdso_write_begin(void) {
+    vdso_data->seq++;
+    asm volatile("" ::: "memory");
+}
+
+static void vdso_write_end(void) {
+    asm volatile("" ::: "memory");
+    vdso_data->seq++;
+}
+
+void vdso_init(void) {
+    vdso_data = (vdso_data_t*)pmm_alloc_page();
+    if (!vdso_data) {
+        print_string("[VDSO] Error: Out of memory\n");
+        return;
+    }
+    memset(vdso_data, 0, PAGE_SIZE);
+    
+    // The TSC is only a clock once its rate is calibrated
+    uint32_t tsc_per_us = lapic_timer_tsc_per_us();
+    
+    vdso_write_begin();
+    vdso_data->hz = TIMER_HZ;
+    vdso_data->ticks = timer_get_ticks();
+    if (tsc_per_us) {
+        vdso_data->clock_mult = (1000u << VDSO_CLOCK_SHIFT) / tsc_per_us;
+        vdso_data->clock_base = rdtsc();
+    }
+    vdso_write_end();
+}
+
+void vdso_tick(uint32_t ticks) {
+    if (vdso_data) {
+        vdso_data->ticks = ticks;
+    }
+}
+
+int vdso_map(process_t* proc) {
+    if (!vdso_data) {
+        return -1;
+    }
+    
+    vdso_proc_t* info = (vdso_proc_t*)pmm_alloc_page();
+    if (!info) {
+        return -1;
+    }
+    memset(info, 0, PAGE_SIZE);
+    info->pid = proc->pid;
+    info->created_at = proc->created_at;
+    strncpy(info->name, proc->name, sizeof(info->name) - 1);
+    
+    if (vmm_map_page(proc, VDSO_PROC_ADDR, (uint32_t)info, VMA_READ | VMA_PINNED) < 0) {
+        pmm_free_page(info);
+        return -1;
+    }
+    return vmm_map_page(proc, VDSO_DATA_ADDR, (uint32_t)vdso_data,
+                        VMA_READ | VMA_SHARED | VMA_PINNED);
+}
@@ -0,0 +1,41 @@
+// kernel/mm/vdso.h - Kernel data mapped read-only into every process
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "../../include/types.h"
+#include "../proc/process.h"
+
+// Fixed user addresses, just below the stack (mirrored in
+// userspace/lib/vdso.h)
+#define VDSO_DATA_ADDR  0xBFE00000      // vdso_data_t, shared by all
+#define VDSO_PROC_ADDR  0xBFE01000      // vdso_proc_t, one per process
+
+// Clock: ns = (tsc - clock_base) * clock_mult >> VDSO_CLOCK_SHIFT
+#define VDSO_CLOCK_SHIFT 20
+
+// Global page. Readers retry while seq is odd or changed under them.
+typedef struct {
+    volatile uint32_t seq;
+    volatile uint32_t ticks;        // system_ticks, updated every tick
+    uint32_t hz;                    // Ticks per second
+    uint32_t clock_mult;            // 0: no usable TSC, count ticks instead
+    uint64_t clock_base;            // TSC at time 0
+} vdso_data_t;
+
+// Per-process page, written once at exec
+typedef struct {
+    uint32_t pid;
+    uint32_t created_at;            // Tick the process was started
+    char name[32];
+} vdso_proc_t;
+
+// Allocate the global page and publish the clock; needs the timer
+void vdso_init(void);
+
+// Called by the tick
+void vdso_tick(uint32_t ticks);
+
+// Map both pages into a new process. Returns -1 when out of memory.
+int vdso_map(process_t* proc);
+
+#endif // VDSO_H
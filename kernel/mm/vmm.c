@@ -0,0 +1,830 @@
+// kernel/mm/vmm.c - Virtual memory areas and demand paging of user memory
+//
+// exec only records what a program's address space should contain; pages
+// are allocated and filled when first touched, so start-up cost and memory
+// follow what the program actually uses. Read-only file pages (program
+// text) are kept in a per-file image and mapped into every process running
+// the same binary instead of being copied for each one.
+//
+// The same goes for brk and mmap: they only add VMAs, so reserving a large
+// range costs a VMA, not memory. proc->mm_lock guards a process's VMAs and
+// page tables and is never held while a page is read or zeroed; the fault
+// path works from a copy of the VMA and drops its page if mm_seq moved.
+// munmap and mprotect, serialised by proc->mm_mutex, change the page
+// tables under the lock, then flush the TLBs of every CPU running the
+// process before freeing anything.
+#include "vmm.h"
+#include "pmm.h"
+#include "paging.h"
+#include "heap.h"
+#include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../hal/smp.h"
+#include "../fs/vfs.h"
+#include "../../include/errno.h"
+#include "../../lib/libc/string.h"
+
+static vm_image_t* images = NULL;
+static spinlock_t image_lock = SPINLOCK_INIT;
+
+// Find or create the image of a file and take a reference on it
+static vm_image_t* image_get(fs_node_t* file) {
+    uint32_t flags = spin_lock_irqsave(&image_lock);
+    for (vm_image_t* image = images; image; image = image->next) {
+        if (image->file == file) {
+            image->refs++;
+            spin_unlock_irqrestore(&image_lock, flags);
+            return image;
+        }
+    }
+    spin_unlock_irqrestore(&image_lock, flags);
+    
+    vm_image_t* image = (vm_image_t*)kmalloc(sizeof(vm_image_t));
+    if (!image) {
+        return NULL;
+    }
+    memset(image, 0, sizeof(vm_image_t));
+    image->file = file;
+    image->nr_pages = PAGE_ALIGN_UP(file->length) / PAGE_SIZE;
+    image->refs = 1;
+    
+    if (image->nr_pages) {
+        image->frames = (uint32_t*)kmalloc(image->nr_pages * sizeof(uint32_t));
+        if (!image->frames) {
+            kfree(image);
+            return NULL;
+        }
+        memset(image->frames, 0, image->nr_pages * sizeof(uint32_t));
+    }
+    
+    // Someone may have created it meanwhile
+    flags = spin_lock_irqsave(&image_lock);
+    for (vm_image_t* other = images; other; other = other->next) {
+        if (other->file == file) {
+            other->refs++;
+            spin_unlock_irqrestore(&image_lock, flags);
+            kfree(image->frames);
+            kfree(image);
+            return other;
+        }
+    }
+    image->next = images;
+    images = image;
+    spin_unlock_irqrestore(&image_lock, flags);
+    
+    return image;
+}
+
+static void image_hold(vm_image_t* image) {
+    uint32_t flags = spin_lock_irqsave(&image_lock);
+    image->refs++;
+    spin_unlock_irqrestore(&image_lock, flags);
+}
+
+static void image_put(vm_image_t* image) {
+    uint32_t flags = spin_lock_irqsave(&image_lock);
+    if (--image->refs > 0) {
+        spin_unlock_irqrestore(&image_lock, flags);
+        return;
+    }
+    
+    for (vm_image_t** link = &images; *link; link = &(*link)->next) {
+        if (*link == image) {
+            *link = image->next;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&image_lock, flags);
+    
+    for (uint32_t i = 0; i < image->nr_pages; i++) {
+        if (image->frames[i]) {
+            pmm_free_page((void*)image->frames[i]);
+        }
+    }
+    kfree(image->frames);
+    kfree(image);
+}
+
+// Frame holding page index of the image's file, read in on first use.
+// 0 when out of memory.
+static uint32_t image_page(vm_image_t* image, uint32_t index) {
+    if (index >= image->nr_pages) {
+        return 0;
+    }
+    if (image->frames[index]) {
+        return image->frames[index];
+    }
+    
+    // Read without the lock held; if another CPU got there first, use its
+    // copy
+    uint8_t* page = (uint8_t*)pmm_alloc_page();
+    if (!page) {
+        return 0;
+    }
+    memset(page, 0, PAGE_SIZE);
+    fs_read(image->file, index * PAGE_SIZE, PAGE_SIZE, page);
+    
+    uint32_t flags = spin_lock_irqsave(&image_lock);
+    uint32_t frame = image->frames[index];
+    if (!frame) {
+        frame = (uint32_t)page;
+        image->frames[index] = frame;
+        image->resident++;
+    }
+    spin_unlock_irqrestore(&image_lock, flags);
+    
+    if (frame != (uint32_t)page) {
+        pmm_free_page(page);
+    }
+    return frame;
+}
+
+static int32_t vma_height(vma_t* vma) {
+    return vma ? vma->height : 0;
+}
+
+static void vma_update(vma_t* vma) {
+    int32_t left = vma_height(vma->left);
+    int32_t right = vma_height(vma->right);
+    vma->height = 1 + (left > right ? left : right);
+}
+
+static vma_t* rotate_right(vma_t* vma) {
+    vma_t* left = vma->left;
+    vma->left = left->right;
+    left->right = vma;
+    vma_update(vma);
+    vma_update(left);
+    return left;
+}
+
+static vma_t* rotate_left(vma_t* vma) {
+    vma_t* right = vma->right;
+    vma->right = right->left;
+    right->left = vma;
+    vma_update(vma);
+    vma_update(right);
+    return right;
+}
+
+// Restore the AVL invariant at vma after one of its subtrees changed
+// height by one; returns the subtree's new root
+static vma_t* vma_balance(vma_t* vma) {
+    vma_update(vma);
+    int32_t balance = vma_height(vma->left) - vma_height(vma->right);
+    
+    if (balance > 1) {
+        if (vma_height(vma->left->left) < vma_height(vma->left->right)) {
+            vma->left = rotate_left(vma->left);
+        }
+        return rotate_right(vma);
+    }
+    if (balance < -1) {
+        if (vma_height(vma->right->right) < vma_height(vma->right->left)) {
+            vma->right = rotate_right(vma->right);
+        }
+        return rotate_left(vma);
+    }
+    return vma;
+}
+
+static vma_t* tree_insert(vma_t* root, vma_t* vma) {
+    if (!root) {
+        vma->left = NULL;
+        vma->right = NULL;
+        vma->height = 1;
+        return vma;
+    }
+    if (vma->start < root->start) {
+        root->left = tree_insert(root->left, vma);
+    } else {
+        root->right = tree_insert(root->right, vma);
+    }
+    return vma_balance(root);
+}
+
+static vma_t* tree_remove_min(vma_t* root, vma_t** min) {
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = tree_remove_min(root->left, min);
+    return vma_balance(root);
+}
+
+static vma_t* tree_remove(vma_t* root, vma_t* vma) {
+    if (root == vma) {
+        if (!vma->right) {
+            return vma->left;
+        }
+        vma_t* min;
+        vma_t* right = tree_remove_min(vma->right, &min);
+        min->left = vma->left;
+        min->right = right;
+        return vma_balance(min);
+    }
+    if (vma->start < root->start) {
+        root->left = tree_remove(root->left, vma);
+    } else {
+        root->right = tree_remove(root->right, vma);
+    }
+    return vma_balance(root);
+}
+
+// Last VMA starting at or below addr, NULL if none
+static vma_t* vma_floor(process_t* proc, uint32_t addr) {
+    vma_t* best = NULL;
+    vma_t* vma = proc->vma_root;
+    while (vma) {
+        if (vma->start <= addr) {
+            best = vma;
+            vma = vma->right;
+        } else {
+            vma = vma->left;
+        }
+    }
+    return best;
+}
+
+// Add vma to the tree and the list; mm_lock held
+static void vma_link(process_t* proc, vma_t* vma) {
+    vma_t* prev = vma_floor(proc, vma->start);
+    vma->prev = prev;
+    vma->next = prev ? prev->next : proc->vmas;
+    if (vma->next) {
+        vma->next->prev = vma;
+    }
+    if (prev) {
+        prev->next = vma;
+    } else {
+        proc->vmas = vma;
+    }
+    proc->vma_root = tree_insert(proc->vma_root, vma);
+}
+
+static void vma_unlink(process_t* proc, vma_t* vma) {
+    proc->vma_root = tree_remove(proc->vma_root, vma);
+    if (vma->prev) {
+        vma->prev->next = vma->next;
+    } else {
+        proc->vmas = vma->next;
+    }
+    if (vma->next) {
+        vma->next->prev = vma->prev;
+    }
+}
+
+// Cut vma in two at addr; spare becomes the upper part. mm_lock held.
+static void vma_split(process_t* proc, vma_t* vma, uint32_t addr, vma_t* spare) {
+    *spare = *vma;
+    spare->start = addr;
+    spare->offset = vma->offset + (addr - vma->start);
+    if (!vma->file) {
+        spare->file_end = addr;
+    }
+    if (spare->image) {
+        image_hold(spare->image);
+    }
+    vma->end = addr;
+    vma_link(proc, spare);
+}
+
+// Make start and end VMA boundaries, so every VMA in between lies wholly
+// inside [start, end). Uses up to two spares, setting used ones to NULL.
+static void vma_clip(process_t* proc, uint32_t start, uint32_t end, vma_t** spares) {
+    vma_t* vma = vmm_find(proc, start);
+    if (vma && vma->start < start) {
+        vma_split(proc, vma, start, spares[0]);
+        spares[0] = NULL;
+    }
+    vma = vmm_find(proc, end - 1);
+    if (vma && vma->end > end) {
+        vma_split(proc, vma, end, spares[1]);
+        spares[1] = NULL;
+    }
+}
+
+// First VMA ending above addr, NULL if none
+static vma_t* vma_after(process_t* proc, uint32_t addr) {
+    vma_t* vma = vma_floor(proc, addr);
+    if (!vma) {
+        return proc->vmas;
+    }
+    return vma->end > addr ? vma : vma->next;
+}
+
+// Anonymous VMAs that differ in nothing but their range
+static int vma_mergeable(const vma_t* vma, uint32_t flags) {
+    return !vma->file && !vma->image && vma->flags == flags &&
+           !(flags & (VMA_SHARED | VMA_PINNED));
+}
+
+int vmm_map(process_t* proc, uint32_t start, uint32_t end, uint32_t flags,
+            struct fs_node* file, uint32_t offset, uint32_t file_end) {
+    if ((start | end | offset) & 0xFFF || start >= end ||
+        start < USER_BASE || end > USER_END) {
+        return -1;
+    }
+    
+    vma_t* vma = (vma_t*)kmalloc(sizeof(vma_t));
+    if (!vma) {
+        return -1;
+    }
+    memset(vma, 0, sizeof(vma_t));
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags;
+    vma->file = file;
+    vma->offset = offset;
+    vma->file_end = file ? file_end : start;
+    
+    // Only pages that are pure file contents can be shared; a zero-filled
+    // tail (bss) or a writable page must be private
+    if (file && !(flags & VMA_WRITE) && PAGE_ALIGN_UP(file_end) >= end) {
+        vma->image = image_get(file);
+        if (!vma->image) {
+            kfree(vma);
+            return -1;
+        }
+    }
+    
+    uint32_t irq = spin_lock_irqsave(&proc->mm_lock);
+    vma_t* next = vma_after(proc, start);
+    if (next && next->start < end) {
+        spin_unlock_irqrestore(&proc->mm_lock, irq);
+        if (vma->image) {
+            image_put(vma->image);
+        }
+        kfree(vma);
+        return -1;
+    }
+    
+    // Anonymous memory right after a like mapping just extends it, so a
+    // growing heap stays one VMA
+    vma_t* prev = next ? next->prev : vma_floor(proc, start);
+    if (!file && prev && prev->end == start && vma_mergeable(prev, flags)) {
+        prev->end = end;
+        spin_unlock_irqrestore(&proc->mm_lock, irq);
+        kfree(vma);
+        return 0;
+    }
+    
+    vma_link(proc, vma);
+    spin_unlock_irqrestore(&proc->mm_lock, irq);
+    return 0;
+}
+
+int vmm_map_page(process_t* proc, uint32_t addr, uint32_t frame, uint32_t flags) {
+    if (vmm_map(proc, addr, addr + PAGE_SIZE, flags, NULL, 0, 0) < 0) {
+        return -1;
+    }
+    
+    uint32_t pte = PAGE_PRESENT | PAGE_USER;
+    if (flags & VMA_WRITE) {
+        pte |= PAGE_WRITE;
+    }
+    
+    uint32_t irq = spin_lock_irqsave(&proc->mm_lock);
+    int result = paging_map_user(proc->page_dir, addr, frame, pte);
+    spin_unlock_irqrestore(&proc->mm_lock, irq);
+    return result;
+}
+
+vma_t* vmm_find(process_t* proc, uint32_t addr) {
+    vma_t* vma = vma_floor(proc, addr);
+    return (vma && addr < vma->end) ? vma : NULL;
+}
+
+// Private page: zeroed, then whatever part of it the file backs
+static uint32_t private_page(vma_t* vma, uint32_t page) {
+    uint8_t* frame = (uint8_t*)pmm_alloc_page();
+    if (!frame) {
+        return 0;
+    }
+    memset(frame, 0, PAGE_SIZE);
+    
+    if (vma->file && page < vma->file_end) {
+        uint32_t size = vma->file_end - page;
+        if (size > PAGE_SIZE) {
+            size = PAGE_SIZE;
+        }
+        fs_read(vma->file, vma->offset + (page - vma->start), size, frame);
+    }
+    return (uint32_t)frame;
+}
+
+// Map the page holding addr. Returns 0 once it is mapped (or the mappings
+// changed meanwhile and the access should simply be retried), -EFAULT if
+// no VMA allows the access, -ENOMEM when out of memory.
+static int fault_in(process_t* proc, uint32_t addr, int write) {
+    uint32_t page = PAGE_ALIGN_DOWN(addr);
+    
+    // The page is filled from a copy of the VMA, without the lock
+    uint32_t flags = spin_lock_irqsave(&proc->mm_lock);
+    vma_t* found = vmm_find(proc, addr);
+    if (!found || !(found->flags & VMA_ACCESS) ||
+        (write && !(found->flags & VMA_WRITE))) {
+        spin_unlock_irqrestore(&proc->mm_lock, flags);
+        return -EFAULT;
+    }
+    vma_t vma = *found;
+    uint32_t seq = proc->mm_seq;
+    if (vma.image) {
+        image_hold(vma.image);
+    }
+    spin_unlock_irqrestore(&proc->mm_lock, flags);
+    
+    uint32_t frame;
+    if (vma.image) {
+        frame = image_page(vma.image, (vma.offset + (page - vma.start)) / PAGE_SIZE);
+    } else {
+        frame = private_page(&vma, page);
+    }
+    
+    int result = -ENOMEM;
+    int mapped = 0;
+    if (frame) {
+        uint32_t pte = PAGE_PRESENT | PAGE_USER;
+        if (vma.flags & VMA_WRITE) {
+            pte |= PAGE_WRITE;
+        }
+        
+        // Another thread may have faulted the page in, or an munmap or
+        // mprotect may have run since the copy was taken
+        flags = spin_lock_irqsave(&proc->mm_lock);
+        if (proc->mm_seq != seq || paging_lookup(proc->page_dir, page)) {
+            result = 0;
+        } else if (paging_map_user(proc->page_dir, page, frame, pte) == 0) {
+            result = 0;
+            mapped = 1;
+        }
+        spin_unlock_irqrestore(&proc->mm_lock, flags);
+        
+        if (!mapped && !vma.image) {
+            pmm_free_page((void*)frame);
+        }
+    }
+    
+    if (vma.image) {
+        image_put(vma.image);
+    }
+    return result;
+}
+
+int vmm_handle_fault(uint32_t addr, uint32_t error_code) {
+    page_fault_error_t error;
+    *((uint32_t*)&error) = error_code;
+    
+    thread_t* thread = current_thread;
+    process_t* proc = thread ? thread->proc : NULL;
+    
+    // Not-present faults inside a VMA are demand paging; a present page
+    // only faults on a protection violation
+    if (proc && IS_USER_ADDR(addr) && !error.present) {
+        int result = fault_in(proc, addr, error.write);
+        if (result == 0) {
+            return 0;
+        }
+        if (result == -ENOMEM) {
+            print_string("[VMM] Out of memory\n");
+        }
+    }
+    
+    if (!error.user || !proc) {
+        return -1;
+    }
+    
+    print_string("[VMM] ");
+    print_string(proc->name);
+    print_string(" (PID ");
+    print_dec(proc->pid);
+    print_string("): segmentation fault at 0x");
+    print_hex(addr);
+    print_string(error.write ? " (write)\n" : " (read)\n");
+    
+    process_terminate(proc);
+    return -1;
+}
+
+// Page-aligned [addr, addr + len) in the user range, 0 if it is not
+static uint32_t range_end(uint32_t addr, uint32_t len) {
+    uint32_t end = PAGE_ALIGN_UP(addr + len);
+    if ((addr & 0xFFF) || !len || end <= addr || addr < USER_BASE || end > USER_END) {
+        return 0;
+    }
+    return end;
+}
+
+static int alloc_spares(vma_t** spares) {
+    spares[0] = (vma_t*)kmalloc(sizeof(vma_t));
+    spares[1] = (vma_t*)kmalloc(sizeof(vma_t));
+    return (spares[0] && spares[1]) ? 0 : -ENOMEM;
+}
+
+static void free_spares(vma_t** spares) {
+    kfree(spares[0]);
+    kfree(spares[1]);
+}
+
+// Make the page table changes just made to [start, end) visible on every
+// CPU; called without mm_lock
+static void vmm_flush(process_t* proc, uint32_t start, uint32_t end) {
+    paging_flush_user(proc->page_dir, start, end);
+    smp_flush_tlb(proc->page_dir);
+}
+
+// munmap with proc->mm_mutex held. Fails on VMAs with any of the refuse
+// flags (VMA_PINNED for anything user space asked for).
+static int unmap_locked(process_t* proc, uint32_t start, uint32_t end, uint32_t refuse) {
+    vma_t* spares[2];
+    if (alloc_spares(spares) < 0) {
+        free_spares(spares);
+        return -ENOMEM;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&proc->mm_lock);
+    for (vma_t* vma = vma_after(proc, start); vma && vma->start < end; vma = vma->next) {
+        if (vma->flags & refuse) {
+            spin_unlock_irqrestore(&proc->mm_lock, flags);
+            free_spares(spares);
+            return -EINVAL;
+        }
+    }
+    
+    // Take the VMAs out, so nothing faults the range back in, and make its
+    // pages unreachable. The frames stay in the PTEs until every CPU has
+    // flushed them from its TLB.
+    vma_clip(proc, start, end, spares);
+    vma_t* gone = NULL;
+    vma_t* vma = vma_after(proc, start);
+    while (vma && vma->start < end) {
+        vma_t* next = vma->next;
+        vma_unlink(proc, vma);
+        vma->next = gone;
+        gone = vma;
+        vma = next;
+    }
+    paging_update_user(proc->page_dir, start, end, PAGE_PRESENT, 0);
+    proc->mm_seq++;
+    if (end > proc->mmap_cache) {
+        proc->mmap_cache = end;
+    }
+    spin_unlock_irqrestore(&proc->mm_lock, flags);
+    
+    vmm_flush(proc, start, end);
+    
+    flags = spin_lock_irqsave(&proc->mm_lock);
+    for (vma = gone; vma; vma = vma->next) {
+        int owned = !vma->image && !(vma->flags & VMA_SHARED);
+        paging_release_user(proc->page_dir, vma->start, vma->end, owned);
+    }
+    spin_unlock_irqrestore(&proc->mm_lock, flags);
+    
+    while (gone) {
+        vma = gone;
+        gone = vma->next;
+        if (vma->image) {
+            image_put(vma->image);
+        }
+        kfree(vma);
+    }
+    free_spares(spares);
+    return 0;
+}
+
+// Highest free range of len bytes between floor and top, 0 if none.
+// mm_lock held.
+static uint32_t find_gap(process_t* proc, uint32_t len, uint32_t floor, uint32_t top) {
+    vma_t* vma = vma_floor(proc, top - 1);
+    while (top >= floor + len) {
+        if (!vma || vma->end <= top - len) {
+            return top - len;
+        }
+        top = vma->start;
+        vma = vma->prev;
+    }
+    return 0;
+}
+
+// Free address for an mmap of len bytes: the hint if that range is free,
+// else below the last one handed out, else anywhere above the heap
+static uint32_t mmap_place(process_t* proc, uint32_t hint, uint32_t len) {
+    uint32_t floor = proc->brk ? PAGE_ALIGN_UP(proc->brk) : USER_BASE;
+    if (floor + len > USER_MMAP_TOP) {
+        return 0;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&proc->mm_lock);
+    uint32_t addr = 0;
+    if (hint >= floor && hint <= USER_MMAP_TOP - len) {
+        vma_t* next = vma_after(proc, hint);
+        if (!next || next->start >= hint + len) {
+            addr = hint;
+        }
+    }
+    if (!addr && proc->mmap_cache && proc->mmap_cache < USER_MMAP_TOP) {
+        addr = find_gap(proc, len, floor, proc->mmap_cache);
+    }
+    if (!addr) {
+        addr = find_gap(proc, len, floor, USER_MMAP_TOP);
+    }
+    spin_unlock_irqrestore(&proc->mm_lock, flags);
+    return addr;
+}
+
+int vmm_mmap(process_t* proc, uint32_t* addr, uint32_t len, uint32_t prot, int fixed) {
+    if (proc->page_dir == paging_get_kernel_directory() || (prot & ~VMA_ACCESS) ||
+        !len || len > USER_END - USER_BASE) {
+        return -EINVAL;
+    }
+    len = PAGE_ALIGN_UP(len);
+    
+    uint32_t start = *addr;
+    if (fixed && !range_end(start, len)) {
+        return -EINVAL;
+    }
+    
+    mutex_lock(&proc->mm_mutex);
+    int result = 0;
+    if (fixed) {
+        result = unmap_locked(proc, start, start + len, VMA_PINNED);
+    } else {
+        start = mmap_place(proc, PAGE_ALIGN_DOWN(start), len);
+        if (!start) {
+            result = -ENOMEM;
+        }
+    }
+    if (result == 0 && vmm_map(proc, start, start + len, prot, NULL, 0, 0) < 0) {
+        result = -ENOMEM;
+    }
+    if (result == 0 && !fixed) {
+        proc->mmap_cache = start;
+    }
+    mutex_unlock(&proc->mm_mutex);
+    
+    if (result == 0) {
+        *addr = start;
+    }
+    return result;
+}
+
+int vmm_munmap(process_t* proc, uint32_t addr, uint32_t len) {
+    uint32_t end = range_end(addr, len);
+    if (!end || proc->page_dir == paging_get_kernel_directory()) {
+        return -EINVAL;
+    }
+    
+    mutex_lock(&proc->mm_mutex);
+    int result = unmap_locked(proc, addr, end, VMA_PINNED);
+    mutex_unlock(&proc->mm_mutex);
+    return result;
+}
+
+int vmm_unmap_pinned(process_t* proc, uint32_t addr, uint32_t len) {
+    uint32_t end = range_end(addr, len);
+    if (!end || proc->page_dir == paging_get_kernel_directory()) {
+        return -EINVAL;
+    }
+    
+    mutex_lock(&proc->mm_mutex);
+    int result = unmap_locked(proc, addr, end, 0);
+    mutex_unlock(&proc->mm_mutex);
+    return result;
+}
+
+int vmm_mprotect(process_t* proc, uint32_t addr, uint32_t len, uint32_t prot) {
+    uint32_t end = range_end(addr, len);
+    if (!end || (prot & ~VMA_ACCESS) || proc->page_dir == paging_get_kernel_directory()) {
+        return -EINVAL;
+    }
+    
+    vma_t* spares[2];
+    if (alloc_spares(spares) < 0) {
+        free_spares(spares);
+        return -ENOMEM;
+    }
+    
+    mutex_lock(&proc->mm_mutex);
+    uint32_t flags = spin_lock_irqsave(&proc->mm_lock);
+    
+    // The whole range must be mapped. Shared file pages are never made
+    // writable: there is no copy-on-write to give the process its own.
+    int result = 0;
+    uint32_t at = addr;
+    for (vma_t* vma = vmm_find(proc, addr); at < end; vma = vma->next) {
+        if (!vma || vma->start > at) {
+            result = -ENOMEM;
+            break;
+        }
+        if (vma->flags & (VMA_PINNED | VMA_SHARED)) {
+            result = -EINVAL;
+            break;
+        }
+        if ((prot & VMA_WRITE) && vma->image) {
+            result = -EACCES;
+            break;
+        }
+        at = vma->end;
+    }
+    
+    if (result == 0) {
+        vma_clip(proc, addr, end, spares);
+        for (vma_t* vma = vmm_find(proc, addr); vma && vma->start < end; vma = vma->next) {
+            vma->flags = (vma->flags & ~VMA_ACCESS) | prot;
+        }
+        
+        // Pages of a PROT_NONE range keep their frame in a non-present
+        // PTE; the fault path never maps over it since no access is allowed
+        uint32_t set = 0;
+        if (prot) {
+            set |= PAGE_PRESENT;
+        }
+        if (prot & VMA_WRITE) {
+            set |= PAGE_WRITE;
+        }
+        paging_update_user(proc->page_dir, addr, end, PAGE_PRESENT | PAGE_WRITE, set);
+        proc->mm_seq++;
+    }
+    spin_unlock_irqrestore(&proc->mm_lock, flags);
+    
+    if (result == 0) {
+        vmm_flush(proc, addr, end);
+    }
+    mutex_unlock(&proc->mm_mutex);
+    free_spares(spares);
+    return result;
+}
+
+uint32_t vmm_brk(process_t* proc, uint32_t addr) {
+    if (proc->page_dir == paging_get_kernel_directory()) {
+        return 0;
+    }
+    
+    mutex_lock(&proc->mm_mutex);
+    uint32_t old_end = PAGE_ALIGN_UP(proc->brk);
+    uint32_t new_end = PAGE_ALIGN_UP(addr);
+    
+    if (addr >= proc->brk_start && addr <= USER_MMAP_TOP) {
+        int result = 0;
+        if (new_end > old_end) {
+            result = vmm_map(proc, old_end, new_end, VMA_READ | VMA_WRITE, NULL, 0, 0);
+        } else if (new_end < old_end) {
+            result = unmap_locked(proc, new_end, old_end, VMA_PINNED);
+        }
+        if (result == 0) {
+            proc->brk = addr;
+        }
+    }
+    
+    addr = proc->brk;
+    mutex_unlock(&proc->mm_mutex);
+    return addr;
+}
+
+void vmm_exit(process_t* proc) {
+    page_directory_t* dir = proc->page_dir;
+    if (dir == paging_get_kernel_directory()) {
+        return;
+    }
+    
+    vma_t* vma = proc->vmas;
+    proc->vmas = NULL;
+    proc->vma_root = NULL;
+    
+    while (vma) {
+        vma_t* next = vma->next;
+        
+        // Shared pages belong to the image or their owner
+        int owned = !vma->image && !(vma->flags & VMA_SHARED);
+        paging_release_user(dir, vma->start, vma->end, owned);
+        if (vma->image) {
+            image_put(vma->image);
+        }
+        
+        kfree(vma);
+        vma = next;
+    }
+    
+    proc->page_dir = paging_get_kernel_directory();
+    paging_destroy_directory(dir);
+}
+
+void vmm_image_list(void) {
+    uint32_t flags = spin_lock_irqsave(&image_lock);
+    for (vm_image_t* image = images; image; image = image->next) {
+        fs_node_t* file = image->file;
+        
+        print_string("  ");
+        print_string(file->name);
+        for (int j = strlen(file->name); j < 16; j++) {
+            print_char(' ');
+        }
+        print_dec(image->resident * (PAGE_SIZE / 1024));
+        print_string(" of ");
+        print_dec(image->nr_pages * (PAGE_SIZE / 1024));
+        print_string(" KB resident, ");
+        print_dec(image->refs);
+        print_string(" mappings\n");
+    }
+    spin_unlock_irqrestore(&image_lock, flags);
+}
@@ -0,0 +1,102 @@
+// kernel/mm/vmm.h - Virtual memory areas and demand paging of user memory
+#ifndef VMM_H
+#define VMM_H
+
+#include "../../include/types.h"
+#include "../proc/process.h"
+
+struct fs_node;
+
+// VMA protection
+#define VMA_READ    0x01
+#define VMA_WRITE   0x02
+#define VMA_EXEC    0x04
+#define VMA_SHARED  0x08    // Pages belong to someone else and are not freed
+#define VMA_PINNED  0x10    // Kernel-managed: munmap and mprotect refuse it
+#define VMA_ACCESS  (VMA_READ | VMA_WRITE | VMA_EXEC)
+
+// Stack of a new program, ending at USER_END. Only the pages it touches
+// are ever allocated.
+#define USER_STACK_SIZE 0x00100000
+
+// mmap hands out addresses downwards from here, towards the heap; the
+// ring, vDSO and stack sit above
+#define USER_MMAP_TOP   0xBFC00000
+
+// Pages of a file mapped read-only, shared by every process that maps the
+// same file. The frames belong to the image and go with its last user.
+typedef struct vm_image {
+    struct fs_node* file;
+    uint32_t nr_pages;
+    uint32_t* frames;           // Per file page, 0 until first faulted in
+    uint32_t resident;          // Frames filled in
+    uint32_t refs;              // VMAs using the image
+    struct vm_image* next;
+} vm_image_t;
+
+// A page-aligned range of a process's address space. Nothing is mapped
+// up front; each page is filled in on its first fault. A process's VMAs
+// are kept both in an AVL tree keyed by start, for lookups, and in an
+// address-ordered list, for walking neighbours.
+typedef struct vma {
+    uint32_t start;
+    uint32_t end;
+    uint32_t flags;             // VMA_*
+    struct fs_node* file;       // Backing file, NULL for zero-filled memory
+    uint32_t offset;            // File offset of start, page aligned
+    uint32_t file_end;          // File data stops here; zero-filled beyond
+    vm_image_t* image;          // Shared pages of a read-only file mapping
+    struct vma* left;           // Tree
+    struct vma* right;
+    int32_t height;
+    struct vma* prev;           // List
+    struct vma* next;
+} vma_t;
+
+// Add [start, end) to proc's address space, backed by file from offset
+// up to file_end (file may be NULL). Read-only file mappings share their
+// pages through the file's image. Returns -1 on a bad or overlapping range.
+int vmm_map(process_t* proc, uint32_t start, uint32_t end, uint32_t flags,
+            struct fs_node* file, uint32_t offset, uint32_t file_end);
+
+// Map frame at addr right away, as a one-page VMA. Unless flags has
+// VMA_SHARED the frame is the process's and goes with it.
+int vmm_map_page(process_t* proc, uint32_t addr, uint32_t frame, uint32_t flags);
+
+// VMA containing addr, NULL if none. The caller holds proc->mm_lock or
+// otherwise keeps the mappings from changing.
+vma_t* vmm_find(process_t* proc, uint32_t addr);
+
+// Anonymous zero-filled mapping of len bytes with VMA_* access prot (0
+// reserves address space). With fixed the mapping goes exactly at *addr,
+// replacing what was there; otherwise *addr is a hint and the chosen
+// address is stored back. Returns 0 or -errno.
+int vmm_mmap(process_t* proc, uint32_t* addr, uint32_t len, uint32_t prot, int fixed);
+
+// Remove [addr, addr + len) from proc's mappings and free the pages
+// behind it. Returns 0 or -errno.
+int vmm_munmap(process_t* proc, uint32_t addr, uint32_t len);
+
+// The same for the kernel's own VMA_PINNED mappings, which vmm_munmap
+// refuses: undoing a setup that failed half way
+int vmm_unmap_pinned(process_t* proc, uint32_t addr, uint32_t len);
+
+// Change the access of every page in [addr, addr + len), which must be
+// fully mapped. Returns 0 or -errno.
+int vmm_mprotect(process_t* proc, uint32_t addr, uint32_t len, uint32_t prot);
+
+// Move the end of the heap to addr, or just report it for 0. Returns the
+// new end, or the old one if the heap cannot move there.
+uint32_t vmm_brk(process_t* proc, uint32_t addr);
+
+// Page fault on a user address or from ring 3. Returns 0 once the page is
+// mapped; kills the process on a bad user access, -1 for the kernel's.
+int vmm_handle_fault(uint32_t addr, uint32_t error_code);
+
+// Drop every mapping of proc and free its page directory
+void vmm_exit(process_t* proc);
+
+// Print the shared images (shell meminfo)
+void vmm_image_list(void);
+
+#endif // VMM_H
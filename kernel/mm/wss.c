@@ -0,0 +1,85 @@
+// kernel/mm/wss.c - Working-set size estimation
+//
+// Every WSS_SCAN_INTERVAL ticks the accessed bits of each process's user
+// pages are sampled and cleared. The number of pages referenced during the
+// interval is folded into an exponentially decayed average, so a task that
+// stops touching memory sees its working set shrink over a few scans.
+// Unreferenced pages age in the PTE available bits (see paging_get_idle_age),
+// which lets reclaim pick pages that have really gone idle.
+#include "wss.h"
+#include "paging.h"
+
+static uint32_t next_scan = WSS_SCAN_INTERVAL;
+
+// Distinct page directories sampled per scan. Kernel tasks all share one;
+// a process whose directory does not fit keeps its previous estimate.
+#define WSS_MAX_DIRS 32
+
+typedef struct {
+    page_directory_t* dirs[WSS_MAX_DIRS];
+    uint32_t referenced[WSS_MAX_DIRS];
+    uint32_t mapped[WSS_MAX_DIRS];
+    int count;
+} wss_scan_t;
+
+static void wss_scan_one(process_t* proc, void* arg) {
+    wss_scan_t* scan = (wss_scan_t*)arg;
+    
+    if (!proc->page_dir || proc->exiting) {
+        return;
+    }
+    
+    // Processes sharing a directory must see the same sample, scanning
+    // it twice would clear the bits before the second reader
+    int slot = -1;
+    for (int j = 0; j < scan->count; j++) {
+        if (scan->dirs[j] == proc->page_dir) {
+            slot = j;
+            break;
+        }
+    }
+    
+    if (slot < 0) {
+        if (scan->count >= WSS_MAX_DIRS) {
+            return;
+        }
+        slot = scan->count++;
+        scan->dirs[slot] = proc->page_dir;
+        
+        // Unmapping and mprotect rewrite the same entries under mm_lock
+        uint32_t flags = spin_lock_irqsave(&proc->mm_lock);
+        scan->referenced[slot] = paging_scan_accessed(proc->page_dir, &scan->mapped[slot]);
+        spin_unlock_irqrestore(&proc->mm_lock, flags);
+    }
+    
+    proc->wss_last = scan->referenced[slot];
+    proc->rss_pages = scan->mapped[slot];
+    proc->wss_avg = (proc->wss_avg * ((1 << WSS_DECAY_SHIFT) - 1) +
+                     (scan->referenced[slot] << WSS_SHIFT)) >> WSS_DECAY_SHIFT;
+}
+
+void wss_scan(void) {
+    wss_scan_t scan;
+    scan.count = 0;
+    process_for_each(wss_scan_one, &scan);
+}
+
+void wss_tick(uint32_t ticks) {
+    // Ticks may be skipped while idle, so compare rather than test for
+    // an exact multiple
+    if ((int32_t)(ticks - next_scan) >= 0) {
+        next_scan = ticks + WSS_SCAN_INTERVAL;
+        wss_scan();
+    }
+}
+
+uint32_t wss_next_scan(void) {
+    return next_scan;
+}
+
+uint32_t wss_pages(process_t* proc) {
+    if (!proc) return 0;
+    
+    // Round to nearest page
+    return (proc->wss_avg + (1 << (WSS_SHIFT - 1))) >> WSS_SHIFT;
+}
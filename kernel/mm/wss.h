@@ -0,0 +1,30 @@
+// kernel/mm/wss.h - Working-set size estimation
+#ifndef WSS_H
+#define WSS_H
+
+#include "../../include/types.h"
+#include "../proc/process.h"
+#include "../drivers/timer/pit.h"
+
+// Scan period in timer ticks (1s)
+#define WSS_SCAN_INTERVAL TIMER_HZ
+
+// process_t.wss_avg is fixed point with WSS_SHIFT fraction bits
+#define WSS_SHIFT 8
+
+// Weight of the newest sample is 1 / (1 << WSS_DECAY_SHIFT)
+#define WSS_DECAY_SHIFT 2
+
+// Sample accessed bits of every process and update its working set
+void wss_scan(void);
+
+// Called from the timer interrupt, scans every WSS_SCAN_INTERVAL ticks
+void wss_tick(uint32_t ticks);
+
+// Tick of the next scheduled scan
+uint32_t wss_next_scan(void);
+
+// Decayed working set of a process, in pages
+uint32_t wss_pages(process_t* proc);
+
+#endif // WSS_H
@@ -0,0 +1,147 @@
+// kernel/proc/exec.c - Start programs from ELF32 executables
+//
+// Loading only parses the headers: every PT_LOAD segment becomes a VMA
+// backed by the file and the fault handler reads pages in on first use
+// (see mm/vmm.c). Nothing is copied up front, so a large binary that
+// runs a few pages of code starts as fast as a small one.
+#include "exec.h"
+#include "process.h"
+#include "thread.h"
+#include "../mm/vmm.h"
+#include "../mm/vdso.h"
+#include "../mm/heap.h"
+#include "../fs/vfs.h"
+#include "../core/monitor.h"
+#include "../../include/elf.h"
+#include "../../lib/libc/string.h"
+
+static int elf_check(const elf32_ehdr_t* eh) {
+    if (*(const uint32_t*)eh->e_ident != ELF_MAGIC ||
+        eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+        eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+        eh->e_ident[EI_VERSION] != EV_CURRENT) {
+        return -1;
+    }
+    if (eh->e_type != ET_EXEC || eh->e_machine != EM_386 ||
+        eh->e_phentsize != sizeof(elf32_phdr_t) ||
+        eh->e_phnum == 0 || eh->e_phnum > EXEC_MAX_PHDRS) {
+        return -1;
+    }
+    return IS_USER_ADDR(eh->e_entry) ? 0 : -1;
+}
+
+// Turn one PT_LOAD segment into a VMA. The file offset and address of a
+// segment must agree modulo the page size so pages map straight onto
+// file pages.
+static int elf_map_segment(process_t* proc, fs_node_t* file, const elf32_phdr_t* ph) {
+    if (ph->p_memsz == 0) {
+        return 0;
+    }
+    if (ph->p_filesz > ph->p_memsz ||
+        ph->p_offset + ph->p_filesz < ph->p_offset ||
+        ph->p_offset + ph->p_filesz > file->length ||
+        ph->p_vaddr + ph->p_memsz < ph->p_vaddr ||
+        (ph->p_vaddr & 0xFFF) != (ph->p_offset & 0xFFF)) {
+        return -1;
+    }
+    
+    uint32_t start = PAGE_ALIGN_DOWN(ph->p_vaddr);
+    uint32_t end = PAGE_ALIGN_UP(ph->p_vaddr + ph->p_memsz);
+    uint32_t offset = ph->p_offset - (ph->p_vaddr - start);
+    
+    uint32_t flags = 0;
+    if (ph->p_flags & PF_R) flags |= VMA_READ;
+    if (ph->p_flags & PF_W) flags |= VMA_WRITE;
+    if (ph->p_flags & PF_X) flags |= VMA_EXEC;
+    
+    return vmm_map(proc, start, end, flags, ph->p_filesz ? file : NULL,
+                   offset, ph->p_vaddr + ph->p_filesz);
+}
+
+static void exec_error(const char* path, const char* msg) {
+    print_string("[EXEC] ");
+    print_string(path);
+    print_string(": ");
+    print_string(msg);
+    print_string("\n");
+}
+
+int32_t process_exec(const char* path) {
+    fs_node_t* file = fs_lookup(path);
+    if (!file || !(file->flags & FS_FILE)) {
+        exec_error(path, "not found");
+        return -1;
+    }
+    
+    elf32_ehdr_t eh;
+    if (fs_read(file, 0, sizeof(eh), (uint8_t*)&eh) != sizeof(eh) || elf_check(&eh) < 0) {
+        exec_error(path, "not an i386 ELF executable");
+        return -1;
+    }
+    
+    elf32_phdr_t phdrs[EXEC_MAX_PHDRS];
+    uint32_t size = eh.e_phnum * sizeof(elf32_phdr_t);
+    if (fs_read(file, eh.e_phoff, size, (uint8_t*)phdrs) != size) {
+        exec_error(path, "truncated program headers");
+        return -1;
+    }
+    
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' && p[1]) name = p + 1;
+    }
+    
+    process_t* proc = process_create_user(name);
+    if (!proc) {
+        return -1;
+    }
+    
+    uint32_t image_end = USER_BASE;
+    for (uint32_t i = 0; i < eh.e_phnum; i++) {
+        if (phdrs[i].p_type == PT_INTERP) {
+            exec_error(path, "dynamically linked");
+            process_discard(proc);
+            return -1;
+        }
+        if (phdrs[i].p_type == PT_LOAD && elf_map_segment(proc, file, &phdrs[i]) < 0) {
+            exec_error(path, "bad or overlapping segment");
+            process_discard(proc);
+            return -1;
+        }
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_memsz &&
+            PAGE_ALIGN_UP(phdrs[i].p_vaddr + phdrs[i].p_memsz) > image_end) {
+            image_end = PAGE_ALIGN_UP(phdrs[i].p_vaddr + phdrs[i].p_memsz);
+        }
+    }
+    
+    // The heap starts empty right after the highest segment
+    proc->brk_start = image_end;
+    proc->brk = image_end;
+    
+    if (vmm_map(proc, USER_END - USER_STACK_SIZE, USER_END, VMA_READ | VMA_WRITE,
+                NULL, 0, 0) < 0) {
+        exec_error(path, "stack overlaps a segment");
+        process_discard(proc);
+        return -1;
+    }
+    
+    if (vdso_map(proc) < 0) {
+        exec_error(path, "cannot map the vDSO");
+        process_discard(proc);
+        return -1;
+    }
+    
+    // Once its thread runs the process may exit at any time
+    int32_t pid = (int32_t)proc->pid;
+    print_string("[PROC] Created process: ");
+    print_string(proc->name);
+    print_string(" (PID ");
+    print_dec(proc->pid);
+    print_string(")\n");
+    
+    if (!thread_create_user(proc, eh.e_entry, USER_END, 0, 0)) {
+        process_discard(proc);
+        return -1;
+    }
+    return pid;
+}
@@ -0,0 +1,16 @@
+// kernel/proc/exec.h - Start programs from ELF32 executables
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "../../include/types.h"
+
+// Program headers read per executable
+#define EXEC_MAX_PHDRS 16
+
+// Start the executable at path (resolved from fs_root) in a new process.
+// Its segments are mapped, not read: pages come in as they are touched.
+// Returns the new PID, or -1 if the file is missing or not a static i386
+// executable.
+int32_t process_exec(const char* path);
+
+#endif // EXEC_H
@@ -0,0 +1,155 @@
+// kernel/thread/fpu.c - Lazy FPU/SSE context switching
+//
+// FPU registers are not part of the normal context switch. The scheduler
+// sets CR0.TS whenever it switches to a thread that does not own the FPU;
+// the first FPU/SSE instruction then raises #NM (ISR 7), which saves the
+// previous owner's state and restores (or initializes) the current thread's.
+// Tasks that never touch the FPU never pay for a save or restore.
+//
+// Each CPU tracks its own owner. With more than one CPU online a thread may
+// be picked up elsewhere, so its state is saved when it is switched out
+// instead of being left in a register file another CPU cannot reach.
+#include "fpu.h"
+#include "../hal/cpu.h"
+#include "../hal/smp.h"
+#include "../core/monitor.h"
+#include "../mm/heap.h"
+#include "../../lib/libc/string.h"
+
+static int fpu_use_fxsr = 0;
+
+static void fpu_save(thread_t* thread) {
+    if (fpu_use_fxsr) {
+        asm volatile("fxsave (%0)" :: "r"(thread->fpu_state) : "memory");
+    } else {
+        asm volatile("fnsave (%0)" :: "r"(thread->fpu_state) : "memory");
+    }
+}
+
+static void fpu_restore(thread_t* thread) {
+    if (fpu_use_fxsr) {
+        asm volatile("fxrstor (%0)" :: "r"(thread->fpu_state) : "memory");
+    } else {
+        asm volatile("frstor (%0)" :: "r"(thread->fpu_state) : "memory");
+    }
+}
+
+// Device Not Available: first FPU use since the last context switch
+static void fpu_nm_handler(registers_t* regs) {
+    (void)regs;
+    
+    clts();
+    
+    cpu_t* cpu = cpu_current();
+    thread_t* current = cpu->current;
+    if (!current || cpu->fpu_owner == current) {
+        return;
+    }
+    
+    if (cpu->fpu_owner) {
+        fpu_save(cpu->fpu_owner);
+    }
+    
+    if (current->fpu_state) {
+        fpu_restore(current);
+    } else {
+        void* raw = kmalloc(FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+        if (!raw) {
+            print_string("[FPU] Error: Failed to allocate FPU state\n");
+            for(;;) asm("cli; hlt");
+        }
+        
+        current->fpu_alloc = raw;
+        current->fpu_state = (uint8_t*)(((uint32_t)raw + FPU_STATE_ALIGN - 1) &
+                                        ~(FPU_STATE_ALIGN - 1));
+        memset(current->fpu_state, 0, FPU_STATE_SIZE);
+        
+        // Fresh thread: default control words
+        asm volatile("fninit");
+        if (fpu_use_fxsr) {
+            uint32_t mxcsr = 0x1F80;
+            asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+        }
+    }
+    
+    cpu->fpu_owner = current;
+}
+
+// Per-CPU control register setup, run by the BSP and every AP
+void fpu_init_cpu(void) {
+    if (!cpu_has_feature(CPUID_EDX_FPU)) {
+        return;
+    }
+    
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+    
+    if (cpu_has_feature(CPUID_EDX_FXSR)) {
+        uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+        if (cpu_has_feature(CPUID_EDX_SSE)) {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        write_cr4(cr4);
+        fpu_use_fxsr = 1;
+    }
+    
+    asm volatile("fninit");
+    
+    // Nobody owns the FPU yet, trap on first use
+    stts();
+}
+
+void fpu_init(void) {
+    cpu_init();
+    
+    if (!cpu_has_feature(CPUID_EDX_FPU)) {
+        print_string(" [no FPU]");
+        return;
+    }
+    
+    fpu_init_cpu();
+    isr_register_handler(7, fpu_nm_handler);
+    
+    if (cpu_has_feature(CPUID_EDX_SSE2)) {
+        print_string(" [SSE2]");
+    } else if (cpu_has_feature(CPUID_EDX_SSE)) {
+        print_string(" [SSE]");
+    } else {
+        print_string(" [x87]");
+    }
+}
+
+void fpu_switch(thread_t* prev, thread_t* next) {
+    cpu_t* cpu = cpu_current();
+    
+    if (cpu_count > 1 && prev && cpu->fpu_owner == prev) {
+        // prev may migrate: write its state back now (TS is clear while
+        // the owner runs, so this cannot fault)
+        fpu_save(prev);
+        cpu->fpu_owner = NULL;
+    }
+    
+    if (next == cpu->fpu_owner) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+void fpu_release(thread_t* thread) {
+    if (!thread) return;
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (cpus[i].fpu_owner == thread) {
+            cpus[i].fpu_owner = NULL;
+        }
+    }
+    
+    if (thread->fpu_alloc) {
+        kfree(thread->fpu_alloc);
+        thread->fpu_alloc = NULL;
+        thread->fpu_state = NULL;
+    }
+}
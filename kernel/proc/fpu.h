@@ -0,0 +1,23 @@
+// kernel/thread/fpu.h - Lazy FPU/SSE context switching
+#ifndef FPU_H
+#define FPU_H
+
+#include "thread.h"
+
+// FXSAVE image size and required alignment
+#define FPU_STATE_SIZE  512
+#define FPU_STATE_ALIGN 16
+
+// Enable x87/SSE and install the #NM handler
+void fpu_init(void);
+
+// Enable x87/SSE on the calling CPU (application processors)
+void fpu_init_cpu(void);
+
+// Called by the scheduler before switching from prev to next
+void fpu_switch(thread_t* prev, thread_t* next);
+
+// Forget and free a thread's FPU state
+void fpu_release(thread_t* thread);
+
+#endif // FPU_H
@@ -1,78 +1,193 @@
 #include "process.h"
 #include "../core/monitor.h"
 #include "../mm/heap.h"
+#include "../mm/paging.h"
+#include "../mm/vmm.h"
+#include "../mm/wss.h"
+#include "../fs/file.h"
+#include "../syscall/ring.h"
+#include "../syscall/trace.h"
 #include "../drivers/timer/pit.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "../core/spinlock.h"
 #include "../../lib/libc/string.h"
+#include "../../lib/libk/bitmap.h"
 
-#define KERNEL_STACK_SIZE 4096
+// PIDs come from a bitmap searched cyclically from the last one handed
+// out, so IDs are not reused straight away and the search normally stops
+// in the first word. Lookup goes through a hash on the PID and iteration
+// through a list of every process, so nothing is bounded by a table size.
+static uint32_t pid_map[BITMAP_WORDS(PID_MAX)];
+static uint32_t last_pid = PID_MAX - 1;
+static spinlock_t pid_lock = SPINLOCK_INIT;
+static hash_node_t* pid_buckets[1 << PID_HASH_BITS];
+static hashtable_t pid_hash;
+static process_t* task_list = NULL;
+static process_t* task_tail = NULL;
+static uint32_t task_count = 0;
 
-process_t* process_table[MAX_PROCESSES];
-static uint32_t next_pid = 0;
-process_t* current_process = NULL;
+// Protects the pid hash, the process list and each process's thread list
+static spinlock_t process_lock = SPINLOCK_INIT;
 
-void process_init(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        process_table[i] = NULL;
-    }
+int32_t pid_alloc(void) {
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
     
-    current_process = (process_t*)kmalloc(sizeof(process_t));
-    memset(current_process, 0, sizeof(process_t));
+    uint32_t pid = bitmap_find_next_zero(pid_map, PID_MAX, last_pid + 1);
+    if (pid >= PID_MAX) {
+        pid = bitmap_find_next_zero(pid_map, PID_MAX, 0);
+        if (pid >= PID_MAX) {
+            spin_unlock_irqrestore(&pid_lock, flags);
+            return -1;
+        }
+    }
     
-    current_process->pid = next_pid++;
-    strcpy(current_process->name, "idle");
-    current_process->state = PROCESS_RUNNING;
-    current_process->created_at = timer_get_ticks();
-    current_process->cpu_time = 0;
-    current_process->next = NULL;
+    bitmap_set(pid_map, pid);
+    last_pid = pid;
     
-    process_table[0] = current_process;
+    spin_unlock_irqrestore(&pid_lock, flags);
+    return (int32_t)pid;
 }
 
-process_t* process_create(const char* name, void (*entry_point)(void)) {
-    if (next_pid >= MAX_PROCESSES) {
-        print_string("[PROC] Error: Process table full\n");
-        return NULL;
-    }
-    
+void pid_free(uint32_t pid) {
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    bitmap_clear(pid_map, pid);
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+// Allocate a process with a fresh PID and make it visible to lookup and
+// iteration. It has no threads yet.
+static process_t* process_alloc(const char* name) {
     process_t* proc = (process_t*)kmalloc(sizeof(process_t));
     if (!proc) {
-        print_string("[PROC] Error: Failed to allocate process\n");
         return NULL;
     }
-    
     memset(proc, 0, sizeof(process_t));
     
-    uint32_t* stack = (uint32_t*)kmalloc(KERNEL_STACK_SIZE);
-    if (!stack) {
-        print_string("[PROC] Error: Failed to allocate stack\n");
+    int32_t pid = pid_alloc();
+    if (pid < 0) {
         kfree(proc);
         return NULL;
     }
     
-    proc->pid = next_pid++;
+    proc->pid = (uint32_t)pid;
     strncpy(proc->name, name, 31);
     proc->name[31] = '\0';
-    proc->state = PROCESS_READY;
     proc->created_at = timer_get_ticks();
-    proc->cpu_time = 0;
-    proc->kernel_stack = (uint32_t)stack + KERNEL_STACK_SIZE;
-    
-    memset(&proc->regs, 0, sizeof(registers_t));
-    proc->regs.eip = (uint32_t)entry_point;
-    proc->regs.cs = 0x08;
-    proc->regs.ds = 0x10;
-    proc->regs.eflags = 0x202;
-    proc->regs.useresp = proc->kernel_stack;
-    proc->regs.ss = 0x10;
-    
-    proc->next = NULL;
-    
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i] == NULL) {
-            process_table[i] = proc;
-            break;
-        }
+    proc->refs = 1;
+    proc->page_dir = paging_get_kernel_directory();
+    spin_lock_init(&proc->mm_lock);
+    mutex_init(&proc->mm_mutex);
+    
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    
+    hashtable_add(&pid_hash, &proc->pid_node, proc->pid);
+    
+    // Append so iteration runs oldest first
+    proc->task_next = NULL;
+    proc->task_prev = task_tail;
+    if (task_tail) {
+        task_tail->task_next = proc;
+    } else {
+        task_list = proc;
     }
+    task_tail = proc;
+    task_count++;
+    
+    spin_unlock_irqrestore(&process_lock, flags);
+    return proc;
+}
+
+// Caller holds process_lock
+static void process_unlink(process_t* proc) {
+    hashtable_del(&pid_hash, &proc->pid_node);
+    
+    if (proc->task_prev) {
+        proc->task_prev->task_next = proc->task_next;
+    } else {
+        task_list = proc->task_next;
+    }
+    if (proc->task_next) {
+        proc->task_next->task_prev = proc->task_prev;
+    } else {
+        task_tail = proc->task_prev;
+    }
+    task_count--;
+}
+
+static void process_free(process_t* proc) {
+    ring_exit(proc);
+    systrace_exit(proc);
+    fd_table_exit(proc);
+    vmm_exit(proc);
+    pid_free(proc->pid);
+    kfree(proc);
+}
+
+void process_put(process_t* proc) {
+    if (__sync_sub_and_fetch(&proc->refs, 1) == 0) {
+        process_free(proc);
+    }
+}
+
+void process_discard(process_t* proc) {
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    process_unlink(proc);
+    spin_unlock_irqrestore(&process_lock, flags);
+    process_put(proc);
+}
+
+void process_init(void) {
+    hashtable_init(&pid_hash, pid_buckets, PID_HASH_BITS);
+    thread_init();
+    
+    // The boot context becomes the BSP's idle thread
+    cpus[0].idle = process_create_idle("idle");
+    cpus[0].current = cpus[0].idle;
+}
+
+// Wrap the calling context (boot code of a CPU) in a thread that only
+// runs when nothing else is ready and is never queued
+thread_t* process_create_idle(const char* name) {
+    process_t* proc = process_alloc(name);
+    thread_t* thread = proc ? thread_alloc(proc, proc->pid, 0) : NULL;
+    if (!thread) {
+        print_string("[PROC] Error: Failed to allocate idle thread\n");
+        for(;;) asm("cli; hlt");
+    }
+    
+    thread->state = THREAD_RUNNING;
+    thread->static_prio = SCHED_PRIO_LEVELS - 1;
+    thread->prio = SCHED_PRIO_LEVELS - 1;
+    thread->cpu = cpu_current()->id;
+    thread->on_cpu = 1;
+    thread->sched_info.arrived_at = timer_clock_us();
+    
+    return thread;
+}
+
+// Body of a process's first thread
+static void process_main(void* arg) {
+    void (*entry_point)(void) = (void (*)(void))arg;
+    entry_point();
+}
+
+process_t* process_create(const char* name, void (*entry_point)(void)) {
+    process_t* proc = process_alloc(name);
+    if (!proc) {
+        print_string("[PROC] Error: Failed to allocate process\n");
+        return NULL;
+    }
+    
+    // The first thread shares the process's ID
+    thread_t* thread = thread_alloc(proc, proc->pid, 1);
+    if (!thread) {
+        print_string("[PROC] Error: Failed to allocate thread\n");
+        process_discard(proc);
+        return NULL;
+    }
+    thread->entry = process_main;
+    thread->arg = (void*)entry_point;
     
     print_string("[PROC] Created process: ");
     print_string(proc->name);
@@ -80,59 +195,230 @@ process_t* process_create(const char* name, void (*entry_point)(void)) {
     print_dec(proc->pid);
     print_string(")\n");
     
+    thread_start(thread);
+    
+    return proc;
+}
+
+process_t* process_create_kernel(const char* name) {
+    process_t* proc = process_alloc(name);
+    if (!proc) {
+        print_string("[PROC] Error: Failed to allocate process\n");
+    }
+    return proc;
+}
+
+process_t* process_create_user(const char* name) {
+    process_t* proc = process_create_kernel(name);
+    if (!proc) {
+        return NULL;
+    }
+    
+    page_directory_t* dir = paging_create_directory();
+    if (!dir) {
+        print_string("[PROC] Error: Failed to allocate page directory\n");
+        process_discard(proc);
+        return NULL;
+    }
+    proc->page_dir = dir;
     return proc;
 }
 
+// Kill every thread of proc. Other threads exit once they hold nothing
+// (thread_kill); if the caller belongs to proc it exits here and now.
 void process_terminate(process_t* proc) {
     if (!proc) return;
     
-    proc->state = PROCESS_TERMINATED;
-    
     print_string("[PROC] Process terminated: ");
     print_string(proc->name);
     print_string(" (PID ");
     print_dec(proc->pid);
     print_string(")\n");
     
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i] == proc) {
-            process_table[i] = NULL;
-            break;
+    thread_t* self = current_thread;
+    
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    proc->exiting = 1;
+    for (thread_t* thread = proc->threads; thread; thread = thread->group_next) {
+        if (thread != self) {
+            thread_kill(thread);
         }
     }
+    spin_unlock_irqrestore(&process_lock, flags);
     
-    if (proc->kernel_stack) {
-        kfree((void*)(proc->kernel_stack - KERNEL_STACK_SIZE));
+    if (self && self->proc == proc) {
+        thread_exit();
     }
-    kfree(proc);
 }
 
-void process_list(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        process_t* proc = process_table[i];
-        if (proc) {
-            if (proc->pid < 10) print_char(' ');
-            print_dec(proc->pid);
-            print_string("  ");
-            
-            print_string(proc->name);
-            for (int j = strlen(proc->name); j < 18; j++) {
-                print_char(' ');
-            }
-            
-            switch (proc->state) {
-                case PROCESS_READY:     print_string("READY   "); break;
-                case PROCESS_RUNNING:   print_string("RUNNING "); break;
-                case PROCESS_BLOCKED:   print_string("BLOCKED "); break;
-                case PROCESS_TERMINATED: print_string("DEAD    "); break;
-            }
-            
-            print_dec(proc->cpu_time);
-            print_string(" ticks\n");
+void process_add_thread(process_t* proc, thread_t* thread) {
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    
+    thread->group_prev = NULL;
+    thread->group_next = proc->threads;
+    if (proc->threads) {
+        proc->threads->group_prev = thread;
+    }
+    proc->threads = thread;
+    proc->nr_threads++;
+    
+    if (thread->tid == proc->pid) {
+        proc->main_thread = thread;
+    }
+    
+    spin_unlock_irqrestore(&process_lock, flags);
+}
+
+void process_remove_thread(process_t* proc, thread_t* thread) {
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    
+    if (thread->group_prev) {
+        thread->group_prev->group_next = thread->group_next;
+    } else {
+        proc->threads = thread->group_next;
+    }
+    if (thread->group_next) {
+        thread->group_next->group_prev = thread->group_prev;
+    }
+    if (proc->main_thread == thread) {
+        proc->main_thread = NULL;
+    }
+    
+    int last = --proc->nr_threads == 0;
+    if (last) {
+        process_unlink(proc);
+    }
+    
+    spin_unlock_irqrestore(&process_lock, flags);
+    
+    if (last) {
+        process_put(proc);
+    }
+}
+
+// One line of ps, copied under process_lock so the printing (slow on VGA,
+// slower mirrored to serial) runs with interrupts on
+typedef struct {
+    uint32_t pid;
+    char name[32];
+    uint32_t nr_threads;
+    thread_state_t state;
+    uint32_t cpu_time;
+    uint32_t wss_pages;
+} process_info_t;
+
+typedef struct {
+    process_info_t* info;
+    uint32_t count;
+    uint32_t max;
+} process_snapshot_t;
+
+static void process_list_one(process_t* proc, void* arg) {
+    process_snapshot_t* snap = (process_snapshot_t*)arg;
+    if (snap->count >= snap->max) {
+        return;
+    }
+    process_info_t* info = &snap->info[snap->count++];
+    
+    // Summarise the threads: busiest state, total CPU time
+    thread_state_t state = THREAD_BLOCKED;
+    uint32_t cpu_time = 0;
+    for (thread_t* thread = proc->threads; thread; thread = thread->group_next) {
+        if (thread->state == THREAD_RUNNING ||
+            (thread->state == THREAD_READY && state != THREAD_RUNNING)) {
+            state = thread->state;
         }
+        cpu_time += thread->cpu_time;
+    }
+    if (proc->exiting) {
+        state = THREAD_TERMINATED;
+    }
+    
+    info->pid = proc->pid;
+    memcpy(info->name, proc->name, sizeof(info->name));
+    info->nr_threads = proc->nr_threads;
+    info->state = state;
+    info->cpu_time = cpu_time;
+    info->wss_pages = wss_pages(proc);
+}
+
+static void process_print(const process_info_t* info) {
+    if (info->pid < 10) print_char(' ');
+    print_dec(info->pid);
+    print_string("  ");
+    
+    print_string(info->name);
+    for (int j = strlen(info->name); j < 18; j++) {
+        print_char(' ');
+    }
+    
+    print_dec(info->nr_threads);
+    uint32_t width = 1;
+    for (uint32_t t = info->nr_threads; t >= 10; t /= 10) width++;
+    for (; width < 5; width++) print_char(' ');
+    
+    switch (info->state) {
+        case THREAD_READY:     print_string("READY   "); break;
+        case THREAD_RUNNING:   print_string("RUNNING "); break;
+        case THREAD_BLOCKED:   print_string("BLOCKED "); break;
+        case THREAD_TERMINATED: print_string("DEAD    "); break;
+    }
+    
+    print_dec(info->cpu_time);
+    print_string(" ticks");
+    width = 1;
+    for (uint32_t t = info->cpu_time; t >= 10; t /= 10) width++;
+    for (; width < 8; width++) print_char(' ');
+    
+    print_dec(info->wss_pages * (PAGE_SIZE / 1024));
+    print_string(" KB\n");
+}
+
+void process_list(void) {
+    // Room for a few processes created before the lock is taken
+    process_snapshot_t snap;
+    snap.max = task_count + 8;
+    snap.count = 0;
+    snap.info = (process_info_t*)kmalloc(snap.max * sizeof(process_info_t));
+    if (!snap.info) {
+        print_string("[PROC] Out of memory\n");
+        return;
+    }
+    
+    process_for_each(process_list_one, &snap);
+    for (uint32_t i = 0; i < snap.count; i++) {
+        process_print(&snap.info[i]);
     }
+    kfree(snap.info);
 }
 
 process_t* process_get_current(void) {
-    return current_process;
+    thread_t* thread = current_thread;
+    return thread ? thread->proc : NULL;
+}
+
+process_t* process_find(uint32_t pid) {
+    process_t* proc = NULL;
+    
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    hash_node_t* node = hashtable_find(&pid_hash, pid);
+    if (node) {
+        proc = hash_entry(node, process_t, pid_node);
+        __sync_fetch_and_add(&proc->refs, 1);
+    }
+    spin_unlock_irqrestore(&process_lock, flags);
+    
+    return proc;
+}
+
+void process_for_each(void (*fn)(process_t* proc, void* arg), void* arg) {
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    for (process_t* proc = task_list; proc; proc = proc->task_next) {
+        fn(proc, arg);
+    }
+    spin_unlock_irqrestore(&process_lock, flags);
+}
+
+uint32_t process_count(void) {
+    return task_count;
 }
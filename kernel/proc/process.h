@@ -2,36 +2,98 @@
 #define PROCESS_H
 
 #include "../../include/types.h"
-#include "../hal/isr.h"
+#include "../mm/paging.h"
+#include "../hal/smp.h"
+#include "thread.h"
+#include "../core/spinlock.h"
+#include "sync.h"
+#include "../../lib/libk/hashtable.h"
 
-#define MAX_PROCESSES 64
+struct vma;
+struct ring;
+struct systrace_ring;
+struct fd_table;
 
-typedef enum {
-    PROCESS_READY,
-    PROCESS_RUNNING,
-    PROCESS_BLOCKED,
-    PROCESS_TERMINATED
-} process_state_t;
+// PIDs are recycled from a bitmap of this many IDs. Thread IDs come from
+// the same space; a process's first thread has TID == PID.
+#define PID_BITS 15
+#define PID_MAX (1 << PID_BITS)
 
+// The PID and TID hashes have a bucket per 4 IDs, so lookups stay a short
+// chain walk with the ID space in use
+#define PID_HASH_BITS (PID_BITS - 2)
+
+// Address space and identity shared by a group of threads
 typedef struct process {
     uint32_t pid;
     char name[32];
-    process_state_t state;
-    registers_t regs;
-    uint32_t kernel_stack;
     uint32_t created_at;
-    uint32_t cpu_time;
-    struct process* next;
+    page_directory_t* page_dir;
+    struct vma* vmas;       // User mappings, sorted by address (mm/vmm.c)
+    struct vma* vma_root;   // The same mappings as a balanced tree
+    spinlock_t mm_lock;     // Guards the VMAs and user page tables
+    mutex_t mm_mutex;       // Serialises mmap/munmap/mprotect/brk
+    uint32_t mm_seq;        // Bumped when a mapping shrinks or loses access
+    uint32_t brk_start;     // Heap [brk_start, brk), grown by brk()
+    uint32_t brk;
+    uint32_t mmap_cache;    // Where the next mmap search starts, 0: the top
+    struct ring* ring;      // Submission/completion rings (syscall/ring.c)
+    struct systrace_ring* trace; // Recent syscalls while traced (syscall/trace.c)
+    struct fd_table* files; // Open descriptors, created on first use (fs/file.c)
+    uint32_t wss_avg;       // Decayed working set, pages << WSS_SHIFT
+    uint32_t wss_last;      // Pages referenced during the last scan
+    uint32_t rss_pages;     // User pages mapped at the last scan
+    thread_t* threads;      // Live threads, linked by group_next
+    thread_t* main_thread;  // First thread, NULL once it has exited
+    uint32_t nr_threads;
+    uint8_t exiting;        // Terminated, waiting for its threads to go
+    volatile uint32_t refs; // One for the threads, one per process_find
+    hash_node_t pid_node;   // Entry in the pid hash
+    struct process* task_next; // List of all processes
+    struct process* task_prev;
 } process_t;
 
 void process_init(void);
 process_t* process_create(const char* name, void (*entry_point)(void));
+thread_t* process_create_idle(const char* name);
+
+// Create a process with no threads yet, to hold kernel threads started
+// with thread_create; it goes away with its last thread
+process_t* process_create_kernel(const char* name);
+
+// Create a process with its own, empty user address space and no threads;
+// the caller maps its memory and starts its first thread
+process_t* process_create_user(const char* name);
+
+// Free a process created above that never got a thread
+void process_discard(process_t* proc);
 void process_terminate(process_t* proc);
 void process_list(void);
 process_t* process_get_current(void);
 
-// For scheduler access
-extern process_t* current_process;
-extern process_t* process_table[MAX_PROCESSES];
+// Look up a live process by PID, NULL if none. The process is returned
+// with a reference held, so it is not freed under the caller even if its
+// last thread exits; drop it with process_put.
+process_t* process_find(uint32_t pid);
+void process_put(process_t* proc);
+
+// Call fn on every process with the process list locked and interrupts
+// off; fn must not create or terminate processes, and should copy what it
+// needs rather than print it
+void process_for_each(void (*fn)(process_t* proc, void* arg), void* arg);
+
+uint32_t process_count(void);
+
+// Thread membership, called by thread.c. process_remove_thread unlists the
+// process along with its last thread and drops the threads' reference.
+void process_add_thread(process_t* proc, thread_t* thread);
+void process_remove_thread(process_t* proc, thread_t* thread);
+
+// ID allocator shared by processes and threads; -1 when exhausted
+int32_t pid_alloc(void);
+void pid_free(uint32_t pid);
+
+// Process of the thread running on the calling CPU
+#define current_process (current_thread->proc)
 
 #endif
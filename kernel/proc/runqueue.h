@@ -0,0 +1,44 @@
+// kernel/proc/runqueue.h - Per-CPU run queue
+#ifndef RUNQUEUE_H
+#define RUNQUEUE_H
+
+#include "../../include/types.h"
+#include "../core/spinlock.h"
+
+// Priorities: 0 is highest
+#define SCHED_PRIO_LEVELS  32
+
+// Wakeup-to-run latency histogram, bucket upper bounds in microseconds:
+// 10, 100, 1000, 10000, 100000 and everything above
+#define SCHEDSTAT_LAT_BUCKETS 6
+
+struct thread;
+
+typedef struct runqueue {
+    spinlock_t lock;
+    uint32_t cpu;           // Owning CPU
+    
+    // One FIFO per priority level, bit N of bitmap set when level N is
+    // non-empty. Picking the next task is a single bit scan.
+    struct thread* head[SCHED_PRIO_LEVELS];
+    struct thread* tail[SCHED_PRIO_LEVELS];
+    uint32_t bitmap;
+    
+    // Runnable deadline tasks sorted by absolute deadline; always picked
+    // before any SCHED_NORMAL task
+    struct thread* dl_head;
+    
+    // Every SCHED_DEADLINE task bound to this CPU, for replenishment
+    struct thread* dl_tasks;
+    uint32_t dl_bw;
+    
+    uint32_t nr_queued;     // Tasks waiting on this queue
+    uint32_t last_balance;  // Tick of the last load balance
+    uint32_t nr_switches;   // Context switches on this CPU
+    uint32_t nr_migrations; // Tasks pulled to this CPU by load balancing
+    uint32_t nr_wakeups;    // Wakeups that ran here
+    uint32_t lat_max_us;
+    uint32_t lat_hist[SCHEDSTAT_LAT_BUCKETS];
+} runqueue_t;
+
+#endif // RUNQUEUE_H
@@ -1,120 +1,1099 @@
 #include "scheduler.h"
 #include "process.h"
 #include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../core/softirq.h"
 #include "../drivers/timer/pit.h"
-#include "../hal/irq.h"
+#include "../hal/cpu.h"
+#include "../hal/smp.h"
+#include "fpu.h"
+#include "thread.h"
+#include "../hal/gdt.h"
+#include "../mm/paging.h"
+#include "../mm/heap.h"
+#include "../../lib/libc/string.h"
 
-// External references from process.c
-extern process_t* current_process;
-extern process_t* process_table[];
-extern uint32_t next_pid;
+// Every CPU has its own run queue (cpus[n].rq) protected by its own lock.
+// A thread belongs to the queue of thread->cpu; it only changes CPU when the
+// load balancer pulls it, which requires both queue locks. Deadline tasks
+// are partitioned: admission control is per CPU and they never migrate.
 
-#define MAX_PROCESSES 64
+// Wrap-safe tick comparison
+static inline int time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// Index of lowest set bit (bitmap must be non-zero)
+static inline uint32_t find_first_set(uint32_t bitmap) {
+    uint32_t index;
+    asm("bsf %1, %0" : "=r"(index) : "rm"(bitmap));
+    return index;
+}
+
+// Index of highest set bit (bitmap must be non-zero)
+static inline uint32_t find_last_set(uint32_t bitmap) {
+    uint32_t index;
+    asm("bsr %1, %0" : "=r"(index) : "rm"(bitmap));
+    return index;
+}
+
+static inline runqueue_t* task_rq(thread_t* thread) {
+    return &cpus[thread->cpu].rq;
+}
+
+static inline int is_idle(thread_t* thread) {
+    return thread == cpus[thread->cpu].idle;
+}
+
+// Lock the run queue a task belongs to, retrying if it migrated meanwhile
+static runqueue_t* task_rq_lock(thread_t* thread, uint32_t* flags) {
+    for (;;) {
+        runqueue_t* rq = task_rq(thread);
+        *flags = spin_lock_irqsave(&rq->lock);
+        if (rq == task_rq(thread)) {
+            return rq;
+        }
+        spin_unlock_irqrestore(&rq->lock, *flags);
+    }
+}
+
+// Take two run queue locks in CPU order so balancers cannot deadlock.
+// Interrupts must already be disabled.
+static void double_rq_lock(runqueue_t* a, runqueue_t* b) {
+    if (a->cpu < b->cpu) {
+        spin_lock(&a->lock);
+        spin_lock(&b->lock);
+    } else {
+        spin_lock(&b->lock);
+        spin_lock(&a->lock);
+    }
+}
 
-static process_t* ready_queue_head = NULL;
-static process_t* ready_queue_tail = NULL;
-static uint32_t time_slice = 10;  // 100ms at 100Hz
+static void double_rq_unlock(runqueue_t* a, runqueue_t* b) {
+    spin_unlock(&a->lock);
+    spin_unlock(&b->lock);
+}
+
+// Timeslice scales linearly from SCHED_SLICE_MAX (prio 0) down to
+// SCHED_SLICE_MIN (lowest priority); nice 0 gets about 100ms
+uint32_t scheduler_timeslice(uint32_t prio) {
+    return SCHED_SLICE_MIN + ((SCHED_PRIO_LEVELS - 1 - prio) *
+           (SCHED_SLICE_MAX - SCHED_SLICE_MIN)) / (SCHED_PRIO_LEVELS - 1);
+}
 
-// Add process to ready queue
-static void enqueue_process(process_t* proc) {
-    if (!proc) return;
+static void update_prio(thread_t* thread) {
+    if (thread->static_prio > thread->sleep_bonus) {
+        thread->prio = thread->static_prio - thread->sleep_bonus;
+    } else {
+        thread->prio = 0;
+    }
+}
+
+// Insert deadline task keeping rq->dl_head sorted (EDF)
+static void dl_enqueue(runqueue_t* rq, thread_t* thread) {
+    thread_t* prev = NULL;
+    thread_t* cur = rq->dl_head;
     
-    proc->next = NULL;
+    while (cur && !time_before(thread->dl.abs_deadline, cur->dl.abs_deadline)) {
+        prev = cur;
+        cur = cur->next;
+    }
     
-    if (!ready_queue_head) {
-        ready_queue_head = proc;
-        ready_queue_tail = proc;
+    thread->prev = prev;
+    thread->next = cur;
+    if (cur) cur->prev = thread;
+    if (prev) {
+        prev->next = thread;
     } else {
-        ready_queue_tail->next = proc;
-        ready_queue_tail = proc;
+        rq->dl_head = thread;
     }
 }
 
-// Remove process from ready queue
-static process_t* dequeue_process(void) {
-    if (!ready_queue_head) {
-        return NULL;
+// Context switch rate, sampled over one-second windows on the BSP
+static uint32_t rate_window_start = 0;
+static uint32_t rate_window_switches = 0;
+static uint32_t switches_per_sec = 0;
+
+static const uint32_t lat_bounds[SCHEDSTAT_LAT_BUCKETS - 1] = {
+    10, 100, 1000, 10000, 100000
+};
+
+// Add microseconds to a millisecond total, carrying the remainder
+static void account_us(uint32_t* ms, uint16_t* rem_us, uint32_t us) {
+    us += *rem_us;
+    *ms += us / 1000;
+    *rem_us = us % 1000;
+}
+
+static void record_latency(runqueue_t* rq, thread_t* thread, uint32_t us) {
+    uint32_t bucket = 0;
+    while (bucket < SCHEDSTAT_LAT_BUCKETS - 1 && us >= lat_bounds[bucket]) {
+        bucket++;
+    }
+    
+    thread->stats.lat_hist[bucket]++;
+    if (us > thread->stats.lat_max_us) {
+        thread->stats.lat_max_us = us;
+    }
+    
+    rq->nr_wakeups++;
+    rq->lat_hist[bucket]++;
+    if (us > rq->lat_max_us) {
+        rq->lat_max_us = us;
+    }
+}
+
+// Account the time prev ran and why it gave up the CPU
+static void sched_info_depart(thread_t* prev, uint32_t now) {
+    sched_info_t* si = &prev->sched_info;
+    
+    account_us(&prev->stats.run_ms, &si->run_rem_us, now - si->arrived_at);
+    
+    if (prev->state == THREAD_BLOCKED || si->yielded) {
+        prev->stats.nvcsw++;
+    } else if (prev->state == THREAD_READY) {
+        prev->stats.nivcsw++;
     }
+    si->yielded = 0;
+}
+
+// Account the time next spent queued, and its latency if it was woken
+static void sched_info_arrive(runqueue_t* rq, thread_t* next, uint32_t now) {
+    sched_info_t* si = &next->sched_info;
+    
+    if (si->queued) {
+        uint32_t wait = now - si->queued_at;
+        if ((int32_t)wait < 0) {
+            // Queued on a CPU whose TSC runs slightly ahead
+            wait = 0;
+        }
+        account_us(&next->stats.wait_ms, &si->wait_rem_us, wait);
+        if (si->woken) {
+            record_latency(rq, next, wait);
+        }
+    }
+    
+    si->queued = 0;
+    si->woken = 0;
+    si->arrived_at = now;
+    next->stats.run_count++;
+}
+
+// Add thread to the tail of its priority queue
+static void enqueue_thread(runqueue_t* rq, thread_t* thread) {
+    if (!thread) return;
+    
+    rq->nr_queued++;
     
-    process_t* proc = ready_queue_head;
-    ready_queue_head = ready_queue_head->next;
+    // Requeueing (migration, priority change) keeps the original time
+    if (!thread->sched_info.queued) {
+        thread->sched_info.queued = 1;
+        thread->sched_info.queued_at = timer_clock_us();
+    }
     
-    if (!ready_queue_head) {
-        ready_queue_tail = NULL;
+    if (thread->policy == SCHED_DEADLINE) {
+        dl_enqueue(rq, thread);
+        return;
     }
     
-    proc->next = NULL;
-    return proc;
+    uint32_t prio = thread->prio;
+    
+    thread->next = NULL;
+    thread->prev = rq->tail[prio];
+    
+    if (!rq->head[prio]) {
+        rq->head[prio] = thread;
+    } else {
+        rq->tail[prio]->next = thread;
+    }
+    rq->tail[prio] = thread;
+    rq->bitmap |= (1u << prio);
 }
 
-// Context switch (implemented in switch.asm)
-extern void switch_context(registers_t* old, registers_t* new_ctx);
+// Unlink thread from its priority queue
+static void unlink_thread(runqueue_t* rq, thread_t* thread) {
+    rq->nr_queued--;
+    
+    if (thread->policy == SCHED_DEADLINE) {
+        if (thread->prev) {
+            thread->prev->next = thread->next;
+        } else {
+            rq->dl_head = thread->next;
+        }
+        if (thread->next) {
+            thread->next->prev = thread->prev;
+        }
+        thread->next = NULL;
+        thread->prev = NULL;
+        return;
+    }
+    
+    uint32_t prio = thread->prio;
+    
+    if (thread->prev) {
+        thread->prev->next = thread->next;
+    } else {
+        rq->head[prio] = thread->next;
+    }
+    
+    if (thread->next) {
+        thread->next->prev = thread->prev;
+    } else {
+        rq->tail[prio] = thread->prev;
+    }
+    
+    if (!rq->head[prio]) {
+        rq->bitmap &= ~(1u << prio);
+    }
+    
+    thread->next = NULL;
+    thread->prev = NULL;
+}
 
-// Schedule next process
-void schedule(void) {
-    if (!current_process) return;
+// Remove earliest deadline or highest priority thread from the queues
+static thread_t* dequeue_thread(runqueue_t* rq) {
+    thread_t* thread;
     
-    // Save current process state
-    if (current_process->state == PROCESS_RUNNING) {
-        current_process->state = PROCESS_READY;
-        enqueue_process(current_process);
+    if (rq->dl_head) {
+        thread = rq->dl_head;
+    } else if (rq->bitmap) {
+        thread = rq->head[find_first_set(rq->bitmap)];
+    } else {
+        return NULL;
     }
     
-    // Find idle process
-    process_t* idle = NULL;
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i] && process_table[i]->pid == 0) {
-            idle = process_table[i];
-            break;
+    unlink_thread(rq, thread);
+    return thread;
+}
+
+static int is_queued(runqueue_t* rq, thread_t* thread) {
+    if (thread->policy == SCHED_DEADLINE) {
+        return thread->prev || rq->dl_head == thread;
+    }
+    return thread->prev || rq->head[thread->prio] == thread;
+}
+
+// Should the task running on rq's CPU give way to a queued one?
+static int need_preempt(runqueue_t* rq, thread_t* curr) {
+    if (!curr || curr == cpus[rq->cpu].idle) {
+        return rq->bitmap || rq->dl_head;
+    }
+    if (rq->dl_head) {
+        return curr->policy != SCHED_DEADLINE ||
+               time_before(rq->dl_head->dl.abs_deadline, curr->dl.abs_deadline);
+    }
+    if (curr->policy == SCHED_DEADLINE) {
+        return 0;
+    }
+    return rq->bitmap && find_first_set(rq->bitmap) < curr->prio;
+}
+
+// After queueing work on another CPU, kick it if it should switch now
+static void check_preempt_remote(runqueue_t* rq) {
+    if (rq->cpu != cpu_current()->id &&
+        need_preempt(rq, cpus[rq->cpu].current)) {
+        smp_send_reschedule(rq->cpu);
+    }
+}
+
+// Release new jobs at period boundaries and account deadline misses
+static void dl_update(runqueue_t* rq, uint32_t now) {
+    for (thread_t* thread = rq->dl_tasks; thread; thread = thread->dl.dl_next) {
+        if (!thread->dl.job_done && !thread->dl.missed &&
+            !time_before(now, thread->dl.abs_deadline)) {
+            thread->dl.missed = 1;
+            thread->dl.misses++;
+        }
+        
+        if (time_before(now, thread->dl.next_release)) {
+            continue;
+        }
+        
+        int queued = is_queued(rq, thread);
+        if (queued) {
+            unlink_thread(rq, thread);
+        }
+        
+        thread->dl.abs_deadline = thread->dl.next_release + thread->dl.deadline;
+        thread->dl.next_release += thread->dl.period;
+        thread->dl.budget = thread->dl.runtime;
+        thread->dl.throttled = 0;
+        thread->dl.job_done = 0;
+        thread->dl.missed = 0;
+        thread->dl.jobs++;
+        
+        if (queued || (thread->state == THREAD_READY &&
+                       thread != cpus[rq->cpu].current)) {
+            enqueue_thread(rq, thread);
+        }
+    }
+}
+
+// Tasks running or queued on a CPU
+static uint32_t cpu_load(cpu_t* cpu) {
+    return cpu->rq.nr_queued + (cpu->current != cpu->idle ? 1 : 0);
+}
+
+// Lowest priority normal task on rq that is not mid context switch or
+// bound to its CPU
+static thread_t* pick_migratable(runqueue_t* rq) {
+    uint32_t bitmap = rq->bitmap;
+    
+    while (bitmap) {
+        uint32_t prio = find_last_set(bitmap);
+        for (thread_t* thread = rq->tail[prio]; thread; thread = thread->prev) {
+            if (!thread->on_cpu && !thread->pinned) {
+                return thread;
+            }
+        }
+        bitmap &= ~(1u << prio);
+    }
+    return NULL;
+}
+
+// Pull one task from the busiest CPU if it has at least two more tasks
+// than this one. Called with interrupts disabled.
+static void load_balance(cpu_t* self) {
+    cpu_t* busiest = NULL;
+    uint32_t max_load = cpu_load(self) + 1;
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (&cpus[i] == self || !cpus[i].online) {
+            continue;
+        }
+        uint32_t load = cpu_load(&cpus[i]);
+        if (load > max_load) {
+            max_load = load;
+            busiest = &cpus[i];
+        }
+    }
+    
+    if (!busiest) {
+        return;
+    }
+    
+    double_rq_lock(&self->rq, &busiest->rq);
+    
+    // Loads were sampled without the locks, check again
+    if (cpu_load(busiest) > cpu_load(self) + 1) {
+        thread_t* thread = pick_migratable(&busiest->rq);
+        if (thread) {
+            unlink_thread(&busiest->rq, thread);
+            thread->cpu = self->id;
+            enqueue_thread(&self->rq, thread);
+            thread->stats.migrations++;
+            self->rq.nr_migrations++;
+        }
+    }
+    
+    double_rq_unlock(&self->rq, &busiest->rq);
+}
+
+// The thread switched out last on this CPU is fully off it; it may now be
+// pulled elsewhere, or freed if it exited
+static void finish_switch(cpu_t* cpu) {
+    thread_t* last = cpu->last;
+    cpu->last = NULL;
+    
+    if (last && last != cpu->current) {
+        last->on_cpu = 0;
+        if (last->state == THREAD_TERMINATED) {
+            thread_reap(last);
+        }
+    }
+}
+
+// Called by a new thread on its first run, in place of the return from
+// switch_context in schedule()
+void scheduler_finish_switch(void) {
+    finish_switch(cpu_current());
+}
+
+// Save callee-saved registers and ESP to *old_esp, then resume the thread
+// whose ESP is new_esp (implemented in switch.asm)
+extern void switch_context(uint32_t* old_esp, uint32_t new_esp);
+
+// Pick and switch to the next thread. preempt: the switch is forced on
+// prev from IRQ context rather than asked for by prev itself.
+static void __schedule(int preempt) {
+    cpu_t* cpu = cpu_current();
+    thread_t* prev = cpu->current;
+    if (!prev) return;
+    
+    runqueue_t* rq = &cpu->rq;
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    cpu->need_resched = 0;
+    
+    // Save current thread state; a throttled deadline task stays off
+    // the queues until its next release. A thread preempted between
+    // prepare_to_wait and its own schedule() has not checked its wait
+    // condition yet, so it stays runnable: it rechecks when it resumes.
+    int runnable = prev->state == THREAD_RUNNING ||
+                   (preempt && prev->state == THREAD_BLOCKED);
+    if (runnable && prev != cpu->idle) {
+        prev->state = THREAD_READY;
+        if (!(prev->policy == SCHED_DEADLINE && prev->dl.throttled)) {
+            enqueue_thread(rq, prev);
         }
     }
     
-    // Get next process or idle
-    process_t* next = dequeue_process();
+    // Get next thread, pulling work from a busy CPU before going idle
+    thread_t* next = dequeue_thread(rq);
+    if (!next && cpu_count > 1) {
+        spin_unlock(&rq->lock);
+        load_balance(cpu);
+        spin_lock(&rq->lock);
+        next = dequeue_thread(rq);
+    }
     if (!next) {
-        next = idle;
+        next = cpu->idle;
     }
     
-    if (!next) return;
+    if (!next) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+    
+    // Switch to next thread
+    if (prev != next) {
+        uint32_t now = timer_clock_us();
+        sched_info_depart(prev, now);
+        sched_info_arrive(rq, next, now);
+        rq->nr_switches++;
+    } else {
+        // Preempted or yielded but picked again straight away
+        next->sched_info.queued = 0;
+        next->sched_info.woken = 0;
+        next->sched_info.yielded = 0;
+    }
     
-    // Switch to next process
-    next->state = PROCESS_RUNNING;
-    process_t* prev = current_process;
-    current_process = next;
+    next->state = THREAD_RUNNING;
+    next->on_cpu = 1;
+    cpu->current = next;
+    spin_unlock(&rq->lock);
     
-    // Perform context switch
+    // Perform context switch. The ring 0 stack, TLS segment and address
+    // space follow the thread; %gs is reloaded to pick up the new base.
     if (prev != next) {
-        switch_context(&prev->regs, &next->regs);
+        cpu->last = prev;
+        fpu_switch(prev, next);
+        if (next->kernel_stack) {
+            set_kernel_stack(next->kernel_stack);
+        }
+        gdt_set_tls(next->tls_base);
+        if (next->proc->page_dir != prev->proc->page_dir) {
+            paging_switch_directory(next->proc->page_dir);
+        }
+        switch_context(&prev->context, next->context);
+        finish_switch(cpu_current());
     }
+    
+    cpu_irq_restore(flags);
 }
 
-// Timer interrupt handler
+void schedule(void) {
+    __schedule(0);
+}
+
+void preempt_schedule(void) {
+    __schedule(1);
+}
+
+// Give up the CPU, staying runnable. For a deadline task this marks the
+// current job complete; it runs again at its next release.
+void yield(void) {
+    uint32_t flags = cpu_irq_save();
+    
+    thread_t* curr = current_thread;
+    if (curr && curr->policy == SCHED_DEADLINE) {
+        curr->dl.job_done = 1;
+        curr->dl.throttled = 1;
+    }
+    if (curr) {
+        curr->sched_info.yielded = 1;
+    }
+    
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+static void update_switch_rate(uint32_t now) {
+    uint32_t elapsed = now - rate_window_start;
+    if (elapsed < TIMER_HZ) {
+        return;
+    }
+    
+    uint32_t switches = 0;
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        switches += cpus[i].rq.nr_switches;
+    }
+    
+    switches_per_sec = ((switches - rate_window_switches) * TIMER_HZ) / elapsed;
+    rate_window_start = now;
+    rate_window_switches = switches;
+}
+
+// Timer interrupt handler, called once per tick on every CPU
 void scheduler_tick(registers_t* regs) {
-    static uint32_t ticks = 0;
+    (void)regs;
+    
+    cpu_t* cpu = cpu_current();
+    thread_t* curr = cpu->current;
+    if (!curr) return;
+    
+    runqueue_t* rq = &cpu->rq;
+    uint32_t now = timer_get_ticks();
+    int resched = 0;
     
-    if (!current_process) return;
+    finish_switch(cpu);
     
     // Update CPU time
-    current_process->cpu_time++;
+    curr->cpu_time++;
     
-    // Check if time slice expired
-    ticks++;
-    if (ticks >= time_slice) {
-        ticks = 0;
+    if (cpu->id == 0) {
+        update_switch_rate(now);
+    }
+    
+    // Idle CPUs look for work every tick, busy ones periodically. The
+    // scan of other run queues is left to the softirq.
+    if (cpu_count > 1 && (curr == cpu->idle ||
+        now - rq->last_balance >= SCHED_BALANCE_INTERVAL)) {
+        rq->last_balance = now;
+        raise_softirq_irqoff(SOFTIRQ_SCHED);
+    }
+    
+    spin_lock(&rq->lock);
+    dl_update(rq, now);
+    
+    if (curr == cpu->idle) {
+        // Preempt idle as soon as anything is runnable
+        resched = rq->bitmap || rq->dl_head;
+    } else if (curr->policy == SCHED_DEADLINE) {
+        if (curr->dl.budget > 0) {
+            curr->dl.budget--;
+        }
         
-        // Save current register state
-        current_process->regs = *regs;
+        // Budget exhausted: throttle so an overrunning job cannot eat
+        // into other tasks' reservations
+        if (curr->dl.budget == 0 && !curr->dl.throttled) {
+            curr->dl.overruns++;
+            curr->dl.throttled = 1;
+            resched = 1;
+        } else {
+            resched = need_preempt(rq, curr);
+        }
+    } else {
+        // Check if time slice expired
+        if (curr->time_slice > 0) {
+            curr->time_slice--;
+        }
         
-        // Schedule next process
-        schedule();
+        if (curr->time_slice == 0) {
+            // CPU-bound: lose bonus earned by sleeping
+            if (curr->sleep_bonus > 0) {
+                curr->sleep_bonus--;
+                update_prio(curr);
+            }
+            curr->time_slice = scheduler_timeslice(curr->static_prio);
+            resched = 1;
+        } else {
+            // A deadline or higher priority task woke up
+            resched = need_preempt(rq, curr);
+        }
+    }
+    
+    spin_unlock(&rq->lock);
+    
+    // Switch on the way out of the interrupt
+    if (resched) {
+        cpu->need_resched = 1;
+    }
+}
+
+// SOFTIRQ_SCHED: periodic load balancing raised by scheduler_tick
+static void sched_softirq(void) {
+    uint32_t flags = cpu_irq_save();
+    
+    cpu_t* cpu = cpu_current();
+    load_balance(cpu);
+    if (cpu->current == cpu->idle && (cpu->rq.bitmap || cpu->rq.dl_head)) {
+        cpu->need_resched = 1;
+    }
+    
+    cpu_irq_restore(flags);
+}
+
+// Reschedule IPI: another CPU queued work here that should run now
+void scheduler_ipi(registers_t* regs) {
+    (void)regs;
+    
+    cpu_t* cpu = cpu_current();
+    thread_t* curr = cpu->current;
+    if (!curr) return;
+    
+    spin_lock(&cpu->rq.lock);
+    int resched = need_preempt(&cpu->rq, curr);
+    spin_unlock(&cpu->rq.lock);
+    
+    if (resched) {
+        cpu->need_resched = 1;
+    }
+}
+
+// Least loaded online CPU, for placing new tasks
+uint32_t scheduler_select_cpu(void) {
+    uint32_t best = 0;
+    uint32_t best_load = cpu_load(&cpus[0]);
+    
+    for (uint32_t i = 1; i < cpu_count; i++) {
+        if (!cpus[i].online) {
+            continue;
+        }
+        uint32_t load = cpu_load(&cpus[i]);
+        if (load < best_load) {
+            best_load = load;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Queue a task on rq; rq must be locked
+static void activate_task(runqueue_t* rq, thread_t* thread) {
+    if (is_queued(rq, thread)) {
+        return;
+    }
+    
+    thread->state = THREAD_READY;
+    if (thread->policy == SCHED_DEADLINE && thread->dl.throttled) {
+        // Queued by dl_update() at the next release
+        return;
+    }
+    update_prio(thread);
+    if (thread->time_slice == 0) {
+        thread->time_slice = scheduler_timeslice(thread->static_prio);
+    }
+    enqueue_thread(rq, thread);
+    check_preempt_remote(rq);
+}
+
+// Make a thread runnable on its CPU
+void scheduler_add(thread_t* thread) {
+    if (!thread || is_idle(thread)) return;
+    
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    activate_task(rq, thread);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Take a thread off the ready queues
+void scheduler_remove(thread_t* thread) {
+    if (!thread) return;
+    
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    
+    if (is_queued(rq, thread)) {
+        unlink_thread(rq, thread);
+    }
+    thread->sched_info.queued = 0;
+    thread->sched_info.woken = 0;
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Block the current thread until scheduler_wake
+void scheduler_block(void) {
+    thread_t* curr = current_thread;
+    if (!curr || curr == idle_thread) return;
+    
+    uint32_t flags = cpu_irq_save();
+    curr->state = THREAD_BLOCKED;
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+// Wake a blocked thread on the CPU it last ran on, boosting it for
+// having slept
+void scheduler_wake(thread_t* thread) {
+    if (!thread) return;
+    
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    
+    if (thread->state == THREAD_BLOCKED) {
+        if (thread->policy == SCHED_NORMAL &&
+            thread->sleep_bonus < SCHED_MAX_BONUS) {
+            thread->sleep_bonus++;
+        }
+        thread->stats.wakeups++;
+        activate_task(rq, thread);
+        if (thread->sched_info.queued) {
+            thread->sched_info.woken = 1;
+        }
+    }
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// The caller prepared to block but is running again, either because its
+// wait condition came true or because it was woken. A wakeup that raced
+// with the sleep may have queued it while still running; take it back off.
+void scheduler_finish_wait(thread_t* thread) {
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    
+    if (is_queued(rq, thread)) {
+        unlink_thread(rq, thread);
+    }
+    thread->sched_info.queued = 0;
+    thread->sched_info.woken = 0;
+    thread->state = THREAD_RUNNING;
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Change nice value, requeueing at the new priority if needed
+int scheduler_set_nice(thread_t* thread, int32_t nice) {
+    if (!thread || is_idle(thread)) return -1;
+    
+    if (nice < NICE_MIN) nice = NICE_MIN;
+    if (nice > NICE_MAX) nice = NICE_MAX;
+    
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    
+    int queued = is_queued(rq, thread);
+    if (queued) {
+        unlink_thread(rq, thread);
+    }
+    
+    thread->nice = nice;
+    thread->static_prio = SCHED_PRIO_DEFAULT + nice;
+    update_prio(thread);
+    
+    if (queued) {
+        enqueue_thread(rq, thread);
+    }
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return nice;
+}
+
+// Switch a thread to SCHED_DEADLINE with the given parameters in ticks,
+// or back to SCHED_NORMAL when runtime is 0. Fails if the task set of the
+// thread's CPU would no longer be schedulable (bandwidth above DL_BW_LIMIT)
+// or the period is longer than DL_PERIOD_MAX.
+int scheduler_set_deadline(thread_t* thread, uint32_t runtime,
+                           uint32_t period, uint32_t deadline) {
+    if (!thread || is_idle(thread)) return -1;
+    
+    if (deadline == 0) deadline = period;
+    
+    uint32_t new_bw = 0;
+    if (runtime > 0) {
+        if (period == 0 || period > DL_PERIOD_MAX ||
+            runtime > deadline || deadline > period) {
+            return -1;
+        }
+        new_bw = (runtime << DL_BW_SHIFT) / period;
+    }
+    
+    uint32_t flags;
+    runqueue_t* rq = task_rq_lock(thread, &flags);
+    
+    uint32_t old_bw = 0;
+    if (thread->policy == SCHED_DEADLINE) {
+        old_bw = (thread->dl.runtime << DL_BW_SHIFT) / thread->dl.period;
+    }
+    
+    // Admission control
+    if (rq->dl_bw - old_bw + new_bw > DL_BW_LIMIT) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return -1;
+    }
+    
+    int queued = is_queued(rq, thread);
+    if (queued) {
+        unlink_thread(rq, thread);
+    }
+    
+    // Leave the deadline task list
+    if (thread->policy == SCHED_DEADLINE) {
+        thread_t** link = &rq->dl_tasks;
+        while (*link && *link != thread) {
+            link = &(*link)->dl.dl_next;
+        }
+        if (*link) {
+            *link = thread->dl.dl_next;
+        }
+        thread->dl.dl_next = NULL;
+    }
+    
+    rq->dl_bw = rq->dl_bw - old_bw + new_bw;
+    
+    if (runtime > 0) {
+        uint32_t now = timer_get_ticks();
+        
+        thread->policy = SCHED_DEADLINE;
+        thread->dl.runtime = runtime;
+        thread->dl.period = period;
+        thread->dl.deadline = deadline;
+        thread->dl.abs_deadline = now + deadline;
+        thread->dl.next_release = now + period;
+        thread->dl.budget = runtime;
+        thread->dl.throttled = 0;
+        thread->dl.job_done = 0;
+        thread->dl.missed = 0;
+        thread->dl.jobs = 1;
+        thread->dl.misses = 0;
+        thread->dl.overruns = 0;
+        thread->dl.dl_next = rq->dl_tasks;
+        rq->dl_tasks = thread;
+    } else {
+        thread->policy = SCHED_NORMAL;
+        update_prio(thread);
+    }
+    
+    if (queued || (thread->state == THREAD_READY &&
+                   thread != cpus[rq->cpu].current)) {
+        enqueue_thread(rq, thread);
+    }
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return 0;
+}
+
+// Is any task waiting for this CPU?
+int scheduler_has_ready(void) {
+    runqueue_t* rq = &cpu_current()->rq;
+    return rq->bitmap != 0 || rq->dl_head != NULL;
+}
+
+// Ticks from now until the scheduler needs a tick (next deadline release
+// on any CPU)
+uint32_t scheduler_next_event(uint32_t now) {
+    uint32_t next = 0xFFFFFFFF;
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        runqueue_t* rq = &cpus[i].rq;
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        
+        for (thread_t* thread = rq->dl_tasks; thread; thread = thread->dl.dl_next) {
+            uint32_t delta = thread->dl.next_release - now;
+            if ((int32_t)delta <= 0) {
+                next = 0;
+                break;
+            }
+            if (delta < next) {
+                next = delta;
+            }
+        }
+        
+        spin_unlock_irqrestore(&rq->lock, flags);
+        if (next == 0) {
+            break;
+        }
+    }
+    return next;
+}
+
+// Drop a thread from the scheduler for good
+void scheduler_exit(thread_t* thread) {
+    if (!thread) return;
+    
+    if (thread->policy == SCHED_DEADLINE) {
+        scheduler_set_deadline(thread, 0, 0, 0);
+    }
+    scheduler_remove(thread);
+}
+
+// Print deadline task statistics
+void scheduler_dl_list(void) {
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        runqueue_t* rq = &cpus[i].rq;
+        
+        for (thread_t* thread = rq->dl_tasks; thread; thread = thread->dl.dl_next) {
+            if (thread->tid < 10) print_char(' ');
+            print_dec(thread->tid);
+            print_string("  ");
+            
+            print_string(thread->proc->name);
+            for (int j = strlen(thread->proc->name); j < 18; j++) {
+                print_char(' ');
+            }
+            
+            print_dec(thread->dl.runtime);
+            print_char('/');
+            print_dec(thread->dl.deadline);
+            print_char('/');
+            print_dec(thread->dl.period);
+            print_string("  jobs ");
+            print_dec(thread->dl.jobs);
+            print_string("  missed ");
+            print_dec(thread->dl.misses);
+            print_string("  overrun ");
+            print_dec(thread->dl.overruns);
+            print_string("\n");
+        }
+        
+        print_string("CPU ");
+        print_dec(i);
+        print_string(" bandwidth reserved: ");
+        print_dec((rq->dl_bw * 100) >> DL_BW_SHIFT);
+        print_string("%\n");
+    }
+}
+
+void scheduler_get_stats(sched_global_stats_t* stats) {
+    memset(stats, 0, sizeof(sched_global_stats_t));
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        runqueue_t* rq = &cpus[i].rq;
+        
+        stats->switches += rq->nr_switches;
+        stats->migrations += rq->nr_migrations;
+        stats->wakeups += rq->nr_wakeups;
+        if (rq->lat_max_us > stats->lat_max_us) {
+            stats->lat_max_us = rq->lat_max_us;
+        }
+        for (int b = 0; b < SCHEDSTAT_LAT_BUCKETS; b++) {
+            stats->lat_hist[b] += rq->lat_hist[b];
+        }
+    }
+    stats->switches_per_sec = switches_per_sec;
+}
+
+static void print_padded(uint32_t value, uint32_t width) {
+    uint32_t digits = 1;
+    for (uint32_t v = value; v >= 10; v /= 10) digits++;
+    print_dec(value);
+    for (; digits < width; digits++) print_char(' ');
+}
+
+// One thread's line, copied under process_lock and printed after
+typedef struct {
+    uint32_t tid;
+    char name[32];
+    schedstat_t stats;
+} thread_info_t;
+
+typedef struct {
+    thread_info_t* info;
+    uint32_t count;
+    uint32_t max;
+} thread_snapshot_t;
+
+static void stat_count_process(process_t* proc, void* arg) {
+    *(uint32_t*)arg += proc->nr_threads;
+}
+
+static void stat_list_process(process_t* proc, void* arg) {
+    thread_snapshot_t* snap = (thread_snapshot_t*)arg;
+    
+    for (thread_t* thread = proc->threads; thread; thread = thread->group_next) {
+        if (snap->count >= snap->max) {
+            return;
+        }
+        thread_info_t* info = &snap->info[snap->count++];
+        info->tid = thread->tid;
+        memcpy(info->name, proc->name, sizeof(info->name));
+        info->stats = thread->stats;
+    }
+}
+
+static void stat_list_thread(const thread_info_t* info) {
+    if (info->tid < 10) print_char(' ');
+    print_dec(info->tid);
+    print_string("  ");
+    
+    print_string(info->name);
+    for (int j = strlen(info->name); j < 18; j++) {
+        print_char(' ');
+    }
+    
+    print_padded(info->stats.run_ms, 9);
+    print_padded(info->stats.wait_ms, 9);
+    print_padded(info->stats.nvcsw, 7);
+    print_padded(info->stats.nivcsw, 7);
+    print_padded(info->stats.migrations, 6);
+    print_dec(info->stats.lat_max_us);
+    print_string("\n");
+}
+
+// Print per-thread and system-wide scheduler statistics
+void scheduler_stat_list(void) {
+    static const char* bucket_names[SCHEDSTAT_LAT_BUCKETS] = {
+        "<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms"
+    };
+    sched_global_stats_t stats;
+    scheduler_get_stats(&stats);
+    
+    // Room for a few threads started between the count and the copy
+    thread_snapshot_t snap;
+    snap.max = 8;
+    snap.count = 0;
+    process_for_each(stat_count_process, &snap.max);
+    snap.info = (thread_info_t*)kmalloc(snap.max * sizeof(thread_info_t));
+    if (snap.info) {
+        process_for_each(stat_list_process, &snap);
+        for (uint32_t i = 0; i < snap.count; i++) {
+            stat_list_thread(&snap.info[i]);
+        }
+        kfree(snap.info);
+    }
+    
+    print_string("\nSwitches: ");
+    print_dec(stats.switches);
+    print_string(" (");
+    print_dec(stats.switches_per_sec);
+    print_string("/s)  Migrations: ");
+    print_dec(stats.migrations);
+    print_string("  Wakeups: ");
+    print_dec(stats.wakeups);
+    print_string("\n");
+    
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        print_string("CPU ");
+        print_dec(i);
+        print_string(": ");
+        print_dec(cpus[i].rq.nr_switches);
+        print_string(" switches, ");
+        print_dec(cpus[i].rq.nr_queued);
+        print_string(" queued\n");
+    }
+    
+    print_string("Wakeup latency (max ");
+    print_dec(stats.lat_max_us);
+    print_string("us):\n");
+    for (int b = 0; b < SCHEDSTAT_LAT_BUCKETS; b++) {
+        print_string("  ");
+        print_string(bucket_names[b]);
+        for (int j = strlen(bucket_names[b]); j < 9; j++) {
+            print_char(' ');
+        }
+        print_dec(stats.lat_hist[b]);
+        print_string("\n");
     }
 }
 
 // Initialize scheduler
 void scheduler_init(void) {
-    ready_queue_head = NULL;
-    ready_queue_tail = NULL;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        runqueue_t* rq = &cpus[i].rq;
+        
+        memset(rq, 0, sizeof(runqueue_t));
+        spin_lock_init(&rq->lock);
+        rq->cpu = i;
+    }
+    
+    // process_init() made the boot context the BSP's idle thread; it only
+    // runs when nothing else is ready and is never queued. Application
+    // processors create their own idle threads as they come up.
+    
+    open_softirq(SOFTIRQ_SCHED, sched_softirq);
     
-    // Register timer interrupt handler
-    irq_register_handler(0, scheduler_tick);
+    // The tick is delivered by the PIT driver (timer_callback), registering
+    // IRQ0 here as well would overwrite it
 }
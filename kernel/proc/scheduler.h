@@ -2,11 +2,64 @@
 #define SCHEDULER_H
 
 #include "process.h"
+#include "../drivers/timer/pit.h"
+
+// Timeslice in ticks for the highest and lowest priority
+#define SCHED_SLICE_MAX TIMER_MS_TO_TICKS(200)
+#define SCHED_SLICE_MIN TIMER_MS_TO_TICKS(20)
+
+// Maximum priority boost earned by tasks that block
+#define SCHED_MAX_BONUS 5
+
+// Admission control: deadline tasks may reserve at most 95% of the CPU.
+// Bandwidth is runtime/period in fixed point with DL_BW_SHIFT fraction bits.
+#define DL_BW_SHIFT 16
+#define DL_BW_LIMIT ((95 << DL_BW_SHIFT) / 100)
+
+// Longest deadline period in ticks (and so runtime and deadline), keeping
+// runtime << DL_BW_SHIFT within 32 bits; the same in milliseconds
+#define DL_PERIOD_MAX       0xFFFF
+#define DL_PERIOD_MAX_MS    (DL_PERIOD_MAX / TIMER_HZ * 1000)
+
+// Ticks between periodic load balancing passes on each CPU
+#define SCHED_BALANCE_INTERVAL TIMER_MS_TO_TICKS(100)
+
+// System-wide scheduler statistics, also returned by SYS_SCHEDSTAT
+typedef struct {
+    uint32_t switches;          // Context switches on all CPUs
+    uint32_t switches_per_sec;  // During the last second
+    uint32_t migrations;
+    uint32_t wakeups;
+    uint32_t lat_max_us;
+    uint32_t lat_hist[SCHEDSTAT_LAT_BUCKETS];
+} sched_global_stats_t;
+
+// Idle thread of the calling CPU
+#define idle_thread (cpu_current()->idle)
 
 void scheduler_init();
-void scheduler_add(process_t* proc);
-void scheduler_remove(process_t* proc);
+void scheduler_add(thread_t* thread);
+void scheduler_remove(thread_t* thread);
+void scheduler_exit(thread_t* thread);
+void scheduler_tick(registers_t* regs);
+void scheduler_ipi(registers_t* regs);
+void scheduler_finish_switch(void);
+uint32_t scheduler_select_cpu(void);
+void scheduler_block(void);
+void scheduler_wake(thread_t* thread);
+void scheduler_finish_wait(thread_t* thread);
+int scheduler_set_nice(thread_t* thread, int32_t nice);
+uint32_t scheduler_timeslice(uint32_t prio);
+int scheduler_set_deadline(thread_t* thread, uint32_t runtime,
+                           uint32_t period, uint32_t deadline);
+void scheduler_dl_list(void);
+void scheduler_get_stats(sched_global_stats_t* stats);
+void scheduler_stat_list(void);
+int scheduler_has_ready(void);
+uint32_t scheduler_next_event(uint32_t now);
 void schedule();
+// schedule() on the way out of an interrupt; see softirq.c irq_exit()
+void preempt_schedule(void);
 void yield();
 
-#endif
\ No newline at end of file
+#endif
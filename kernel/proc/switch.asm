@@ -1,3 +1,7 @@
+; void switch_context(uint32_t* old_esp, uint32_t new_esp)
+; Push the callee-saved state on the current stack, store ESP in *old_esp
+; and resume the thread whose ESP is new_esp. thread_alloc() primes new
+; stacks with the same frame.
 global switch_context
 
 switch_context:
@@ -0,0 +1,122 @@
+// kernel/proc/sync.c - Sleeping locks built on wait queues
+#include "sync.h"
+#include "../hal/smp.h"
+
+void mutex_init(mutex_t* mutex) {
+    mutex->locked = 0;
+    mutex->owner = NULL;
+    mutex->owner_cpu = 0;
+    wait_queue_init(&mutex->wq);
+}
+
+int mutex_trylock(mutex_t* mutex) {
+    uint32_t old = 1;
+    asm volatile("xchg %0, %1" : "+r"(old), "+m"(mutex->locked) :: "memory");
+    if (old != 0) {
+        return 0;
+    }
+    mutex->owner_cpu = cpu_current()->id;
+    mutex->owner = thread_get_current();
+    return 1;
+}
+
+// An owner running on another CPU will usually release the lock within
+// a few microseconds, far sooner than a sleep and wakeup would take. It
+// is running if it is still current where it took the lock; a migrated
+// owner merely ends the spin early.
+static int mutex_spin(mutex_t* mutex) {
+    if (cpu_count < 2) {
+        return 0;
+    }
+    
+    for (int i = 0; i < MUTEX_SPIN_LIMIT; i++) {
+        thread_t* owner = mutex->owner;
+        if (!mutex->locked) {
+            if (mutex_trylock(mutex)) {
+                return 1;
+            }
+        } else if (!owner || cpus[mutex->owner_cpu].current != owner) {
+            // Owner is not running: spinning cannot help
+            return 0;
+        }
+        asm volatile("pause");
+    }
+    return 0;
+}
+
+void mutex_lock(mutex_t* mutex) {
+    if (mutex_trylock(mutex) || mutex_spin(mutex)) {
+        return;
+    }
+    wait_event(mutex->wq, mutex_trylock(mutex));
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    mutex->owner = NULL;
+    asm volatile("" ::: "memory");
+    mutex->locked = 0;
+    wake_up_one(&mutex->wq);
+}
+
+void sem_init(semaphore_t* sem, int32_t count) {
+    spin_lock_init(&sem->lock);
+    sem->count = count;
+    wait_queue_init(&sem->wq);
+}
+
+int sem_trydown(semaphore_t* sem) {
+    int taken = 0;
+    uint32_t flags = spin_lock_irqsave(&sem->lock);
+    if (sem->count > 0) {
+        sem->count--;
+        taken = 1;
+    }
+    spin_unlock_irqrestore(&sem->lock, flags);
+    return taken;
+}
+
+void sem_down(semaphore_t* sem) {
+    wait_event(sem->wq, sem_trydown(sem));
+    
+    // A sem_up can pick us after we already took a count, so its own
+    // count may have nobody woken for it; hand it to the next waiter
+    if (sem->count > 0 && sem->wq.head) {
+        wake_up_one(&sem->wq);
+    }
+}
+
+void sem_up(semaphore_t* sem) {
+    uint32_t flags = spin_lock_irqsave(&sem->lock);
+    sem->count++;
+    spin_unlock_irqrestore(&sem->lock, flags);
+    wake_up_one(&sem->wq);
+}
+
+void cond_init(condvar_t* cond) {
+    wait_queue_init(&cond->wq);
+}
+
+// Queue before dropping the mutex so a signal sent right after the
+// unlock still finds us
+void cond_wait(condvar_t* cond, mutex_t* mutex) {
+    wait_entry_t entry = { NULL, NULL, NULL, 0 };
+    int can_block = prepare_to_wait(&cond->wq, &entry) == 0;
+    
+    mutex_unlock(mutex);
+    if (can_block) {
+        schedule();
+    } else {
+        asm volatile("hlt");
+    }
+    finish_wait(&cond->wq, &entry);
+    
+    mutex_lock(mutex);
+}
+
+void cond_signal(condvar_t* cond) {
+    wake_up_one(&cond->wq);
+}
+
+void cond_broadcast(condvar_t* cond) {
+    wake_up_all(&cond->wq);
+}
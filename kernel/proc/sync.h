@@ -0,0 +1,55 @@
+// kernel/proc/sync.h - Sleeping locks: mutexes, semaphores, condition variables
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "../../include/types.h"
+#include "wait.h"
+
+// Spin iterations while the owner is running on another CPU before the
+// waiter goes to sleep
+#define MUTEX_SPIN_LIMIT 1000
+
+// owner is only ever compared, never followed: it may exit and be freed
+// while a waiter is looking at it
+typedef struct {
+    volatile uint32_t locked;
+    thread_t* volatile owner;
+    volatile uint32_t owner_cpu; // CPU owner took the lock on
+    wait_queue_t wq;
+} mutex_t;
+
+#define MUTEX_INIT { 0, NULL, 0, WAIT_QUEUE_INIT }
+
+void mutex_init(mutex_t* mutex);
+int mutex_trylock(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+// Counting semaphore
+typedef struct {
+    spinlock_t lock;
+    int32_t count;
+    wait_queue_t wq;
+} semaphore_t;
+
+#define SEMAPHORE_INIT(n) { SPINLOCK_INIT, (n), WAIT_QUEUE_INIT }
+
+void sem_init(semaphore_t* sem, int32_t count);
+int sem_trydown(semaphore_t* sem);
+void sem_down(semaphore_t* sem);
+void sem_up(semaphore_t* sem);
+
+// Condition variable, used with a mutex. Wakeups may be spurious: always
+// wait in a loop that rechecks the predicate.
+typedef struct {
+    wait_queue_t wq;
+} condvar_t;
+
+#define CONDVAR_INIT { WAIT_QUEUE_INIT }
+
+void cond_init(condvar_t* cond);
+void cond_wait(condvar_t* cond, mutex_t* mutex);
+void cond_signal(condvar_t* cond);
+void cond_broadcast(condvar_t* cond);
+
+#endif // SYNC_H
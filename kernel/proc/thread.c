@@ -0,0 +1,296 @@
+// kernel/proc/thread.c - Thread creation, exit and thread-local storage
+//
+// A new thread's kernel stack is primed with the frame switch_context
+// pops, so its first switch-in "returns" into thread_entry(), which
+// finishes the switch and calls the thread body (or drops to ring 3).
+// A thread cannot free the stack it runs on: an exiting thread marks
+// itself terminated and switches away for good, and the scheduler reaps
+// it once the next thread is running on that CPU.
+#include "thread.h"
+#include "process.h"
+#include "scheduler.h"
+#include "fpu.h"
+#include "wait.h"
+#include "../mm/heap.h"
+#include "../hal/gdt.h"
+#include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../drivers/timer/pit.h"
+#include "../drivers/timer/timer_wheel.h"
+#include "../../lib/libc/string.h"
+
+static hash_node_t* tid_buckets[1 << PID_HASH_BITS];
+static hashtable_t tid_hash;
+static spinlock_t tid_lock = SPINLOCK_INIT;
+
+void thread_init(void) {
+    hashtable_init(&tid_hash, tid_buckets, PID_HASH_BITS);
+}
+
+// Drop to ring 3 at the thread's entry point with arg as its argument;
+// never returns
+static void enter_user(thread_t* self, uint32_t arg) {
+    uint32_t* sp = (uint32_t*)self->user_stack;
+    *--sp = arg;
+    *--sp = 0;      // Return address: returning from entry faults
+    
+    asm volatile(
+        "cli\n"
+        "mov $0x23, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%fs\n"
+        "pushl $0x23\n"         // SS
+        "pushl %1\n"            // ESP
+        "pushl $0x202\n"        // EFLAGS, interrupts on
+        "pushl $0x1B\n"         // CS
+        "pushl %0\n"            // EIP
+        "iret\n"
+        :
+        : "r"(self->user_entry), "r"(sp)
+        : "eax", "memory"
+    );
+}
+
+// First code a new thread runs, entered by the ret in switch_context
+static void thread_entry(void) {
+    thread_t* self = current_thread;
+    
+    scheduler_finish_switch();
+    if (self->killed) {
+        thread_exit();
+    }
+    asm volatile("sti");
+    
+    if (self->user_entry) {
+        enter_user(self, (uint32_t)self->arg);
+    } else {
+        self->entry(self->arg);
+    }
+    thread_exit();
+}
+
+thread_t* thread_alloc(process_t* proc, uint32_t tid, int with_stack) {
+    thread_t* thread = (thread_t*)kmalloc(sizeof(thread_t));
+    if (!thread) {
+        return NULL;
+    }
+    memset(thread, 0, sizeof(thread_t));
+    
+    if (with_stack) {
+        uint8_t* stack = (uint8_t*)kmalloc(THREAD_STACK_SIZE);
+        if (!stack) {
+            kfree(thread);
+            return NULL;
+        }
+        thread->kernel_stack = (uint32_t)stack + THREAD_STACK_SIZE;
+        
+        // Frame popped by switch_context: edi, esi, ebx, eflags, ebp, eip
+        uint32_t* sp = (uint32_t*)thread->kernel_stack;
+        *--sp = 0;                          // thread_entry's return address
+        *--sp = (uint32_t)thread_entry;
+        *--sp = 0;                          // ebp
+        *--sp = 0x002;                      // eflags: interrupts off
+        *--sp = 0;                          // ebx
+        *--sp = 0;                          // esi
+        *--sp = 0;                          // edi
+        thread->context = (uint32_t)sp;
+    }
+    
+    thread->tid = tid;
+    thread->proc = proc;
+    thread->state = THREAD_READY;
+    thread->created_at = timer_get_ticks();
+    thread->static_prio = SCHED_PRIO_DEFAULT;
+    thread->prio = SCHED_PRIO_DEFAULT;
+    thread->time_slice = scheduler_timeslice(thread->static_prio);
+    
+    uint32_t flags = spin_lock_irqsave(&tid_lock);
+    hashtable_add(&tid_hash, &thread->tid_node, tid);
+    spin_unlock_irqrestore(&tid_lock, flags);
+    
+    process_add_thread(proc, thread);
+    return thread;
+}
+
+void thread_start(thread_t* thread) {
+    thread->cpu = scheduler_select_cpu();
+    scheduler_add(thread);
+}
+
+// Allocate a thread that inherits the caller's priority and TLS when
+// created from within the same process
+static thread_t* thread_new(process_t* proc) {
+    if (!proc || proc->exiting) {
+        return NULL;
+    }
+    
+    // A process's first thread takes the PID
+    int32_t tid = proc->nr_threads ? pid_alloc() : (int32_t)proc->pid;
+    if (tid < 0) {
+        print_string("[PROC] Error: No free thread ID\n");
+        return NULL;
+    }
+    
+    thread_t* thread = thread_alloc(proc, (uint32_t)tid, 1);
+    if (!thread) {
+        print_string("[PROC] Error: Failed to allocate thread\n");
+        if ((uint32_t)tid != proc->pid) {
+            pid_free((uint32_t)tid);
+        }
+        return NULL;
+    }
+    
+    thread_t* self = current_thread;
+    if (self && self->proc == proc) {
+        thread->nice = self->nice;
+        thread->static_prio = self->static_prio;
+        thread->prio = self->static_prio;
+        thread->time_slice = scheduler_timeslice(thread->static_prio);
+        thread->tls_base = self->tls_base;
+    }
+    return thread;
+}
+
+thread_t* thread_create(process_t* proc, void (*entry)(void*), void* arg) {
+    thread_t* thread = thread_new(proc);
+    if (!thread) {
+        return NULL;
+    }
+    
+    thread->entry = entry;
+    thread->arg = arg;
+    thread_start(thread);
+    return thread;
+}
+
+thread_t* thread_create_on(process_t* proc, void (*entry)(void*),
+                           void* arg, uint32_t cpu) {
+    thread_t* thread = thread_new(proc);
+    if (!thread) {
+        return NULL;
+    }
+    
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->cpu = cpu;
+    thread->pinned = 1;
+    scheduler_add(thread);
+    return thread;
+}
+
+thread_t* thread_create_user(process_t* proc, uint32_t entry, uint32_t stack,
+                             uint32_t arg, uint32_t tls) {
+    thread_t* thread = thread_new(proc);
+    if (!thread) {
+        return NULL;
+    }
+    
+    thread->user_entry = entry;
+    thread->user_stack = stack;
+    thread->arg = (void*)arg;
+    if (tls) {
+        thread->tls_base = tls;
+    }
+    thread_start(thread);
+    return thread;
+}
+
+void thread_exit(void) {
+    thread_t* self = current_thread;
+    if (!self || self == idle_thread) return;
+    
+    asm volatile("cli");
+    
+    // Anything still pointing at our stack must forget us first, and a
+    // wakeup meant for us goes to the next waiter instead
+    if (self->wait_queue) {
+        wait_queue_t* wq = self->wait_queue;
+        if (finish_wait(wq, self->wait_entry)) {
+            wake_up_one(wq);
+        }
+    }
+    if (self->sleep_timer) {
+        timer_cancel(self->sleep_timer);
+        self->sleep_timer = NULL;
+    }
+    
+    scheduler_exit(self);
+    self->state = THREAD_TERMINATED;
+    schedule();
+    
+    // Reaped by the next thread to run on this CPU
+    for (;;) asm volatile("hlt");
+}
+
+// Killing is deferred to points where the thread holds nothing: a
+// thread preempted in the kernel may own a mutex that must be released.
+void thread_kill(thread_t* thread) {
+    if (!thread || thread == cpus[thread->cpu].idle) return;
+    
+    thread->killed = 1;
+    
+    // A sleeper is woken to exit; one running elsewhere is interrupted
+    scheduler_wake(thread);
+    if (thread->on_cpu && thread->cpu != cpu_current()->id) {
+        smp_send_reschedule(thread->cpu);
+    }
+}
+
+void thread_testcancel(void) {
+    if (current_thread->killed) {
+        thread_exit();
+    }
+}
+
+void thread_exit_to_user(registers_t* regs) {
+    if ((regs->cs & 3) == 3 && current_thread->killed) {
+        thread_exit();
+    }
+}
+
+void thread_reap(thread_t* thread) {
+    process_t* proc = thread->proc;
+    
+    uint32_t flags = spin_lock_irqsave(&tid_lock);
+    hashtable_del(&tid_hash, &thread->tid_node);
+    spin_unlock_irqrestore(&tid_lock, flags);
+    
+    // The first thread's ID is the PID, released with the process
+    if (thread->tid != proc->pid) {
+        pid_free(thread->tid);
+    }
+    
+    fpu_release(thread);
+    if (thread->kernel_stack) {
+        kfree((void*)(thread->kernel_stack - THREAD_STACK_SIZE));
+    }
+    
+    process_remove_thread(proc, thread);
+    kfree(thread);
+}
+
+int thread_get_stats(uint32_t tid, schedstat_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&tid_lock);
+    hash_node_t* node = hashtable_find(&tid_hash, tid);
+    if (node) {
+        *stats = hash_entry(node, thread_t, tid_node)->stats;
+    }
+    spin_unlock_irqrestore(&tid_lock, flags);
+    
+    return node ? 0 : -1;
+}
+
+thread_t* thread_get_current(void) {
+    return current_thread;
+}
+
+void thread_set_tls(uint32_t base) {
+    thread_t* self = current_thread;
+    if (!self) return;
+    
+    uint32_t flags = cpu_irq_save();
+    self->tls_base = base;
+    gdt_set_tls(base);
+    cpu_irq_restore(flags);
+}
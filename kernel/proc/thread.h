@@ -0,0 +1,175 @@
+// kernel/proc/thread.h - Threads: the unit the scheduler runs
+//
+// A thread owns its registers (saved on its kernel stack), its scheduling
+// state and its thread-local storage segment. Everything shared between
+// the threads of a program (address space, identity) lives in process_t.
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "../../include/types.h"
+#include "../hal/isr.h"
+#include "../hal/smp.h"
+#include "runqueue.h"
+#include "../../lib/libk/hashtable.h"
+
+// Room for a nested interrupt on top of softirqs run at IRQ exit
+#define THREAD_STACK_SIZE 8192
+
+// Nice 0 maps to SCHED_PRIO_DEFAULT (SCHED_PRIO_LEVELS in runqueue.h)
+#define SCHED_PRIO_DEFAULT 16
+#define NICE_MIN (-SCHED_PRIO_DEFAULT)
+#define NICE_MAX (SCHED_PRIO_LEVELS - 1 - SCHED_PRIO_DEFAULT)
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_TERMINATED
+} thread_state_t;
+
+// Scheduling classes
+#define SCHED_NORMAL   0
+#define SCHED_DEADLINE 1
+
+// Earliest-deadline-first parameters and per-job state, all in ticks
+typedef struct {
+    uint32_t runtime;       // Budget per period
+    uint32_t period;
+    uint32_t deadline;      // Relative to job release
+    uint32_t abs_deadline;  // Deadline of the current job
+    uint32_t next_release;  // Start of the next period
+    uint32_t budget;        // Runtime left in the current job
+    uint8_t throttled;      // Out of budget or job done, wait for release
+    uint8_t job_done;
+    uint8_t missed;         // Current job already counted as a miss
+    uint32_t jobs;
+    uint32_t misses;
+    uint32_t overruns;      // Jobs that exhausted their budget
+    struct thread* dl_next; // List of all deadline tasks
+} sched_dl_t;
+
+// Per-thread scheduler statistics, also returned by SYS_SCHEDSTAT
+typedef struct {
+    uint32_t run_ms;        // Time on a CPU
+    uint32_t wait_ms;       // Time runnable but waiting on a run queue
+    uint32_t run_count;     // Times switched in
+    uint32_t nvcsw;         // Voluntary switches (blocked or yielded)
+    uint32_t nivcsw;        // Involuntary switches (preempted)
+    uint32_t migrations;    // Moves to another CPU's run queue
+    uint32_t wakeups;
+    uint32_t lat_max_us;    // Worst wakeup-to-run latency
+    uint32_t lat_hist[SCHEDSTAT_LAT_BUCKETS];
+} schedstat_t;
+
+// Timestamps behind schedstat_t, in timer_clock_us() microseconds
+typedef struct {
+    uint32_t queued_at;     // Made runnable
+    uint32_t arrived_at;    // Last switched in
+    uint16_t run_rem_us;    // Sub-millisecond parts of run_ms and wait_ms
+    uint16_t wait_rem_us;
+    uint8_t queued;         // Waiting since queued_at
+    uint8_t woken;          // Queued by a wakeup, count its latency
+    uint8_t yielded;        // Gave up the CPU in yield()
+} sched_info_t;
+
+struct process;
+struct wait_queue;
+struct wait_entry;
+struct ktimer;
+
+typedef struct thread {
+    uint32_t tid;
+    thread_state_t state;
+    uint32_t context;       // Saved ESP while switched out (switch.asm)
+    uint32_t kernel_stack;  // Top of the kernel stack, 0 for a CPU's boot stack
+    uint32_t tls_base;      // Base of the %gs segment
+    void (*entry)(void*);   // Kernel thread body
+    void* arg;
+    uint32_t user_entry;    // Ring 3 start address, 0 for kernel threads
+    uint32_t user_stack;
+    registers_t* syscall_regs; // Frame of the system call in progress
+    volatile uint8_t killed; // Exit on the way back to user mode
+    uint32_t created_at;
+    uint32_t cpu_time;
+    int32_t nice;
+    uint32_t static_prio;   // SCHED_PRIO_DEFAULT + nice
+    uint32_t prio;          // Effective priority (static minus sleep bonus)
+    uint32_t sleep_bonus;   // Earned by blocking, spent by using full slices
+    uint32_t time_slice;    // Ticks left in the current slice
+    uint32_t policy;        // SCHED_NORMAL or SCHED_DEADLINE
+    sched_dl_t dl;
+    uint32_t cpu;           // CPU whose run queue owns this thread
+    volatile uint8_t on_cpu; // Set from switch-in until switched out
+    uint8_t pinned;         // Never moved off cpu by the load balancer
+    schedstat_t stats;
+    sched_info_t sched_info;
+    uint8_t* fpu_state;     // FXSAVE area, allocated on first FPU use
+    void* fpu_alloc;        // Unaligned allocation backing fpu_state
+    
+    // What a blocked thread sleeps on, so an exiting thread can detach
+    struct wait_queue* wait_queue;
+    struct wait_entry* wait_entry;
+    struct ktimer* sleep_timer;
+    
+    struct process* proc;
+    struct thread* next;    // Run queue links
+    struct thread* prev;
+    struct thread* group_next; // Other threads of the same process
+    struct thread* group_prev;
+    hash_node_t tid_node;   // Entry in the tid hash
+} thread_t;
+
+// The thread running on the calling CPU
+#define current_thread (cpu_current()->current)
+
+void thread_init(void);
+
+// Start a kernel thread in proc running entry(arg)
+thread_t* thread_create(struct process* proc, void (*entry)(void*), void* arg);
+
+// Start a kernel thread bound to one CPU (per-CPU service threads)
+thread_t* thread_create_on(struct process* proc, void (*entry)(void*),
+                           void* arg, uint32_t cpu);
+
+// Start a ring 3 thread in proc at entry with esp at stack; arg is pushed
+// as the single argument. A non-zero tls becomes its %gs base.
+thread_t* thread_create_user(struct process* proc, uint32_t entry,
+                             uint32_t stack, uint32_t arg, uint32_t tls);
+
+// Allocate a thread with the given TID and make it visible, without
+// starting it; used for the first thread of a process (TID == PID) and
+// for idle threads, which wrap the boot stack (with_stack 0)
+thread_t* thread_alloc(struct process* proc, uint32_t tid, int with_stack);
+
+// Place a new thread on a CPU and make it runnable
+void thread_start(thread_t* thread);
+
+// Terminate the calling thread; the process goes with its last thread
+void thread_exit(void);
+
+// Ask another thread to exit. A blocked thread is woken; a user thread
+// exits on its next way back to ring 3 (thread_exit_to_user), a kernel
+// thread at a thread_testcancel() of its own.
+void thread_kill(thread_t* thread);
+
+// Exit if the calling thread was killed. Only call this where the caller
+// holds no lock, e.g. at the top of a service loop.
+void thread_testcancel(void);
+
+// End of every interrupt, exception and system call: a killed thread about
+// to return to ring 3 through regs holds nothing and exits instead
+void thread_exit_to_user(registers_t* regs);
+
+// Free a thread that has been switched out for the last time (scheduler)
+void thread_reap(thread_t* thread);
+
+// Copy thread tid's statistics; -1 if there is no such thread. A thread
+// looked up by ID could be reaped as soon as the lookup returned, so only
+// a snapshot taken under the ID lock is handed out.
+int thread_get_stats(uint32_t tid, schedstat_t* stats);
+thread_t* thread_get_current(void);
+
+// Set the calling thread's %gs base
+void thread_set_tls(uint32_t base);
+
+#endif // THREAD_H
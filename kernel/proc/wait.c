@@ -0,0 +1,108 @@
+// kernel/proc/wait.c - Wait queues
+//
+// A waiter queues itself and sets THREAD_BLOCKED before testing its
+// condition; a waker dequeues entries and calls scheduler_wake. If the
+// wakeup lands before the waiter reaches schedule(), the waiter is simply
+// requeued on its run queue and schedule() picks it straight back up.
+// An interrupt that preempts the waiter in that window leaves it runnable
+// (preempt_schedule), so it still gets to test the condition.
+#include "wait.h"
+#include "scheduler.h"
+
+void wait_queue_init(wait_queue_t* wq) {
+    spin_lock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+static void entry_unlink(wait_queue_t* wq, wait_entry_t* entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        wq->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        wq->tail = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->queued = 0;
+}
+
+int prepare_to_wait(wait_queue_t* wq, wait_entry_t* entry) {
+    thread_t* current = current_thread;
+    
+    if (!current || current == idle_thread) {
+        entry->thread = NULL;
+        entry->queued = 0;
+        return -1;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    
+    if (!entry->queued) {
+        entry->thread = current;
+        entry->next = NULL;
+        entry->prev = wq->tail;
+        if (wq->tail) {
+            wq->tail->next = entry;
+        } else {
+            wq->head = entry;
+        }
+        wq->tail = entry;
+        entry->queued = 1;
+    }
+    current->state = THREAD_BLOCKED;
+    current->wait_queue = wq;
+    current->wait_entry = entry;
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return 0;
+}
+
+int finish_wait(wait_queue_t* wq, wait_entry_t* entry) {
+    thread_t* thread = entry->thread;
+    if (!thread) {
+        return 0;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    int woken = !entry->queued;
+    if (entry->queued) {
+        entry_unlink(wq, entry);
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    
+    thread->wait_queue = NULL;
+    thread->wait_entry = NULL;
+    scheduler_finish_wait(thread);
+    return woken;
+}
+
+void wake_up_one(wait_queue_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    
+    wait_entry_t* entry = wq->head;
+    if (entry) {
+        thread_t* thread = entry->thread;
+        entry_unlink(wq, entry);
+        scheduler_wake(thread);
+    }
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wake_up_all(wait_queue_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    
+    while (wq->head) {
+        wait_entry_t* entry = wq->head;
+        thread_t* thread = entry->thread;
+        entry_unlink(wq, entry);
+        scheduler_wake(thread);
+    }
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
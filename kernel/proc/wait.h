@@ -0,0 +1,69 @@
+// kernel/proc/wait.h - Wait queues
+#ifndef WAIT_H
+#define WAIT_H
+
+#include "../../include/types.h"
+#include "../core/spinlock.h"
+#include "thread.h"
+
+// One sleeping thread; lives on the sleeper's stack
+typedef struct wait_entry {
+    thread_t* thread;
+    struct wait_entry* next;
+    struct wait_entry* prev;
+    uint8_t queued;
+} wait_entry_t;
+
+typedef struct wait_queue {
+    spinlock_t lock;
+    wait_entry_t* head;
+    wait_entry_t* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, NULL, NULL }
+
+void wait_queue_init(wait_queue_t* wq);
+
+// From scheduler.h, for wait_event(). Not included: process.h embeds a
+// mutex and so depends on this header.
+void schedule();
+
+// Queue the caller on wq and mark it blocked. Returns -1 if the caller
+// cannot block (the idle/boot context), which must then poll instead.
+int prepare_to_wait(wait_queue_t* wq, wait_entry_t* entry);
+
+// Leave wq and become runnable again, whether or not we slept. Returns 1
+// if a waker had already dequeued the entry, i.e. the caller holds a
+// wakeup it must pass on with wake_up_one() if it will not act on it.
+int finish_wait(wait_queue_t* wq, wait_entry_t* entry);
+
+// Wake the longest waiting thread / every thread on wq
+void wake_up_one(wait_queue_t* wq);
+void wake_up_all(wait_queue_t* wq);
+
+// Block until condition is true. The condition is rechecked after queueing
+// so a wakeup between the check and the sleep is never lost.
+#define wait_event(wq, condition)                                       \
+    do {                                                                \
+        wait_entry_t __entry = { NULL, NULL, NULL, 0 };                 \
+        for (;;) {                                                      \
+            int __can_block = prepare_to_wait(&(wq), &__entry) == 0;    \
+            if (condition) {                                            \
+                break;                                                  \
+            }                                                           \
+            if (__can_block) {                                          \
+                schedule();                                             \
+            } else {                                                    \
+                asm volatile("hlt");                                    \
+            }                                                           \
+        }                                                               \
+        finish_wait(&(wq), &__entry);                                   \
+    } while (0)
+
+// wait_event that also gives up once the caller is killed (thread_kill),
+// so a killed thread gets back to a point where it can exit. The caller
+// checks current_thread->killed to tell the two apart.
+#define wait_event_killable(wq, condition)                              \
+    wait_event(wq, (condition) || current_thread->killed)
+
+#endif // WAIT_H
@@ -0,0 +1,147 @@
+// kernel/proc/workqueue.c - Deferred work run by kernel threads
+//
+// Each workqueue is a process whose threads take work items off a shared
+// FIFO. Queueing is a list append and a wakeup, so interrupt handlers and
+// softirqs can push anything that needs to sleep (take a mutex, wait for
+// I/O) out to thread context.
+#include "workqueue.h"
+#include "process.h"
+#include "thread.h"
+#include "../core/monitor.h"
+#include "../mm/heap.h"
+#include "../hal/smp.h"
+#include "../../lib/libc/string.h"
+
+workqueue_t* system_wq = NULL;
+
+static workqueue_t* workqueues = NULL;
+static spinlock_t workqueues_lock = SPINLOCK_INIT;
+
+static work_t* dequeue_work(workqueue_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    
+    work_t* work = wq->head;
+    if (work) {
+        wq->head = work->next;
+        if (!wq->head) {
+            wq->tail = NULL;
+        }
+        work->next = NULL;
+        work->pending = 0;      // May be queued again while it runs
+    }
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return work;
+}
+
+static void worker_main(void* arg) {
+    workqueue_t* wq = (workqueue_t*)arg;
+    
+    for (;;) {
+        wait_event(wq->wait, wq->head != NULL);
+        
+        work_t* work = dequeue_work(wq);
+        if (!work) {
+            continue;
+        }
+        
+        work->func(work);
+        
+        uint32_t flags = spin_lock_irqsave(&wq->lock);
+        wq->completed++;
+        spin_unlock_irqrestore(&wq->lock, flags);
+    }
+}
+
+workqueue_t* workqueue_create(const char* name, uint32_t nr_workers) {
+    workqueue_t* wq = (workqueue_t*)kmalloc(sizeof(workqueue_t));
+    if (!wq) {
+        return NULL;
+    }
+    memset(wq, 0, sizeof(workqueue_t));
+    strncpy(wq->name, name, sizeof(wq->name) - 1);
+    spin_lock_init(&wq->lock);
+    wait_queue_init(&wq->wait);
+    
+    process_t* proc = process_create_kernel(name);
+    if (!proc) {
+        kfree(wq);
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < nr_workers; i++) {
+        if (thread_create(proc, worker_main, wq)) {
+            wq->nr_workers++;
+        }
+    }
+    if (wq->nr_workers == 0) {
+        print_string("[WQ] Error: No workers for ");
+        print_string(name);
+        print_string("\n");
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&workqueues_lock);
+    wq->next = workqueues;
+    workqueues = wq;
+    spin_unlock_irqrestore(&workqueues_lock, flags);
+    
+    return wq;
+}
+
+void workqueue_init(void) {
+    system_wq = workqueue_create("events", cpu_count);
+}
+
+void work_init(work_t* work, void (*func)(work_t* work)) {
+    work->next = NULL;
+    work->func = func;
+    work->pending = 0;
+}
+
+int queue_work(workqueue_t* wq, work_t* work) {
+    if (!wq) {
+        return 0;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (work->pending) {
+        spin_unlock_irqrestore(&wq->lock, flags);
+        return 0;
+    }
+    
+    work->pending = 1;
+    work->next = NULL;
+    if (wq->tail) {
+        wq->tail->next = work;
+    } else {
+        wq->head = work;
+    }
+    wq->tail = work;
+    wq->queued++;
+    spin_unlock_irqrestore(&wq->lock, flags);
+    
+    wake_up_one(&wq->wait);
+    return 1;
+}
+
+int schedule_work(work_t* work) {
+    return queue_work(system_wq, work);
+}
+
+void workqueue_stat_list(void) {
+    uint32_t flags = spin_lock_irqsave(&workqueues_lock);
+    for (workqueue_t* wq = workqueues; wq; wq = wq->next) {
+        print_string("  ");
+        print_string(wq->name);
+        for (int j = strlen(wq->name); j < 16; j++) {
+            print_char(' ');
+        }
+        print_dec(wq->nr_workers);
+        print_string(" workers, ");
+        print_dec(wq->queued);
+        print_string(" queued, ");
+        print_dec(wq->completed);
+        print_string(" done\n");
+    }
+    spin_unlock_irqrestore(&workqueues_lock, flags);
+}
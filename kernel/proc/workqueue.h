@@ -0,0 +1,49 @@
+// kernel/proc/workqueue.h - Deferred work run by kernel threads
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "../../include/types.h"
+#include "../core/spinlock.h"
+#include "wait.h"
+
+// Unlike softirqs and tasklets, work items run in a worker thread and
+// may sleep. A work item is queued at most once until it starts running.
+typedef struct work {
+    struct work* next;
+    void (*func)(struct work* work);
+    volatile uint8_t pending;
+} work_t;
+
+#define WORK_INIT(func) { NULL, func, 0 }
+
+typedef struct workqueue {
+    char name[16];
+    spinlock_t lock;
+    work_t* head;
+    work_t* tail;
+    wait_queue_t wait;          // Idle workers
+    uint32_t nr_workers;
+    uint32_t queued;            // Work items queued / completed
+    uint32_t completed;
+    struct workqueue* next;     // List of all workqueues
+} workqueue_t;
+
+// Shared queue for work that does not need its own workers
+extern workqueue_t* system_wq;
+
+// Create system_wq; needs the scheduler and SMP
+void workqueue_init(void);
+
+// Create a queue served by nr_workers kernel threads
+workqueue_t* workqueue_create(const char* name, uint32_t nr_workers);
+
+void work_init(work_t* work, void (*func)(work_t* work));
+
+// Queue work; safe from any context. Returns 0 if it was already pending.
+int queue_work(workqueue_t* wq, work_t* work);
+int schedule_work(work_t* work);
+
+// Print queued/completed counts of every workqueue (shell irqstat)
+void workqueue_stat_list(void);
+
+#endif // WORKQUEUE_H
@@ -6,8 +6,15 @@
 #include "../mm/heap.h"
 #include "../proc/process.h"
 #include "../proc/scheduler.h"
+#include "../proc/workqueue.h"
+#include "../proc/exec.h"
+#include "../mm/vmm.h"
+#include "../syscall/trace.h"
+#include "../core/softirq.h"
+#include "../hal/irq.h"
 #include "../fs/vfs.h"
 #include "../usermode/usermode.h"
+#include "../gui/gui.h"
 #include "../../lib/libc/string.h"
 
 extern fs_node_t* fs_root;
@@ -31,10 +38,18 @@ static void shell_help(void) {
     print_string("  clear    - Clear screen\n");
     print_string("  uptime   - Show system uptime\n");
     print_string("  meminfo  - Show memory information\n");
+    print_string("  idlestat - Show idle residency and timer wakeups\n");
     print_string("  ps       - List processes\n");
     print_string("  spawn    - Spawn test processes\n");
+    print_string("  rtstat   - Deadline task statistics\n");
+    print_string("  schedstat - Switches, run/wait time and wakeup latency\n");
+    print_string("  irqstat  - Interrupt, softirq and workqueue statistics\n");
+    print_string("  sysstat  - Syscall counts and latency [on|off|reset]\n");
+    print_string("  strace   - Show a process's syscalls [on|off] <pid>\n");
+    print_string("  gui      - Start the GUI compositor\n");
     print_string("  ls       - List files\n");
     print_string("  cat      - Display file contents\n");
+    print_string("  exec     - Run an ELF executable\n");
     print_string("  syscall  - Test system calls\n");
     print_string("  usermode - Test user mode\n");
     print_string("  echo     - Echo text\n");
@@ -56,6 +71,36 @@ static void shell_uptime(void) {
     print_string("s\n");
 }
 
+static void shell_idlestat(void) {
+    timer_stats_t stats;
+    timer_get_stats(&stats);
+    
+    print_string("Tick source:    ");
+    print_string(stats.clock);
+    print_string(", ");
+    print_dec(TIMER_HZ);
+    print_string("Hz\n");
+    print_string("Dynamic ticks:  ");
+    print_string(stats.nohz ? "on\n" : "off\n");
+    print_string("Idle residency: ");
+    print_dec(stats.idle_percent);
+    print_string("% (last second)\n");
+    print_string("Wakeups:        ");
+    print_dec(stats.wakeups_per_sec);
+    print_string("/s (last second)\n");
+    print_string("Idle ticks:     ");
+    print_dec(stats.idle_ticks);
+    print_string(" of ");
+    print_dec(timer_get_ticks());
+    print_string("\n");
+    print_string("Timer IRQs:     ");
+    print_dec(stats.timer_irqs);
+    print_string("\n");
+    print_string("Pending timers: ");
+    print_dec(stats.pending_timers);
+    print_string("\n");
+}
+
 static void shell_meminfo(void) {
     print_string("Physical Memory:\n");
     print_string("  Total: ");
@@ -75,14 +120,96 @@ static void shell_meminfo(void) {
     print_string("  Free:  ");
     print_dec(heap_get_free() / 1024);
     print_string(" KB\n");
+    
+    print_string("\nShared program text:\n");
+    vmm_image_list();
 }
 
 static void shell_ps(void) {
-    print_string("PID  Name              State    CPU Time\n");
-    print_string("---  ----------------  -------  --------\n");
+    print_string("PID  Name              Thr  State    CPU Time       WSS\n");
+    print_string("---  ----------------  ---  -------  -------------  --------\n");
     process_list();
 }
 
+static void shell_rtstat(void) {
+    print_string("PID  Name              Run/Dl/Period  Stats\n");
+    print_string("---  ----------------  -------------  -----\n");
+    scheduler_dl_list();
+}
+
+static void shell_schedstat(void) {
+    print_string("TID  Name              Run ms   Wait ms  Vol    Invol  Migr  Max lat us\n");
+    print_string("---  ----------------  -------  -------  -----  -----  ----  ----------\n");
+    scheduler_stat_list();
+}
+
+static void shell_irqstat(void) {
+    print_string("  CPU  HardIRQs  Hard ms  Max us  Soft ms  Max us  Tasklets  ksoftirqd\n");
+    print_string("  ---  --------  -------  ------  -------  ------  --------  ---------\n");
+    softirq_stat_list();
+    print_string("\nThreaded IRQs:\n");
+    print_string("  IRQ  Name            Nice\n");
+    irq_thread_stat_list();
+    print_string("\nWorkqueues:\n");
+    workqueue_stat_list();
+}
+
+// Decimal number at the start of s, -1 if there is none
+static int32_t parse_number(const char* s) {
+    if (*s < '0' || *s > '9') {
+        return -1;
+    }
+    int32_t n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+    }
+    return n;
+}
+
+static void shell_sysstat(const char* args) {
+    if (strcmp(args, "on") == 0) {
+        systrace_stats_enable(1);
+    } else if (strcmp(args, "off") == 0) {
+        systrace_stats_enable(0);
+    } else if (strcmp(args, "reset") == 0) {
+        systrace_stats_reset();
+    } else if (args[0] != '\0') {
+        print_string("Usage: sysstat [on|off|reset]\n");
+        return;
+    }
+    systrace_stat_list();
+}
+
+static void shell_strace(const char* args) {
+    int mode = 0;               // 1: start, -1: stop, 0: show
+    if (memcmp(args, "on ", 3) == 0) {
+        mode = 1;
+        args += 3;
+    } else if (memcmp(args, "off ", 4) == 0) {
+        mode = -1;
+        args += 4;
+    }
+    
+    int32_t pid = parse_number(args);
+    if (pid < 0) {
+        print_string("Usage: strace [on|off] <pid>\n");
+        return;
+    }
+    
+    int result;
+    if (mode > 0) {
+        result = systrace_attach(pid);
+    } else if (mode < 0) {
+        result = systrace_detach(pid);
+    } else {
+        print_string("Tick    TID   Call\n");
+        result = systrace_dump(pid);
+    }
+    if (result < 0) {
+        print_string("Error: No such process or no trace\n");
+    }
+}
+
 static void test_process_a(void) {
     for (int i = 0; i < 10; i++) {
         print_string("[Process A] Running iteration ");
@@ -161,6 +288,19 @@ static void shell_cat(const char* filename) {
     print_char('\n');
 }
 
+static void shell_exec(const char* path) {
+    if (!path || path[0] == '\0') {
+        print_string("Usage: exec <file>\n");
+        return;
+    }
+    
+    if (process_exec(path) < 0) {
+        print_string("Error: Could not start ");
+        print_string(path);
+        print_string("\n");
+    }
+}
+
 static void shell_echo(const char* text) {
     if (text && text[0] != '\0') {
         print_string(text);
@@ -260,14 +400,30 @@ static void shell_execute(const char* command) {
         shell_uptime();
     } else if (strcmp(cmd, "meminfo") == 0) {
         shell_meminfo();
+    } else if (strcmp(cmd, "idlestat") == 0) {
+        shell_idlestat();
     } else if (strcmp(cmd, "ps") == 0) {
         shell_ps();
     } else if (strcmp(cmd, "spawn") == 0) {
         shell_spawn();
+    } else if (strcmp(cmd, "rtstat") == 0) {
+        shell_rtstat();
+    } else if (strcmp(cmd, "schedstat") == 0) {
+        shell_schedstat();
+    } else if (strcmp(cmd, "irqstat") == 0) {
+        shell_irqstat();
+    } else if (strcmp(cmd, "sysstat") == 0) {
+        shell_sysstat(args);
+    } else if (strcmp(cmd, "strace") == 0) {
+        shell_strace(args);
+    } else if (strcmp(cmd, "gui") == 0) {
+        gui_start();
     } else if (strcmp(cmd, "ls") == 0) {
         shell_ls();
     } else if (strcmp(cmd, "cat") == 0) {
         shell_cat(args);
+    } else if (strcmp(cmd, "exec") == 0) {
+        shell_exec(args);
     } else if (strcmp(cmd, "echo") == 0) {
         shell_echo(args);
     } else if (strcmp(cmd, "syscall") == 0) {
@@ -293,9 +449,7 @@ void shell_run(void) {
     shell_prompt();
     
     while (1) {
-        char c = keyboard_getchar();
-        
-        if (c == 0) continue;
+        char c = keyboard_read();
         
         if (c == '\n') {
             print_char('\n');
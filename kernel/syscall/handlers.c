@@ -1,8 +1,21 @@
 #include "syscall.h"
 #include "../core/monitor.h"
 #include "../proc/process.h"
+#include "../proc/thread.h"
 #include "../proc/scheduler.h"
+#include "../proc/exec.h"
+#include "ring.h"
+#include "../mm/uaccess.h"
+#include "../mm/vmm.h"
+#include "../../include/uio.h"
+#include "../drivers/keyboard/keyboard.h"
 #include "../drivers/timer/pit.h"
+#include "../drivers/timer/timer_wheel.h"
+#include "../fs/file.h"
+#include "../../lib/libc/string.h"
+
+// Most bytes of a user write rendered per console_write call
+#define CONSOLE_WRITE_SLICE 256
 
 static int sys_exit(uint32_t status, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
     (void)a2; (void)a3; (void)a4; (void)a5;
@@ -19,23 +32,169 @@ static int sys_exit(uint32_t status, uint32_t a2, uint32_t a3, uint32_t a4, uint
     return 0;
 }
 
+// Write count bytes of user memory to the console straight from where
+// they are. console_write holds the console lock with interrupts off, so
+// a large write goes out in slices. Returns count, or -EFAULT if any of
+// it cannot be read.
+static int console_write_user(uint32_t buf, uint32_t count) {
+    if (user_access_begin((const void*)buf, count, 0) < 0) {
+        return -EFAULT;
+    }
+    for (uint32_t done = 0; done < count; done += CONSOLE_WRITE_SLICE) {
+        uint32_t n = count - done < CONSOLE_WRITE_SLICE ? count - done : CONSOLE_WRITE_SLICE;
+        console_write((const char*)buf + done, n);
+    }
+    user_access_end();
+    return (int)count;
+}
+
+// Up to count typed characters, each stored straight into user memory.
+// With wait, blocks for the first key; otherwise takes only what is
+// already buffered.
+static int keyboard_read_user(uint32_t buf, uint32_t count, int wait) {
+    uint32_t n = 0;
+    while (n < count) {
+        char c = n == 0 && wait ? keyboard_read() : keyboard_getchar();
+        if (!c) break;
+        if (copy_to_user((char*)buf + n, &c, 1) < 0) {
+            return n ? (int)n : -EFAULT;
+        }
+        n++;
+    }
+    return (int)n;
+}
+
 static int sys_write(uint32_t fd, uint32_t buf, uint32_t count, uint32_t a4, uint32_t a5) {
     (void)a4; (void)a5;
     
     if (fd == 1 || fd == 2) {
-        const char* str = (const char*)buf;
-        for (uint32_t i = 0; i < count; i++) {
-            print_char(str[i]);
-        }
-        return (int)count;
+        return console_write_user(buf, count);
     }
     
     return -1;
 }
 
+// fd 0 is the keyboard: waits for the first key, then takes whatever
+// else is already buffered
 static int sys_read(uint32_t fd, uint32_t buf, uint32_t count, uint32_t a4, uint32_t a5) {
-    (void)fd; (void)buf; (void)count; (void)a4; (void)a5;
-    return -1;
+    (void)a4; (void)a5;
+    
+    if (fd != 0) {
+        return -1;
+    }
+    return keyboard_read_user(buf, count, 1);
+}
+
+// Copy in a user iovec array; its total length must fit the int result
+static int iov_fetch(iovec_t* vec, uint32_t iov, uint32_t iovcnt) {
+    if (iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+    if (copy_from_user(vec, (const void*)iov, iovcnt * sizeof(iovec_t)) < 0) {
+        return -EFAULT;
+    }
+    
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        if (vec[i].iov_len > 0x7FFFFFFF - total) {
+            return -EINVAL;
+        }
+        total += vec[i].iov_len;
+    }
+    return 0;
+}
+
+// One pass over the segments, stopping at the first short one; like
+// sys_read only the first waits for a key
+static int sys_readv(uint32_t fd, uint32_t iov, uint32_t iovcnt, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    iovec_t vec[IOV_MAX];
+    int result = iov_fetch(vec, iov, iovcnt);
+    if (result < 0) {
+        return result;
+    }
+    if (fd != 0) {
+        return -EBADF;
+    }
+    
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        int n = keyboard_read_user((uint32_t)vec[i].iov_base, vec[i].iov_len, total == 0);
+        if (n < 0) {
+            return total ? (int)total : n;
+        }
+        total += n;
+        if ((uint32_t)n < vec[i].iov_len) {
+            break;
+        }
+    }
+    return (int)total;
+}
+
+// A header and its payload in one trap
+static int sys_writev(uint32_t fd, uint32_t iov, uint32_t iovcnt, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    iovec_t vec[IOV_MAX];
+    int result = iov_fetch(vec, iov, iovcnt);
+    if (result < 0) {
+        return result;
+    }
+    if (fd != 1 && fd != 2) {
+        return -EBADF;
+    }
+    
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        int n = console_write_user((uint32_t)vec[i].iov_base, vec[i].iov_len);
+        if (n < 0) {
+            return total ? (int)total : n;
+        }
+        total += n;
+        if ((uint32_t)n < vec[i].iov_len) {
+            break;
+        }
+    }
+    return (int)total;
+}
+
+// Positional I/O on a descriptor of the process's table (fs/file.c). The
+// console streams 0-2 are not in it and cannot seek.
+static int file_positional(uint32_t fd, uint32_t buf, uint32_t count, uint32_t offset, int write) {
+    file_t* file = fd_get((int)fd);
+    if (!file) {
+        return fd <= 2 ? -ESPIPE : -EBADF;
+    }
+    uint32_t type = file->node->flags & 0x7;
+    file_put(file);
+    if (type == FS_PIPE || type == FS_CHARDEVICE) {
+        return -ESPIPE;
+    }
+    if (count > 0x7FFFFFFF) {
+        return -EINVAL;
+    }
+    
+    // The node callbacks copy with plain memcpy; pin the buffer for them
+    if (user_access_begin((void*)buf, count, !write) < 0) {
+        return -EFAULT;
+    }
+    int ret = write ? vfs_pwrite((int)fd, (const void*)buf, count, offset)
+                    : vfs_pread((int)fd, (void*)buf, count, offset);
+    user_access_end();
+    return ret < 0 ? -EBADF : ret;
+}
+
+static int sys_pread(uint32_t fd, uint32_t buf, uint32_t count, uint32_t offset, uint32_t a5) {
+    (void)a5;
+    
+    return file_positional(fd, buf, count, offset, 0);
+}
+
+static int sys_pwrite(uint32_t fd, uint32_t buf, uint32_t count, uint32_t offset, uint32_t a5) {
+    (void)a5;
+    
+    return file_positional(fd, buf, count, offset, 1);
 }
 
 static int sys_getpid(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
@@ -48,20 +207,218 @@ static int sys_getpid(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32
 static int sys_sleep(uint32_t ms, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
     (void)a2; (void)a3; (void)a4; (void)a5;
     
-    uint32_t start = timer_get_ticks();
-    uint32_t ticks_to_wait = ms / 10;
+    // Sleep on the timer wheel; other tasks run meanwhile
+    timer_sleep(TIMER_MS_TO_TICKS(ms));
+    
+    return 0;
+}
+
+// Add increment to the caller's nice value (clamped to NICE_MIN..NICE_MAX).
+// Only kernel processes may lower it. Returns 0 or -errno; the new value is
+// not returned, as it could be mistaken for an error.
+static int sys_nice(uint32_t increment, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    thread_t* current = thread_get_current();
+    if (!current) return -EINVAL;
+    
+    int32_t inc = (int32_t)increment;
+    if (inc < 0 && current->proc->page_dir != paging_get_kernel_directory()) {
+        return -EPERM;
+    }
+    
+    // Beyond the full range the sum could overflow; the result clamps anyway
+    int32_t range = NICE_MAX - NICE_MIN;
+    if (inc > range) inc = range;
+    if (inc < -range) inc = -range;
+    
+    return scheduler_set_nice(current, current->nice + inc) < 0 ? -EINVAL : 0;
+}
+
+// runtime/period/deadline in milliseconds, runtime 0 reverts to SCHED_NORMAL
+static int sys_sched_setdeadline(uint32_t runtime, uint32_t period, uint32_t deadline, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    thread_t* current = thread_get_current();
+    if (!current) return -1;
     
-    while ((timer_get_ticks() - start) < ticks_to_wait) {
-        asm volatile("hlt");
+    // Larger values would overflow the conversion to ticks
+    if (runtime > DL_PERIOD_MAX_MS || period > DL_PERIOD_MAX_MS || deadline > DL_PERIOD_MAX_MS) {
+        return -1;
     }
     
+    return scheduler_set_deadline(current, TIMER_MS_TO_TICKS(runtime),
+                                  TIMER_MS_TO_TICKS(period),
+                                  TIMER_MS_TO_TICKS(deadline));
+}
+
+static int sys_yield(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    yield();
+    return 0;
+}
+
+// Copy the schedstat_t of thread tid (0 for the caller) and/or the
+// system-wide sched_global_stats_t; either pointer may be NULL
+static int sys_schedstat(uint32_t tid, uint32_t task_buf, uint32_t global_buf, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    if (task_buf) {
+        schedstat_t task;
+        if (!tid) {
+            tid = thread_get_current()->tid;
+        }
+        if (thread_get_stats(tid, &task) < 0) return -1;
+        if (copy_to_user((void*)task_buf, &task, sizeof(task)) < 0) {
+            return -EFAULT;
+        }
+    }
+    
+    if (global_buf) {
+        sched_global_stats_t stats;
+        scheduler_get_stats(&stats);
+        if (copy_to_user((void*)global_buf, &stats, sizeof(stats)) < 0) {
+            return -EFAULT;
+        }
+    }
+    
+    return 0;
+}
+
+// Start a thread in the caller's process at entry(arg). User callers must
+// supply the new thread's stack; tls 0 inherits the caller's TLS base.
+// Returns the new TID.
+static int sys_clone(uint32_t entry, uint32_t arg, uint32_t stack, uint32_t tls, uint32_t a5) {
+    (void)a5;
+    
+    thread_t* current = thread_get_current();
+    if (!current || !entry) return -1;
+    
+    thread_t* thread;
+    if (current->syscall_regs && (current->syscall_regs->cs & 3)) {
+        if (!stack) return -1;
+        thread = thread_create_user(current->proc, entry, stack, arg, tls);
+    } else {
+        thread = thread_create(current->proc, (void (*)(void*))entry, (void*)arg);
+        if (thread && tls) {
+            thread->tls_base = tls;
+        }
+    }
+    
+    return thread ? (int)thread->tid : -1;
+}
+
+static int sys_set_tls(uint32_t base, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    thread_set_tls(base);
+    return 0;
+}
+
+static int sys_gettid(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    thread_t* current = thread_get_current();
+    return current ? (int)current->tid : -1;
+}
+
+// Exit the calling thread only; SYS_EXIT ends the whole process
+static int sys_thread_exit(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a1; (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    thread_exit();
     return 0;
 }
 
+// Start the executable at path in a new process (there is no fork, so
+// this spawns rather than replaces the caller). Returns the new PID.
+static int sys_exec(uint32_t path, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    if (!path) return -1;
+    
+    char buf[128];
+    int32_t len = strncpy_from_user(buf, (const char*)path, sizeof(buf));
+    if (len < 0) {
+        return len;
+    }
+    if (len == sizeof(buf)) {
+        return -EINVAL;
+    }
+    
+    return process_exec(buf);
+}
+
+// Set up the caller's submission/completion rings; returns their address
+static int sys_ring_setup(uint32_t entries, uint32_t flags, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a3; (void)a4; (void)a5;
+    
+    return ring_setup(entries, flags);
+}
+
+static int sys_ring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    return ring_enter(to_submit, min_complete, flags);
+}
+
+// Move the end of the heap; 0 just returns it. Returns the new end, the
+// old one if it could not move.
+static int sys_brk(uint32_t addr, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a2; (void)a3; (void)a4; (void)a5;
+    
+    return (int)vmm_brk(current_process, addr);
+}
+
+// Map anonymous memory; returns its address or -errno. Pages are only
+// allocated when touched.
+static int sys_mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags, uint32_t a5) {
+    (void)a5;
+    
+    if ((flags & ~(MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS)) || !(flags & MAP_ANONYMOUS)) {
+        return -EINVAL;
+    }
+    
+    int result = vmm_mmap(current_process, &addr, len, prot, (flags & MAP_FIXED) != 0);
+    return result < 0 ? result : (int)addr;
+}
+
+static int sys_munmap(uint32_t addr, uint32_t len, uint32_t a3, uint32_t a4, uint32_t a5) {
+    (void)a3; (void)a4; (void)a5;
+    
+    return vmm_munmap(current_process, addr, len);
+}
+
+static int sys_mprotect(uint32_t addr, uint32_t len, uint32_t prot, uint32_t a4, uint32_t a5) {
+    (void)a4; (void)a5;
+    
+    return vmm_mprotect(current_process, addr, len, prot);
+}
+
 void syscall_handlers_init(void) {
     syscall_register(SYS_EXIT, sys_exit);
     syscall_register(SYS_WRITE, sys_write);
     syscall_register(SYS_READ, sys_read);
     syscall_register(SYS_GETPID, sys_getpid);
     syscall_register(SYS_SLEEP, sys_sleep);
+    syscall_register(SYS_NICE, sys_nice);
+    syscall_register(SYS_SCHED_SETDEADLINE, sys_sched_setdeadline);
+    syscall_register(SYS_YIELD, sys_yield);
+    syscall_register(SYS_SCHEDSTAT, sys_schedstat);
+    syscall_register(SYS_CLONE, sys_clone);
+    syscall_register(SYS_SET_TLS, sys_set_tls);
+    syscall_register(SYS_GETTID, sys_gettid);
+    syscall_register(SYS_THREAD_EXIT, sys_thread_exit);
+    syscall_register(SYS_EXEC, sys_exec);
+    syscall_register(SYS_RING_SETUP, sys_ring_setup);
+    syscall_register(SYS_RING_ENTER, sys_ring_enter);
+    syscall_register(SYS_BRK, sys_brk);
+    syscall_register(SYS_MMAP, sys_mmap);
+    syscall_register(SYS_MUNMAP, sys_munmap);
+    syscall_register(SYS_MPROTECT, sys_mprotect);
+    syscall_register(SYS_READV, sys_readv);
+    syscall_register(SYS_WRITEV, sys_writev);
+    syscall_register(SYS_PREAD, sys_pread);
+    syscall_register(SYS_PWRITE, sys_pwrite);
 }
@@ -0,0 +1,230 @@
+// kernel/syscall/ring.c - Submission/completion rings for batched system calls
+//
+// A process queues requests in a submission ring shared with the kernel
+// and collects the results from a completion ring, so one trap (or none,
+// with a worker thread polling the ring) covers many operations. Each
+// operation runs the same handler as the equivalent system call.
+#include "ring.h"
+#include "syscall.h"
+#include "../core/monitor.h"
+#include "../mm/heap.h"
+#include "../mm/paging.h"
+#include "../mm/vmm.h"
+#include "../proc/thread.h"
+#include "../drivers/keyboard/keyboard.h"
+#include "../drivers/timer/timer_wheel.h"
+#include "../../lib/libc/string.h"
+
+// Ticks an idle worker keeps polling before it sleeps until woken
+#define RING_WORKER_IDLE_TICKS 10
+
+static mutex_t ring_setup_lock = MUTEX_INIT;
+
+// Readiness of the descriptors sys_read/sys_write serve: the console
+static int32_t ring_poll(int32_t fd, uint32_t events) {
+    if (fd == 0 && (events & RING_POLL_IN)) {
+        keyboard_wait_for_key();
+        return RING_POLL_IN;
+    }
+    if ((fd == 1 || fd == 2) && (events & RING_POLL_OUT)) {
+        return RING_POLL_OUT;
+    }
+    return -1;
+}
+
+static int32_t ring_execute(const ring_sqe_t* sqe) {
+    switch (sqe->opcode) {
+        case RING_OP_NOP:
+            return 0;
+        case RING_OP_READ:
+            return syscall_invoke(SYS_READ, sqe->fd, sqe->addr, sqe->len, 0, 0);
+        case RING_OP_WRITE:
+            return syscall_invoke(SYS_WRITE, sqe->fd, sqe->addr, sqe->len, 0, 0);
+        case RING_OP_SLEEP:
+            return syscall_invoke(SYS_SLEEP, sqe->len, 0, 0, 0, 0);
+        case RING_OP_POLL:
+            return ring_poll(sqe->fd, sqe->len);
+        default:
+            return -1;
+    }
+}
+
+static uint32_t ring_sq_pending(ring_t* ring) {
+    uint32_t pending = ring->hdr->sq_tail - ring->sq_head;
+    return pending <= ring->entries ? pending : 0;
+}
+
+static int ring_cq_full(ring_t* ring) {
+    return ring->cq_tail - ring->hdr->cq_head >= 2 * ring->entries;
+}
+
+// Something the worker can make progress on
+static int ring_runnable(ring_t* ring) {
+    return ring_sq_pending(ring) && !ring_cq_full(ring);
+}
+
+static void ring_complete(ring_t* ring, uint32_t user_data, int32_t result) {
+    ring_cqe_t* cqe = &ring->cqes[ring->cq_tail & (2 * ring->entries - 1)];
+    cqe->user_data = user_data;
+    cqe->result = result;
+    
+    // The entry must be visible before the tail that publishes it
+    asm volatile("" ::: "memory");
+    ring->hdr->cq_tail = ++ring->cq_tail;
+    ring->completed++;
+    wake_up_all(&ring->cq_wait);
+}
+
+// Run up to max submissions in order, stopping early when the completion
+// ring is full. Returns how many were consumed.
+static uint32_t ring_drain(ring_t* ring, uint32_t max) {
+    uint32_t done = 0;
+    
+    mutex_lock(&ring->lock);
+    while (done < max && ring_runnable(ring)) {
+        asm volatile("" ::: "memory");
+        
+        // Copied first: user space may reuse the slot once sq_head moves
+        ring_sqe_t sqe = ring->sqes[ring->sq_head & (ring->entries - 1)];
+        ring->hdr->sq_head = ++ring->sq_head;
+        ring->submitted++;
+        
+        ring_complete(ring, sqe.user_data, ring_execute(&sqe));
+        done++;
+    }
+    mutex_unlock(&ring->lock);
+    
+    return done;
+}
+
+// Polls the ring while submissions keep coming, then sleeps until user
+// space sees RING_SQ_NEED_WAKEUP and wakes it through ring_enter. Exits
+// when the process is terminated.
+static void ring_worker(void* arg) {
+    ring_t* ring = (ring_t*)arg;
+    uint32_t idle = 0;
+    
+    for (;;) {
+        thread_testcancel();
+        if (ring_drain(ring, ring->entries)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < RING_WORKER_IDLE_TICKS) {
+            timer_sleep(1);
+            continue;
+        }
+        
+        // Set the flag before the final check: a submitter that missed it
+        // published its tail first, so the check below sees the entry
+        ring->hdr->flags |= RING_SQ_NEED_WAKEUP;
+        __sync_synchronize();
+        wait_event_killable(ring->sq_wait, ring_runnable(ring));
+        ring->hdr->flags &= ~RING_SQ_NEED_WAKEUP;
+        idle = 0;
+    }
+}
+
+int32_t ring_setup(uint32_t entries, uint32_t flags) {
+    process_t* proc = current_process;
+    if (!entries || entries > RING_MAX_ENTRIES ||
+        proc->page_dir == paging_get_kernel_directory()) {
+        return -1;
+    }
+    
+    uint32_t n = 1;
+    while (n < entries) {
+        n <<= 1;
+    }
+    uint32_t cq_off = sizeof(ring_header_t) + n * sizeof(ring_sqe_t);
+    uint32_t size = PAGE_ALIGN_UP(cq_off + 2 * n * sizeof(ring_cqe_t));
+    
+    mutex_lock(&ring_setup_lock);
+    if (proc->ring) {
+        mutex_unlock(&ring_setup_lock);
+        return -1;
+    }
+    
+    ring_t* ring = (ring_t*)kmalloc(sizeof(ring_t));
+    if (!ring) {
+        mutex_unlock(&ring_setup_lock);
+        return -1;
+    }
+    if (vmm_map(proc, RING_ADDR, RING_ADDR + size, VMA_READ | VMA_WRITE | VMA_PINNED,
+                NULL, 0, 0) < 0) {
+        mutex_unlock(&ring_setup_lock);
+        kfree(ring);
+        return -1;
+    }
+    
+    memset(ring, 0, sizeof(ring_t));
+    ring->hdr = (ring_header_t*)RING_ADDR;
+    ring->sqes = (ring_sqe_t*)(RING_ADDR + sizeof(ring_header_t));
+    ring->cqes = (ring_cqe_t*)(RING_ADDR + cq_off);
+    ring->entries = n;
+    mutex_init(&ring->lock);
+    wait_queue_init(&ring->sq_wait);
+    wait_queue_init(&ring->cq_wait);
+    
+    // Fresh anonymous memory reads as zero: only the geometry is written
+    ring->hdr->sq_mask = n - 1;
+    ring->hdr->sq_off = sizeof(ring_header_t);
+    ring->hdr->cq_mask = 2 * n - 1;
+    ring->hdr->cq_off = cq_off;
+    
+    // Started before the ring is published, so a failure leaves nothing
+    // behind that ring_enter could find
+    if (flags & RING_SETUP_WORKER) {
+        ring->worker = thread_create(proc, ring_worker, ring);
+        if (!ring->worker) {
+            print_string("[RING] Error: Failed to start the worker\n");
+            vmm_unmap_pinned(proc, RING_ADDR, size);
+            mutex_unlock(&ring_setup_lock);
+            kfree(ring);
+            return -1;
+        }
+    }
+    
+    proc->ring = ring;
+    mutex_unlock(&ring_setup_lock);
+    
+    return (int32_t)RING_ADDR;
+}
+
+int ring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    ring_t* ring = current_process->ring;
+    if (!ring) {
+        return -1;
+    }
+    
+    uint32_t submitted;
+    if (ring->worker) {
+        submitted = ring_sq_pending(ring);
+        if (submitted > to_submit) {
+            submitted = to_submit;
+        }
+        if ((flags & RING_ENTER_WAKEUP) || min_complete) {
+            wake_up_one(&ring->sq_wait);
+        }
+    } else {
+        submitted = ring_drain(ring, to_submit);
+    }
+    
+    // Without a worker everything submitted has already completed
+    if (ring->worker && min_complete) {
+        if (min_complete > 2 * ring->entries) {
+            min_complete = 2 * ring->entries;
+        }
+        wait_event_killable(ring->cq_wait,
+                            ring->cq_tail - ring->hdr->cq_head >= min_complete);
+    }
+    
+    return (int)submitted;
+}
+
+void ring_exit(process_t* proc) {
+    if (proc->ring) {
+        kfree(proc->ring);
+        proc->ring = NULL;
+    }
+}
@@ -0,0 +1,93 @@
+// kernel/syscall/ring.h - Submission/completion rings for batched system calls
+#ifndef RING_H
+#define RING_H
+
+#include "../../include/types.h"
+#include "../proc/process.h"
+#include "../proc/sync.h"
+#include "../proc/wait.h"
+
+// The rings live in user memory at a fixed address below the vDSO
+// (mirrored in userspace/lib/ring.h)
+#define RING_ADDR           0xBFC00000
+#define RING_MAX_ENTRIES    256         // Submission entries; the CQ is twice that
+
+// Operations
+#define RING_OP_NOP     0
+#define RING_OP_READ    1       // fd, addr, len: like SYS_READ
+#define RING_OP_WRITE   2       // fd, addr, len: like SYS_WRITE
+#define RING_OP_SLEEP   3       // len milliseconds
+#define RING_OP_POLL    4       // fd, len = RING_POLL_* mask: wait until ready
+
+#define RING_POLL_IN    0x01
+#define RING_POLL_OUT   0x04
+
+// Setup flags: drain submissions from a kernel thread instead of on enter
+#define RING_SETUP_WORKER   0x01
+
+// Enter flags: wake a worker that went to sleep (RING_SQ_NEED_WAKEUP)
+#define RING_ENTER_WAKEUP   0x01
+
+// Header flags, written by the kernel
+#define RING_SQ_NEED_WAKEUP 0x01
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t reserved[3];
+    int32_t fd;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t user_data;         // Copied to the completion
+    uint32_t pad[3];
+} ring_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    int32_t result;             // What the equivalent syscall returns
+} ring_cqe_t;
+
+// Start of the ring area. User space owns sq_tail and cq_head, the kernel
+// sq_head and cq_tail; indices run freely and are masked on use.
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    uint32_t sq_mask;
+    uint32_t sq_off;            // Byte offset of the ring_sqe_t array
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t cq_mask;
+    uint32_t cq_off;            // Byte offset of the ring_cqe_t array
+    volatile uint32_t flags;
+    uint32_t pad[7];
+} ring_header_t;
+
+// Kernel side of a process's ring. The header fields user space writes
+// are only read, never trusted: the kernel keeps its own indices.
+typedef struct ring {
+    ring_header_t* hdr;         // User addresses, valid in the owner's space
+    ring_sqe_t* sqes;
+    ring_cqe_t* cqes;
+    uint32_t entries;
+    uint32_t sq_head;
+    uint32_t cq_tail;
+    mutex_t lock;               // One drainer at a time; operations may sleep
+    wait_queue_t sq_wait;       // Idle worker
+    wait_queue_t cq_wait;       // Threads waiting in enter for completions
+    thread_t* worker;
+    uint32_t submitted;
+    uint32_t completed;
+} ring_t;
+
+// Create the calling process's ring with entries (rounded up to a power
+// of two) submission slots. Returns its user address, or -1.
+int32_t ring_setup(uint32_t entries, uint32_t flags);
+
+// Run up to to_submit queued submissions (or wake the worker), then wait
+// until at least min_complete completions are unread if a worker is
+// posting them. Returns the number of submissions consumed, or -1.
+int ring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+// Free the process's ring (process teardown; the memory goes with its VMAs)
+void ring_exit(process_t* proc);
+
+#endif // RING_H
@@ -1,10 +1,26 @@
 #include "syscall.h"
+#include "trace.h"
 #include "../hal/idt.h"
+#include "../hal/gdt.h"
+#include "../hal/cpu.h"
+#include "../hal/smp.h"
 #include "../core/monitor.h"
+#include "../core/panic.h"
+#include "../proc/process.h"
+#include "../proc/thread.h"
+
+#define EFLAGS_TF 0x100
+
+// Per-CPU stack SYSENTER starts on, left after two instructions. Only a
+// trap taken before then (the #DB of a single-stepped SYSENTER, an NMI)
+// ever uses it; the top word holds the address of the CPU's TSS.esp0.
+#define SYSENTER_STACK_WORDS 256
 
 static syscall_handler_t syscall_table[MAX_SYSCALLS];
+static uint32_t sysenter_stacks[MAX_CPUS][SYSENTER_STACK_WORDS];
 
 extern void syscall_entry(void);
+extern void sysenter_entry(void);
 
 void syscall_handler(registers_t* regs) {
     uint32_t syscall_num = regs->eax;
@@ -14,11 +30,67 @@ void syscall_handler(registers_t* regs) {
         return;
     }
     
-    int ret = syscall_table[syscall_num](
-        regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi
-    );
+    // Handlers that need the caller's frame (clone) find it on the thread
+    thread_t* thread = current_thread;
+    registers_t* outer = thread->syscall_regs;
+    thread->syscall_regs = regs;
+    
+    int ret;
+    if (systrace_active) {
+        ret = systrace_call(syscall_table[syscall_num], regs);
+    } else {
+        ret = syscall_table[syscall_num](
+            regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi
+        );
+    }
     
+    thread->syscall_regs = outer;
     regs->eax = (uint32_t)ret;
+    thread_exit_to_user(regs);
+}
+
+// sysenter_entry found the caller's frame outside user space, or it
+// faulted; there is no return address to report an error at
+void sysenter_bad_frame(uint32_t frame) {
+    process_t* proc = current_process;
+    
+    print_string("[SYSCALL] ");
+    print_string(proc->name);
+    print_string(" (PID ");
+    print_dec(proc->pid);
+    print_string("): bad SYSENTER frame at 0x");
+    print_hex(frame);
+    print_string("\n");
+    
+    process_terminate(proc);
+}
+
+// SYSENTER does not clear TF, so a caller with TF set traps before the
+// first instruction of sysenter_entry, on the trampoline stack: drop TF and
+// let the entry go on. Single-stepping user code has no debugger to report
+// to and kills the process.
+static void debug_handler(registers_t* regs) {
+    if ((regs->cs & 3) == 0 && regs->eip == (uint32_t)sysenter_entry) {
+        regs->eflags &= ~EFLAGS_TF;
+        return;
+    }
+    
+    if ((regs->cs & 3) == 3) {
+        process_t* proc = current_process;
+        print_string("[SYSCALL] ");
+        print_string(proc->name);
+        print_string(" (PID ");
+        print_dec(proc->pid);
+        print_string("): debug trap at 0x");
+        print_hex(regs->eip);
+        print_string("\n");
+        
+        process_terminate(proc);
+        return;
+    }
+    
+    dump_registers(regs);
+    PANIC("Debug exception in the kernel");
 }
 
 void syscall_init(void) {
@@ -27,6 +99,27 @@ void syscall_init(void) {
     }
     
     idt_set_gate(0x80, (uint32_t)syscall_entry, 0x08, 0xEE);
+    isr_register_handler(1, debug_handler);
+    syscall_init_cpu();
+}
+
+// SYSENTER loads CS from the MSR (SS is the next descriptor) and ESP from
+// the MSR as well. ESP points at the trampoline stack, whose top word
+// points at the TSS slot holding the current thread's kernel stack; the
+// entry stub loads that stack with two moves, instead of the MSR being
+// rewritten on every context switch.
+void syscall_init_cpu(void) {
+    if (!cpu_has_feature(CPUID_EDX_SEP)) {
+        return;
+    }
+    
+    uint32_t cpu = cpu_current()->id;
+    uint32_t* top = &sysenter_stacks[cpu][SYSENTER_STACK_WORDS - 1];
+    *top = gdt_kernel_stack_slot(cpu);
+    
+    wrmsr(MSR_IA32_SYSENTER_CS, 0x08);
+    wrmsr(MSR_IA32_SYSENTER_ESP, (uint32_t)top);
+    wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)sysenter_entry);
 }
 
 void syscall_register(uint32_t num, syscall_handler_t handler) {
@@ -34,3 +127,10 @@ void syscall_register(uint32_t num, syscall_handler_t handler) {
         syscall_table[num] = handler;
     }
 }
+
+int syscall_invoke(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    if (num >= MAX_SYSCALLS || !syscall_table[num]) {
+        return -1;
+    }
+    return syscall_table[num](a1, a2, a3, a4, a5);
+}
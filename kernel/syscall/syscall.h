@@ -9,13 +9,52 @@
 #define SYS_READ    2
 #define SYS_GETPID  3
 #define SYS_SLEEP   4
+#define SYS_NICE    5
+#define SYS_SCHED_SETDEADLINE 6
+#define SYS_YIELD   7
+#define SYS_SCHEDSTAT 8
+#define SYS_CLONE   9
+#define SYS_SET_TLS 10
+#define SYS_GETTID  11
+#define SYS_THREAD_EXIT 12
+#define SYS_EXEC    13
+#define SYS_RING_SETUP 14
+#define SYS_RING_ENTER 15
+#define SYS_BRK     16
+#define SYS_MMAP    17
+#define SYS_MUNMAP  18
+#define SYS_MPROTECT 19
+#define SYS_READV   20
+#define SYS_WRITEV  21
+#define SYS_PREAD   22
+#define SYS_PWRITE  23
+
+// SYS_MMAP/SYS_MPROTECT protection (the VMA_* access bits) and mapping
+// flags; only private anonymous mappings exist. Mirrored in
+// userspace/lib/mman.h.
+#define PROT_NONE   0x00
+#define PROT_READ   0x01
+#define PROT_WRITE  0x02
+#define PROT_EXEC   0x04
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
 
 #define MAX_SYSCALLS 256
 
 typedef int (*syscall_handler_t)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
+// Install the int 0x80 gate and this CPU's SYSENTER entry
 void syscall_init(void);
+
+// Point the calling CPU's SYSENTER MSRs at the kernel (application
+// processors; syscall_init covers the BSP). No-op without SEP.
+void syscall_init_cpu(void);
 void syscall_register(uint32_t num, syscall_handler_t handler);
 void syscall_handlers_init(void);
 
+// Run a handler directly on behalf of an in-kernel caller (the I/O ring);
+// -1 for an unknown number
+int syscall_invoke(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+
 #endif
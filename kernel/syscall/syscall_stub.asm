@@ -1,20 +1,31 @@
 [BITS 32]
 
 global syscall_entry
+global sysenter_entry
 extern syscall_handler
+extern sysenter_bad_frame
+
+; kernel/mm/paging.h
+%define USER_BASE 0x40000000
+%define USER_END  0xC0000000
+
+; Both entry points build a registers_t frame (int_no 0x80, no error code)
+; so handlers see the same thing whichever way they were called.
 
 syscall_entry:
     cli
+    push dword 0            ; err_code
+    push dword 0x80         ; int_no
     pusha
     
     mov ax, ds
     push eax
     
+    ; %gs holds the thread's TLS selector and is left alone
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     push esp
     call syscall_handler
@@ -24,8 +35,74 @@ syscall_entry:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     popa
+    add esp, 8
     sti
     iret
+
+; SYSENTER arrives with interrupts off, CS/SS set from the MSR and nothing
+; else saved. The user stub (userspace/lib/syscall.h) pushes ebp, edx, ecx
+; and its return address, then points ebp at them:
+;   [ebp] return eip, [ebp+4] ecx, [ebp+8] edx, [ebp+12] ebp
+; Arguments are otherwise in the same registers as for int 0x80. The user
+; data segments are flat, so unlike the int 0x80 path they are not
+; reloaded.
+;
+; ebp comes from the user, so the frame is only read once it is known to
+; lie in user space, and every read has an __ex_table fixup in case it
+; faults all the same. A process that hands in a bad frame has no return
+; address to get an error back at and is killed instead.
+sysenter_entry:
+    ; IA32_SYSENTER_ESP points at the top of this CPU's trampoline stack
+    ; (syscall.c), which holds the address of TSS.esp0. A #DB taken here
+    ; because the user had TF set lands on the trampoline.
+    mov esp, [esp]
+    mov esp, [esp]
+    
+    cmp ebp, USER_BASE
+    jb .bad_frame
+    cmp ebp, USER_END - 12
+    jae .bad_frame
+    
+    push dword 0x23         ; ss
+    lea ecx, [ebp + 4]
+    push ecx                ; useresp, above the return address
+    push dword 0x202        ; eflags
+    push dword 0x1B         ; cs
+.load_eip:
+    push dword [ebp]        ; eip
+    push dword 0            ; err_code
+    push dword 0x80         ; int_no
+.load_ecx:
+    mov ecx, [ebp + 4]
+.load_edx:
+    mov edx, [ebp + 8]
+    pusha
+    
+    mov ax, ds
+    push eax
+    
+    push esp
+    call syscall_handler
+    add esp, 4
+    
+    add esp, 4              ; ds
+    popa
+    add esp, 8
+    
+    ; SYSEXIT resumes at edx with esp = ecx; the stub restores its own
+    ; ecx and edx
+    mov edx, [esp]          ; eip
+    mov ecx, [esp + 12]     ; useresp
+    sti                     ; Takes effect after SYSEXIT
+    sysexit
+    
+.bad_frame:
+    push ebp
+    call sysenter_bad_frame ; Does not return
+
+section __ex_table progbits alloc noexec nowrite align=4
+    dd sysenter_entry.load_eip, sysenter_entry.bad_frame
+    dd sysenter_entry.load_ecx, sysenter_entry.bad_frame
+    dd sysenter_entry.load_edx, sysenter_entry.bad_frame
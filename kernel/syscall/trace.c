@@ -0,0 +1,334 @@
+// kernel/syscall/trace.c - System call statistics and per-process tracing
+//
+// Off by default: the dispatcher only comes here while systrace_active is
+// non-zero. Statistics are per CPU, so counting never bounces a cache
+// line between CPUs; the shell sums them when it prints. A traced process
+// keeps its most recent calls in a ring that lives as long as it does, so
+// a CPU still recording into it after the trace was stopped is harmless.
+#include "trace.h"
+#include "../core/monitor.h"
+#include "../core/spinlock.h"
+#include "../hal/cpu.h"
+#include "../hal/smp.h"
+#include "../mm/heap.h"
+#include "../proc/thread.h"
+#include "../drivers/timer/pit.h"
+#include "../../lib/libc/string.h"
+
+typedef struct {
+    uint32_t calls;
+    uint32_t max;
+    uint64_t cycles;
+    uint32_t hist[SYSTRACE_BUCKETS];
+} systrace_stat_t;
+
+volatile uint32_t systrace_active = 0;
+
+static systrace_stat_t stats[MAX_CPUS][SYSTRACE_NR];
+static spinlock_t trace_lock = SPINLOCK_INIT;
+static uint32_t traced = 0;         // Processes with recording enabled
+
+static const char* names[SYSTRACE_NR] = {
+    [SYS_EXIT] = "exit",
+    [SYS_WRITE] = "write",
+    [SYS_READ] = "read",
+    [SYS_GETPID] = "getpid",
+    [SYS_SLEEP] = "sleep",
+    [SYS_NICE] = "nice",
+    [SYS_SCHED_SETDEADLINE] = "sched_setdeadline",
+    [SYS_YIELD] = "yield",
+    [SYS_SCHEDSTAT] = "schedstat",
+    [SYS_CLONE] = "clone",
+    [SYS_SET_TLS] = "set_tls",
+    [SYS_GETTID] = "gettid",
+    [SYS_THREAD_EXIT] = "thread_exit",
+    [SYS_EXEC] = "exec",
+    [SYS_RING_SETUP] = "ring_setup",
+    [SYS_RING_ENTER] = "ring_enter",
+    [SYS_BRK] = "brk",
+    [SYS_MMAP] = "mmap",
+    [SYS_MUNMAP] = "munmap",
+    [SYS_MPROTECT] = "mprotect",
+    [SYS_READV] = "readv",
+    [SYS_WRITEV] = "writev",
+    [SYS_PREAD] = "pread",
+    [SYS_PWRITE] = "pwrite",
+};
+
+static uint32_t bucket(uint32_t cycles) {
+    uint32_t b = 0;
+    cycles >>= SYSTRACE_MIN_SHIFT;
+    while (cycles && b < SYSTRACE_BUCKETS - 1) {
+        cycles >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// 64-by-32-bit division for a quotient that fits 32 bits, without libgcc
+static uint32_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32) % d;
+    uint32_t lo = (uint32_t)n;
+    uint32_t q;
+    asm("divl %2" : "=a"(q), "+d"(hi) : "rm"(d), "a"(lo));
+    return q;
+}
+
+int systrace_call(syscall_handler_t handler, registers_t* regs) {
+    uint32_t num = regs->eax;
+    
+    uint64_t start = rdtsc();
+    int ret = handler(regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
+    uint64_t delta = rdtsc() - start;
+    uint32_t cycles = (delta >> 32) ? 0xFFFFFFFF : (uint32_t)delta;
+    
+    // Re-read: tracing may have been switched while the call slept
+    uint32_t active = systrace_active;
+    
+    if ((active & SYSTRACE_STATS) && num < SYSTRACE_NR) {
+        uint32_t flags = cpu_irq_save();
+        systrace_stat_t* s = &stats[cpu_current()->id][num];
+        s->calls++;
+        s->cycles += cycles;
+        if (cycles > s->max) {
+            s->max = cycles;
+        }
+        s->hist[bucket(cycles)]++;
+        cpu_irq_restore(flags);
+    }
+    
+    if (active & SYSTRACE_PROCS) {
+        thread_t* thread = current_thread;
+        systrace_ring_t* ring = thread->proc->trace;
+        if (ring && ring->enabled) {
+            uint32_t flags = spin_lock_irqsave(&ring->lock);
+            systrace_entry_t* e = &ring->entries[ring->next++ % SYSTRACE_RING];
+            e->tid = thread->tid;
+            e->num = num;
+            e->args[0] = regs->ebx;
+            e->args[1] = regs->ecx;
+            e->args[2] = regs->edx;
+            e->ret = ret;
+            e->cycles = cycles;
+            e->tick = timer_get_ticks();
+            spin_unlock_irqrestore(&ring->lock, flags);
+        }
+    }
+    
+    return ret;
+}
+
+void systrace_stats_enable(int enable) {
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    if (enable) {
+        systrace_active |= SYSTRACE_STATS;
+    } else {
+        systrace_active &= ~SYSTRACE_STATS;
+    }
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+void systrace_stats_reset(void) {
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    memset(stats, 0, sizeof(stats));
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+int systrace_attach(uint32_t pid) {
+    process_t* proc = process_find(pid);
+    if (!proc) {
+        return -1;
+    }
+    
+    systrace_ring_t* ring = (systrace_ring_t*)kmalloc(sizeof(systrace_ring_t));
+    if (!ring) {
+        process_put(proc);
+        return -1;
+    }
+    memset(ring, 0, sizeof(systrace_ring_t));
+    spin_lock_init(&ring->lock);
+    
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    if (!proc->trace) {
+        proc->trace = ring;
+        ring = NULL;
+    }
+    if (!proc->trace->enabled) {
+        proc->trace->enabled = 1;
+        traced++;
+        systrace_active |= SYSTRACE_PROCS;
+    }
+    spin_unlock_irqrestore(&trace_lock, flags);
+    process_put(proc);
+    
+    if (ring) {
+        kfree(ring);
+    }
+    return 0;
+}
+
+static void systrace_disable(systrace_ring_t* ring) {
+    if (ring && ring->enabled) {
+        ring->enabled = 0;
+        if (--traced == 0) {
+            systrace_active &= ~SYSTRACE_PROCS;
+        }
+    }
+}
+
+int systrace_detach(uint32_t pid) {
+    process_t* proc = process_find(pid);
+    if (!proc) {
+        return -1;
+    }
+    
+    int ret = -1;
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    if (proc->trace) {
+        systrace_disable(proc->trace);
+        ret = 0;
+    }
+    spin_unlock_irqrestore(&trace_lock, flags);
+    process_put(proc);
+    return ret;
+}
+
+void systrace_exit(process_t* proc) {
+    if (!proc->trace) {
+        return;
+    }
+    
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    systrace_disable(proc->trace);
+    spin_unlock_irqrestore(&trace_lock, flags);
+    
+    kfree(proc->trace);
+    proc->trace = NULL;
+}
+
+static void print_padded(uint32_t value, uint32_t width) {
+    uint32_t digits = 1;
+    for (uint32_t v = value; v >= 10; v /= 10) digits++;
+    print_dec(value);
+    for (; digits < width; digits++) print_char(' ');
+}
+
+static void print_name(uint32_t num, uint32_t width) {
+    const char* name = num < SYSTRACE_NR ? names[num] : NULL;
+    uint32_t len;
+    if (name) {
+        print_string(name);
+        len = strlen(name);
+    } else {
+        print_string("sys_");
+        print_dec(num);
+        len = num >= 100 ? 7 : num >= 10 ? 6 : 5;
+    }
+    for (; len < width; len++) print_char(' ');
+}
+
+// Upper bound of the bucket holding the rank-th fastest call
+static void print_percentile(const uint32_t* hist, uint32_t rank) {
+    uint32_t seen = 0;
+    for (uint32_t b = 0; b < SYSTRACE_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= rank) {
+            if (b == SYSTRACE_BUCKETS - 1) {
+                print_string("slower   ");
+            } else {
+                print_padded(1u << (b + SYSTRACE_MIN_SHIFT), 9);
+            }
+            return;
+        }
+    }
+    print_string("-        ");
+}
+
+void systrace_stat_list(void) {
+    print_string("Counting: ");
+    print_string((systrace_active & SYSTRACE_STATS) ? "on\n" : "off\n");
+    print_string("  Syscall            Calls     Avg cyc   p50 <    p99 <    Max cyc\n");
+    print_string("  -----------------  --------  --------  -------  -------  --------\n");
+    
+    for (uint32_t num = 0; num < SYSTRACE_NR; num++) {
+        systrace_stat_t total;
+        memset(&total, 0, sizeof(total));
+        
+        for (uint32_t i = 0; i < cpu_count; i++) {
+            systrace_stat_t* s = &stats[i][num];
+            total.calls += s->calls;
+            total.cycles += s->cycles;
+            if (s->max > total.max) {
+                total.max = s->max;
+            }
+            for (uint32_t b = 0; b < SYSTRACE_BUCKETS; b++) {
+                total.hist[b] += s->hist[b];
+            }
+        }
+        if (total.calls == 0) {
+            continue;
+        }
+        
+        print_string("  ");
+        print_name(num, 19);
+        print_padded(total.calls, 10);
+        print_padded(div64_32(total.cycles, total.calls), 10);
+        print_percentile(total.hist, (total.calls + 1) / 2);
+        print_percentile(total.hist, total.calls - total.calls / 100);
+        print_dec(total.max);
+        print_string("\n");
+    }
+}
+
+int systrace_dump(uint32_t pid) {
+    process_t* proc = process_find(pid);
+    if (!proc) {
+        return -1;
+    }
+    if (!proc->trace) {
+        process_put(proc);
+        return -1;
+    }
+    
+    // Copy out so the console is not written with the ring locked
+    systrace_ring_t* copy = (systrace_ring_t*)kmalloc(sizeof(systrace_ring_t));
+    if (!copy) {
+        process_put(proc);
+        return -1;
+    }
+    uint32_t flags = spin_lock_irqsave(&proc->trace->lock);
+    memcpy(copy, proc->trace, sizeof(systrace_ring_t));
+    spin_unlock_irqrestore(&proc->trace->lock, flags);
+    process_put(proc);
+    
+    uint32_t first = copy->next > SYSTRACE_RING ? copy->next - SYSTRACE_RING : 0;
+    for (uint32_t i = first; i < copy->next; i++) {
+        systrace_entry_t* e = &copy->entries[i % SYSTRACE_RING];
+        
+        print_padded(e->tick, 8);
+        print_padded(e->tid, 6);
+        print_name(e->num, 0);
+        print_string("(0x");
+        print_hex(e->args[0]);
+        print_string(", 0x");
+        print_hex(e->args[1]);
+        print_string(", 0x");
+        print_hex(e->args[2]);
+        print_string(") = ");
+        if (e->ret < 0) {
+            print_char('-');
+            print_dec((uint32_t)-e->ret);
+        } else {
+            print_dec((uint32_t)e->ret);
+        }
+        print_string("  ");
+        print_dec(e->cycles);
+        print_string(" cyc\n");
+    }
+    
+    print_dec(copy->next);
+    print_string(" calls recorded");
+    print_string(copy->enabled ? ", tracing\n" : ", stopped\n");
+    kfree(copy);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// kernel/syscall/trace.h - System call statistics and per-process tracing
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../../include/types.h"
+#include "../hal/isr.h"
+#include "../proc/process.h"
+#include "../core/spinlock.h"
+#include "syscall.h"
+
+// Syscall numbers with their own counters; higher ones are not counted
+#define SYSTRACE_NR         32
+
+// Latency histogram: bucket i counts calls under 2^(i + 7) cycles, the
+// last one everything slower
+#define SYSTRACE_BUCKETS    16
+#define SYSTRACE_MIN_SHIFT  7
+
+// Entries kept per traced process; older ones are overwritten
+#define SYSTRACE_RING       64
+
+// systrace_active bits
+#define SYSTRACE_STATS      0x01    // Count calls and cycles
+#define SYSTRACE_PROCS      0x02    // Some process is being traced
+
+// Tested by the dispatcher before anything else, so with tracing off a
+// system call pays one load and branch
+extern volatile uint32_t systrace_active;
+
+typedef struct {
+    uint32_t tid;
+    uint32_t num;
+    uint32_t args[3];
+    int32_t ret;
+    uint32_t cycles;
+    uint32_t tick;              // When the call returned
+} systrace_entry_t;
+
+// A traced process's recent system calls
+typedef struct systrace_ring {
+    spinlock_t lock;
+    uint8_t enabled;            // Recording; cleared by systrace_detach
+    uint32_t next;              // Total entries written
+    systrace_entry_t entries[SYSTRACE_RING];
+} systrace_ring_t;
+
+// Run handler for the frame in regs, timing and recording it as enabled.
+// The dispatcher's slow path.
+int systrace_call(syscall_handler_t handler, registers_t* regs);
+
+void systrace_stats_enable(int enable);
+void systrace_stats_reset(void);
+
+// Start/stop recording the calls of a process; -1 if there is no such
+// process (or, starting, no memory)
+int systrace_attach(uint32_t pid);
+int systrace_detach(uint32_t pid);
+
+// Drop a process's trace (process teardown)
+void systrace_exit(process_t* proc);
+
+// Shell sysstat / strace
+void systrace_stat_list(void);
+int systrace_dump(uint32_t pid);
+
+#endif // TRACE_H
@@ -0,0 +1,37 @@
+// lib/libk/bitmap.c - Fixed-size bit arrays
+#include "bitmap.h"
+
+static inline uint32_t lowest_bit(uint32_t word) {
+    uint32_t bit;
+    asm("bsf %1, %0" : "=r"(bit) : "rm"(word));
+    return bit;
+}
+
+// Scan a word at a time; xor_mask flips the words so both searches look
+// for a set bit
+static uint32_t find_next(const uint32_t* map, uint32_t size, uint32_t start,
+                          uint32_t xor_mask) {
+    if (start >= size) return size;
+    
+    uint32_t word = start / 32;
+    uint32_t bits = (map[word] ^ xor_mask) & (~0u << (start % 32));
+    
+    for (;;) {
+        if (bits) {
+            uint32_t bit = word * 32 + lowest_bit(bits);
+            return bit < size ? bit : size;
+        }
+        if (++word >= BITMAP_WORDS(size)) {
+            return size;
+        }
+        bits = map[word] ^ xor_mask;
+    }
+}
+
+uint32_t bitmap_find_next_zero(const uint32_t* map, uint32_t size, uint32_t start) {
+    return find_next(map, size, start, ~0u);
+}
+
+uint32_t bitmap_find_next_set(const uint32_t* map, uint32_t size, uint32_t start) {
+    return find_next(map, size, start, 0);
+}
@@ -0,0 +1,28 @@
+// lib/libk/bitmap.h - Fixed-size bit arrays
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include "../../include/types.h"
+
+// Number of 32-bit words needed for a map of the given size
+#define BITMAP_WORDS(bits) (((bits) + 31) / 32)
+
+static inline void bitmap_set(uint32_t* map, uint32_t bit) {
+    map[bit / 32] |= 1u << (bit % 32);
+}
+
+static inline void bitmap_clear(uint32_t* map, uint32_t bit) {
+    map[bit / 32] &= ~(1u << (bit % 32));
+}
+
+static inline int bitmap_test(const uint32_t* map, uint32_t bit) {
+    return (map[bit / 32] >> (bit % 32)) & 1;
+}
+
+// First clear bit in [start, size), or size if every bit is set
+uint32_t bitmap_find_next_zero(const uint32_t* map, uint32_t size, uint32_t start);
+
+// First set bit in [start, size), or size if none is set
+uint32_t bitmap_find_next_set(const uint32_t* map, uint32_t size, uint32_t start);
+
+#endif // BITMAP_H
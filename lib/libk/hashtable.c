@@ -0,0 +1,44 @@
+// lib/libk/hashtable.c - Intrusive chained hash table keyed by integers
+#include "hashtable.h"
+
+void hashtable_init(hashtable_t* table, hash_node_t** buckets, uint32_t bits) {
+    table->buckets = buckets;
+    table->bits = bits;
+    table->count = 0;
+    for (uint32_t i = 0; i < (1u << bits); i++) {
+        buckets[i] = NULL;
+    }
+}
+
+void hashtable_add(hashtable_t* table, hash_node_t* node, uint32_t key) {
+    hash_node_t** head = &table->buckets[hash_u32(key, table->bits)];
+    
+    node->key = key;
+    node->next = *head;
+    node->pprev = head;
+    if (*head) {
+        (*head)->pprev = &node->next;
+    }
+    *head = node;
+    table->count++;
+}
+
+void hashtable_del(hashtable_t* table, hash_node_t* node) {
+    if (!node->pprev) return;
+    
+    *node->pprev = node->next;
+    if (node->next) {
+        node->next->pprev = node->pprev;
+    }
+    node->next = NULL;
+    node->pprev = NULL;
+    table->count--;
+}
+
+hash_node_t* hashtable_find(hashtable_t* table, uint32_t key) {
+    hash_node_t* node = table->buckets[hash_u32(key, table->bits)];
+    while (node && node->key != key) {
+        node = node->next;
+    }
+    return node;
+}
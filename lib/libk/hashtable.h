@@ -0,0 +1,39 @@
+// lib/libk/hashtable.h - Intrusive chained hash table keyed by integers
+//
+// Nodes are embedded in the objects they index, so insertion and removal
+// never allocate. The caller provides the bucket array and any locking.
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include "../../include/types.h"
+#include "../../include/stddef.h"
+
+typedef struct hash_node {
+    struct hash_node* next;
+    struct hash_node** pprev;   // Points at whatever points at this node
+    uint32_t key;
+} hash_node_t;
+
+typedef struct {
+    hash_node_t** buckets;
+    uint32_t bits;              // 1 << bits buckets
+    uint32_t count;
+} hashtable_t;
+
+// Recover the containing object from an embedded node
+#define hash_entry(node, type, member) \
+    ((type*)((uint8_t*)(node) - offsetof(type, member)))
+
+// Multiplicative (Fibonacci) hash, spreads sequential keys across buckets
+static inline uint32_t hash_u32(uint32_t key, uint32_t bits) {
+    return (key * 0x9E3779B9u) >> (32 - bits);
+}
+
+void hashtable_init(hashtable_t* table, hash_node_t** buckets, uint32_t bits);
+void hashtable_add(hashtable_t* table, hash_node_t* node, uint32_t key);
+void hashtable_del(hashtable_t* table, hash_node_t* node);
+
+// First node with the given key, or NULL
+hash_node_t* hashtable_find(hashtable_t* table, uint32_t key);
+
+#endif // HASHTABLE_H
@@ -3,16 +3,17 @@
 #include <string.h>
 #include <stdint.h>
 
+// Must match kernel/fs/initrd.h
 typedef struct {
     uint32_t nfiles;
-} initrd_header_t;
+} __attribute__((packed)) initrd_header_t;
 
 typedef struct {
     uint8_t magic;
     char name[64];
     uint32_t offset;
     uint32_t length;
-} initrd_file_header_t;
+} __attribute__((packed)) initrd_file_header_t;
 
 int main(int argc, char** argv) {
     if (argc < 2) {
@@ -49,9 +50,14 @@ int main(int argc, char** argv) {
         uint32_t length = ftell(f);
         fclose(f);
         
+        // Files are looked up by name alone
+        const char* name = strrchr(argv[i + 2], '/');
+        name = name ? name + 1 : argv[i + 2];
+        
         initrd_file_header_t fheader;
+        memset(&fheader, 0, sizeof(fheader));
         fheader.magic = 0xBF;
-        strncpy(fheader.name, argv[i + 2], 63);
+        strncpy(fheader.name, name, 63);
         fheader.name[63] = '\0';
         fheader.offset = offset;
         fheader.length = length;
@@ -0,0 +1,114 @@
+// userspace/bin/sysbench.c - System call latency: int 0x80 vs SYSENTER
+//
+// Times a null system call (getpid) through both entry paths with the TSC
+// and prints the average cost of each in cycles, next to the vDSO read
+// that replaces it and a no-op batched through the submission ring.
+#include "syscall.h"
+#include "vdso.h"
+#include "ring.h"
+
+#define ITERATIONS 10000
+#define ROUNDS     5
+#define RING_BATCH 32
+
+static ring_t ring;
+
+// Low half of the TSC; a round is far shorter than its wrap-around
+static inline unsigned int rdtsc(void) {
+    unsigned int lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static unsigned int bench_int80(void) {
+    unsigned int start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++) {
+        syscall3(SYS_GETPID, 0, 0, 0);
+    }
+    return (rdtsc() - start) / ITERATIONS;
+}
+
+static unsigned int bench_sysenter(void) {
+    unsigned int start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++) {
+        syscall3_fast(SYS_GETPID, 0, 0, 0);
+    }
+    return (rdtsc() - start) / ITERATIONS;
+}
+
+static unsigned int bench_vdso(void) {
+    volatile int sink;
+    unsigned int start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink = vdso_getpid();
+    }
+    (void)sink;
+    return (rdtsc() - start) / ITERATIONS;
+}
+
+// RING_BATCH no-ops per ring_enter; cycles per operation
+static unsigned int bench_ring(void) {
+    unsigned int start = rdtsc();
+    for (int i = 0; i < ITERATIONS / RING_BATCH; i++) {
+        for (int j = 0; j < RING_BATCH; j++) {
+            ring_prep(ring_get_sqe(&ring), RING_OP_NOP, 0, 0, 0, j);
+        }
+        ring_submit(&ring, 0);
+        while (ring_peek_cqe(&ring)) {
+            ring_cqe_seen(&ring);
+        }
+    }
+    return (rdtsc() - start) / (ITERATIONS / RING_BATCH * RING_BATCH);
+}
+
+// Best of several rounds, to discount interrupts and preemption
+static unsigned int best_of(unsigned int (*bench)(void)) {
+    unsigned int best = 0xFFFFFFFF;
+    for (int r = 0; r < ROUNDS; r++) {
+        unsigned int cycles = bench();
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+int main(void) {
+    puts("sysbench: null syscall (getpid), cycles per call\n");
+    
+    unsigned int vdso = best_of(bench_vdso);
+    puts("  vdso:     ");
+    putdec(vdso);
+    puts(vdso_getpid() == getpid() ? "\n" : " (wrong result)\n");
+    
+    unsigned int slow = best_of(bench_int80);
+    puts("  int 0x80: ");
+    putdec(slow);
+    puts("\n");
+    
+    if (ring_setup(&ring, RING_BATCH, 0) == 0) {
+        unsigned int batched = best_of(bench_ring);
+        puts("  ring x");
+        putdec(RING_BATCH);
+        puts(": ");
+        putdec(batched);
+        puts("\n");
+    }
+    
+    if (!sysenter_supported()) {
+        puts("  sysenter: not supported by this CPU\n");
+        return 0;
+    }
+    
+    // Both paths must agree before timing means anything
+    if (syscall3_fast(SYS_GETPID, 0, 0, 0) != getpid()) {
+        puts("  sysenter: wrong result\n");
+        return 1;
+    }
+    
+    unsigned int fast = best_of(bench_sysenter);
+    puts("  sysenter: ");
+    putdec(fast);
+    puts("\n");
+    return 0;
+}
@@ -0,0 +1,35 @@
+// userspace/init/init.c - First user program, loaded from the initrd
+#include "syscall.h"
+#include "vdso.h"
+#include "malloc.h"
+
+#define RESERVE (256 << 20)
+
+int main(void) {
+    puts("init: running in user space as PID ");
+    putdec(vdso_getpid());
+    puts(", ");
+    putdec(vdso_ticks() / vdso_hz());
+    puts(" s after boot\n");
+    
+    // A large reservation is only address space: the two pages touched
+    // are all the memory it ever gets
+    char* big = (char*)mmap(0, RESERVE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    if (big == MAP_FAILED) {
+        puts("init: mmap failed\n");
+        return 1;
+    }
+    big[0] = 1;
+    big[RESERVE - 1] = 1;
+    munmap(big, RESERVE);
+    
+    int* table = (int*)calloc(1024, sizeof(int));
+    if (!table) {
+        puts("init: malloc failed\n");
+        return 1;
+    }
+    table[1023] = 1;
+    free(table);
+    puts("init: heap and mmap ok\n");
+    return 0;
+}
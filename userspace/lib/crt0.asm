@@ -0,0 +1,16 @@
+; userspace/lib/crt0.asm - Entry point of user programs
+[bits 32]
+
+global _start
+extern main
+
+section .text
+_start:
+    call main
+
+    ; exit(main())
+    mov ebx, eax
+    mov eax, 0                  ; SYS_EXIT
+    int 0x80
+.hang:
+    jmp .hang
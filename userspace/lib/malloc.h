@@ -0,0 +1,123 @@
+// userspace/lib/malloc.h - A small heap allocator on top of brk and mmap
+//
+// Small blocks are carved from the brk heap and kept on an address-ordered
+// free list, merging with their neighbours when freed. Large blocks get a
+// mapping of their own and go straight back to the kernel on free.
+#ifndef USER_MALLOC_H
+#define USER_MALLOC_H
+
+#include "mman.h"
+
+#define MALLOC_ALIGN    8
+#define MALLOC_GROW     0x10000     // The heap grows at least this much at a time
+#define MALLOC_MMAP_MIN 0x20000     // Blocks this large get their own mapping
+
+typedef struct malloc_block {
+    unsigned int size;              // Whole block with header; bit 0: own mapping
+    struct malloc_block* next;      // Free list, while free
+} malloc_block_t;
+
+static malloc_block_t* malloc_free_list;
+
+// Return a heap block to the free list, merging it with adjacent ones
+static inline void malloc_insert(malloc_block_t* block) {
+    malloc_block_t* prev = 0;
+    malloc_block_t* next = malloc_free_list;
+    while (next && next < block) {
+        prev = next;
+        next = next->next;
+    }
+    
+    if (next && (char*)block + block->size == (char*)next) {
+        block->size += next->size;
+        next = next->next;
+    }
+    block->next = next;
+    
+    if (prev && (char*)prev + prev->size == (char*)block) {
+        prev->size += block->size;
+        prev->next = next;
+    } else if (prev) {
+        prev->next = block;
+    } else {
+        malloc_free_list = block;
+    }
+}
+
+// First free block that fits need bytes, split if there is room left
+static inline malloc_block_t* malloc_take(unsigned int need) {
+    for (malloc_block_t** link = &malloc_free_list; *link; link = &(*link)->next) {
+        malloc_block_t* block = *link;
+        if (block->size < need) {
+            continue;
+        }
+        if (block->size - need >= sizeof(malloc_block_t) + MALLOC_ALIGN) {
+            malloc_block_t* rest = (malloc_block_t*)((char*)block + need);
+            rest->size = block->size - need;
+            rest->next = block->next;
+            *link = rest;
+            block->size = need;
+        } else {
+            *link = block->next;
+        }
+        return block;
+    }
+    return 0;
+}
+
+static inline void* malloc(unsigned int size) {
+    unsigned int need = (size + sizeof(malloc_block_t) + MALLOC_ALIGN - 1) & ~(MALLOC_ALIGN - 1);
+    if (size == 0 || need < size) {
+        return 0;
+    }
+    
+    if (need >= MALLOC_MMAP_MIN) {
+        need = (need + 0xFFF) & ~0xFFF;
+        malloc_block_t* block = (malloc_block_t*)mmap(0, need, PROT_READ | PROT_WRITE,
+                                                      MAP_PRIVATE | MAP_ANONYMOUS);
+        if (block == MAP_FAILED) {
+            return 0;
+        }
+        block->size = need | 1;
+        return block + 1;
+    }
+    
+    malloc_block_t* block = malloc_take(need);
+    if (!block) {
+        unsigned int grow = need > MALLOC_GROW ? need : MALLOC_GROW;
+        malloc_block_t* more = (malloc_block_t*)sbrk((int)grow);
+        if (more == (void*)-1) {
+            return 0;
+        }
+        more->size = grow;
+        malloc_insert(more);
+        block = malloc_take(need);
+    }
+    return block ? block + 1 : 0;
+}
+
+static inline void free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    malloc_block_t* block = (malloc_block_t*)ptr - 1;
+    if (block->size & 1) {
+        munmap(block, block->size & ~1u);
+    } else {
+        malloc_insert(block);
+    }
+}
+
+static inline void* calloc(unsigned int count, unsigned int size) {
+    unsigned int total = count * size;
+    if (size && total / size != count) {
+        return 0;
+    }
+    char* ptr = (char*)malloc(total);
+    for (unsigned int i = 0; ptr && i < total; i++) {
+        ptr[i] = 0;
+    }
+    return ptr;
+}
+
+#endif // USER_MALLOC_H
@@ -0,0 +1,57 @@
+// userspace/lib/mman.h - Heap and anonymous memory mappings
+//
+// brk/sbrk move the end of the heap, mmap maps anonymous memory anywhere
+// else. Either way the kernel only allocates a page when it is first
+// touched (kernel/mm/vmm.c), so reserving far more than is used is cheap.
+#ifndef USER_MMAN_H
+#define USER_MMAN_H
+
+#include "syscall.h"
+
+// Must match kernel/syscall/syscall.h
+#define SYS_BRK         16
+#define SYS_MMAP        17
+#define SYS_MUNMAP      18
+#define SYS_MPROTECT    19
+
+#define PROT_NONE       0x00
+#define PROT_READ       0x01
+#define PROT_WRITE      0x02
+#define PROT_EXEC       0x04
+
+#define MAP_PRIVATE     0x02
+#define MAP_FIXED       0x10
+#define MAP_ANONYMOUS   0x20
+#define MAP_FAILED      ((void*)-1)
+
+// Errors come back as -errno, which no page-aligned address can be
+static inline void* mmap(void* addr, unsigned int len, int prot, int flags) {
+    int ret = syscall4(SYS_MMAP, (int)addr, (int)len, prot, flags);
+    return (unsigned int)ret >= (unsigned int)-4095 ? MAP_FAILED : (void*)ret;
+}
+
+static inline int munmap(void* addr, unsigned int len) {
+    return syscall3(SYS_MUNMAP, (int)addr, (int)len, 0);
+}
+
+static inline int mprotect(void* addr, unsigned int len, int prot) {
+    return syscall3(SYS_MPROTECT, (int)addr, (int)len, prot);
+}
+
+// Set the end of the heap; brk(0) reports it. Returns the resulting end.
+static inline void* brk(void* addr) {
+    return (void*)syscall3(SYS_BRK, (int)addr, 0, 0);
+}
+
+// Grow (or shrink) the heap by increment bytes. Returns the old end, or
+// (void*)-1 if the heap cannot move.
+static inline void* sbrk(int increment) {
+    char* old = (char*)brk(0);
+    if (increment == 0) {
+        return old;
+    }
+    char* end = (char*)brk(old + increment);
+    return end == old + increment ? (void*)old : (void*)-1;
+}
+
+#endif // USER_MMAN_H
@@ -0,0 +1,143 @@
+// userspace/lib/ring.h - Batched system calls through shared rings
+//
+// Fill submission entries, publish them with ring_submit() and read the
+// results from the completion ring; one ring_enter covers the whole batch
+// (kernel/syscall/ring.h). With RING_SETUP_WORKER a kernel thread drains
+// the ring and most batches need no trap at all.
+#ifndef USER_RING_H
+#define USER_RING_H
+
+#include "syscall.h"
+
+// Must match kernel/syscall/ring.h
+#define SYS_RING_SETUP  14
+#define SYS_RING_ENTER  15
+
+#define RING_OP_NOP     0
+#define RING_OP_READ    1
+#define RING_OP_WRITE   2
+#define RING_OP_SLEEP   3
+#define RING_OP_POLL    4
+
+#define RING_POLL_IN    0x01
+#define RING_POLL_OUT   0x04
+
+#define RING_SETUP_WORKER   0x01
+#define RING_ENTER_WAKEUP   0x01
+#define RING_SQ_NEED_WAKEUP 0x01
+
+typedef struct {
+    unsigned char opcode;
+    unsigned char reserved[3];
+    int fd;
+    unsigned int addr;
+    unsigned int len;
+    unsigned int user_data;
+    unsigned int pad[3];
+} ring_sqe_t;
+
+typedef struct {
+    unsigned int user_data;
+    int result;
+} ring_cqe_t;
+
+typedef struct {
+    volatile unsigned int sq_head;
+    volatile unsigned int sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_off;
+    volatile unsigned int cq_head;
+    volatile unsigned int cq_tail;
+    unsigned int cq_mask;
+    unsigned int cq_off;
+    volatile unsigned int flags;
+    unsigned int pad[7];
+} ring_header_t;
+
+typedef struct {
+    ring_header_t* hdr;
+    ring_sqe_t* sqes;
+    ring_cqe_t* cqes;
+    unsigned int sq_tail;       // Local tail, published by ring_submit
+    unsigned int queued;        // Entries since the last ring_submit
+    unsigned int setup_flags;
+} ring_t;
+
+static inline int ring_setup(ring_t* ring, unsigned int entries, unsigned int flags) {
+    int addr = syscall3(SYS_RING_SETUP, (int)entries, (int)flags, 0);
+    if (addr == -1) {
+        return -1;
+    }
+    ring->hdr = (ring_header_t*)addr;
+    ring->sqes = (ring_sqe_t*)(addr + ring->hdr->sq_off);
+    ring->cqes = (ring_cqe_t*)(addr + ring->hdr->cq_off);
+    ring->sq_tail = ring->hdr->sq_tail;
+    ring->queued = 0;
+    ring->setup_flags = flags;
+    return 0;
+}
+
+// Next free submission slot, NULL when the ring is full
+static inline ring_sqe_t* ring_get_sqe(ring_t* ring) {
+    ring_header_t* hdr = ring->hdr;
+    if (ring->sq_tail - hdr->sq_head > hdr->sq_mask) {
+        return 0;
+    }
+    ring_sqe_t* sqe = &ring->sqes[ring->sq_tail++ & hdr->sq_mask];
+    ring->queued++;
+    return sqe;
+}
+
+static inline void ring_prep(ring_sqe_t* sqe, int opcode, int fd, const void* addr,
+                             unsigned int len, unsigned int user_data) {
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned int)addr;
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
+
+static inline int ring_enter(unsigned int to_submit, unsigned int min_complete,
+                             unsigned int flags) {
+    return syscall3(SYS_RING_ENTER, (int)to_submit, (int)min_complete, (int)flags);
+}
+
+// Publish the queued entries. Without a worker the kernel runs them
+// before returning; with one this traps only to wake a sleeping worker or
+// to wait for min_complete completions.
+static inline int ring_submit(ring_t* ring, unsigned int min_complete) {
+    unsigned int n = ring->queued;
+    ring->queued = 0;
+    
+    asm volatile("" ::: "memory");
+    ring->hdr->sq_tail = ring->sq_tail;
+    if (!(ring->setup_flags & RING_SETUP_WORKER)) {
+        return ring_enter(n, min_complete, 0);
+    }
+    
+    // The tail must be visible before the flag is read (pairs with the
+    // worker setting the flag before its last look at the tail)
+    __sync_synchronize();
+    if (min_complete || (ring->hdr->flags & RING_SQ_NEED_WAKEUP)) {
+        return ring_enter(n, min_complete, RING_ENTER_WAKEUP);
+    }
+    return (int)n;
+}
+
+// Oldest unread completion, NULL if there is none
+static inline ring_cqe_t* ring_peek_cqe(ring_t* ring) {
+    ring_header_t* hdr = ring->hdr;
+    if (hdr->cq_head == hdr->cq_tail) {
+        return 0;
+    }
+    asm volatile("" ::: "memory");
+    return &ring->cqes[hdr->cq_head & hdr->cq_mask];
+}
+
+// Release the completion returned by ring_peek_cqe
+static inline void ring_cqe_seen(ring_t* ring) {
+    asm volatile("" ::: "memory");
+    ring->hdr->cq_head++;
+}
+
+#endif // USER_RING_H
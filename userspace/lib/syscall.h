@@ -0,0 +1,141 @@
+// userspace/lib/syscall.h - System call wrappers for user programs
+#ifndef USER_SYSCALL_H
+#define USER_SYSCALL_H
+
+// Must match kernel/syscall/syscall.h
+#define SYS_EXIT    0
+#define SYS_WRITE   1
+#define SYS_READ    2
+#define SYS_GETPID  3
+#define SYS_SLEEP   4
+#define SYS_YIELD   7
+#define SYS_EXEC    13
+#define SYS_READV   20
+#define SYS_WRITEV  21
+#define SYS_PREAD   22
+#define SYS_PWRITE  23
+
+// Must match include/uio.h
+#define IOV_MAX     64
+
+struct iovec {
+    void* iov_base;
+    unsigned int iov_len;
+};
+
+static inline int syscall3(int num, int a1, int a2, int a3) {
+    int ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret)
+                 : "a"(num), "b"(a1), "c"(a2), "d"(a3)
+                 : "memory");
+    return ret;
+}
+
+static inline int syscall4(int num, int a1, int a2, int a3, int a4) {
+    int ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret)
+                 : "a"(num), "b"(a1), "c"(a2), "d"(a3), "S"(a4)
+                 : "memory");
+    return ret;
+}
+
+// SYSENTER variant: the kernel returns to the label with esp just above
+// it and reads ecx/edx back from the stack (kernel/syscall/syscall_stub.asm).
+// Only usable when sysenter_supported().
+static inline int syscall3_fast(int num, int a1, int a2, int a3) {
+    int ret;
+    asm volatile("push %%ebp\n"
+                 "push %%edx\n"
+                 "push %%ecx\n"
+                 "push $1f\n"
+                 "mov %%esp, %%ebp\n"
+                 "sysenter\n"
+                 "1:\n"
+                 "pop %%ecx\n"
+                 "pop %%edx\n"
+                 "pop %%ebp\n"
+                 : "=a"(ret)
+                 : "a"(num), "b"(a1), "c"(a2), "d"(a3)
+                 : "memory", "cc");
+    return ret;
+}
+
+// CPUID leaf 1 EDX bit 11 (SEP)
+static inline int sysenter_supported(void) {
+    unsigned int eax = 1, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    return (edx >> 11) & 1;
+}
+
+static inline void exit(int status) {
+    syscall3(SYS_EXIT, status, 0, 0);
+    for (;;);
+}
+
+static inline int write(int fd, const void* buf, unsigned int count) {
+    return syscall3(SYS_WRITE, fd, (int)buf, (int)count);
+}
+
+static inline int read(int fd, void* buf, unsigned int count) {
+    return syscall3(SYS_READ, fd, (int)buf, (int)count);
+}
+
+// Gather iovcnt buffers into one write / scatter one read over them
+static inline int writev(int fd, const struct iovec* iov, int iovcnt) {
+    return syscall3(SYS_WRITEV, fd, (int)iov, iovcnt);
+}
+
+static inline int readv(int fd, const struct iovec* iov, int iovcnt) {
+    return syscall3(SYS_READV, fd, (int)iov, iovcnt);
+}
+
+// At a file offset, leaving the descriptor's own offset alone
+static inline int pread(int fd, void* buf, unsigned int count, unsigned int offset) {
+    return syscall4(SYS_PREAD, fd, (int)buf, (int)count, (int)offset);
+}
+
+static inline int pwrite(int fd, const void* buf, unsigned int count, unsigned int offset) {
+    return syscall4(SYS_PWRITE, fd, (int)buf, (int)count, (int)offset);
+}
+
+static inline int getpid(void) {
+    return syscall3(SYS_GETPID, 0, 0, 0);
+}
+
+static inline int sleep(unsigned int ms) {
+    return syscall3(SYS_SLEEP, (int)ms, 0, 0);
+}
+
+static inline int yield(void) {
+    return syscall3(SYS_YIELD, 0, 0, 0);
+}
+
+// Start the program at path in a new process; returns its PID
+static inline int exec(const char* path) {
+    return syscall3(SYS_EXEC, (int)path, 0, 0);
+}
+
+static inline unsigned int strlen(const char* s) {
+    unsigned int n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static inline void puts(const char* s) {
+    write(1, s, strlen(s));
+}
+
+static inline void putdec(unsigned int value) {
+    char buf[12];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    puts(&buf[i]);
+}
+
+#endif // USER_SYSCALL_H
@@ -0,0 +1,79 @@
+// userspace/lib/vdso.h - Syscall-free time and identity queries
+//
+// The kernel maps a read-only page of its own data into every process
+// (kernel/mm/vdso.h); these read it directly instead of trapping.
+#ifndef USER_VDSO_H
+#define USER_VDSO_H
+
+// Must match kernel/mm/vdso.h
+#define VDSO_DATA_ADDR  0xBFE00000
+#define VDSO_PROC_ADDR  0xBFE01000
+#define VDSO_CLOCK_SHIFT 20
+
+typedef struct {
+    volatile unsigned int seq;
+    volatile unsigned int ticks;
+    unsigned int hz;
+    unsigned int clock_mult;
+    unsigned long long clock_base;
+} vdso_data_t;
+
+typedef struct {
+    unsigned int pid;
+    unsigned int created_at;
+    char name[32];
+} vdso_proc_t;
+
+#define vdso_data ((const vdso_data_t*)VDSO_DATA_ADDR)
+#define vdso_proc ((const vdso_proc_t*)VDSO_PROC_ADDR)
+
+static inline int vdso_getpid(void) {
+    return (int)vdso_proc->pid;
+}
+
+static inline const char* vdso_name(void) {
+    return vdso_proc->name;
+}
+
+// Timer ticks since boot (vdso_hz() per second)
+static inline unsigned int vdso_ticks(void) {
+    return vdso_data->ticks;
+}
+
+static inline unsigned int vdso_hz(void) {
+    return vdso_data->hz;
+}
+
+// Nanoseconds from the TSC, falling back to tick resolution when the
+// kernel has no calibrated TSC. The parameters are re-read if the kernel
+// changed them meanwhile.
+static inline unsigned long long vdso_clock_ns(void) {
+    unsigned int seq, mult, ticks, hz;
+    unsigned long long base;
+    
+    do {
+        seq = vdso_data->seq;
+        asm volatile("" ::: "memory");
+        mult = vdso_data->clock_mult;
+        base = vdso_data->clock_base;
+        ticks = vdso_data->ticks;
+        hz = vdso_data->hz;
+        asm volatile("" ::: "memory");
+    } while ((seq & 1) || seq != vdso_data->seq);
+    
+    if (!mult) {
+        return (unsigned long long)ticks * (1000000000u / hz);
+    }
+    
+    unsigned int lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    unsigned long long delta = (((unsigned long long)hi << 32) | lo) - base;
+    
+    // delta * mult >> shift without a 64-bit multiply or divide
+    unsigned int dlo = (unsigned int)delta;
+    unsigned int dhi = (unsigned int)(delta >> 32);
+    return (((unsigned long long)dlo * mult) >> VDSO_CLOCK_SHIFT) +
+           (((unsigned long long)dhi * mult) << (32 - VDSO_CLOCK_SHIFT));
+}
+
+#endif // USER_VDSO_H